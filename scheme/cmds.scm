@@ -386,22 +386,32 @@
 
 ;; Given a filename, return the GWDataFile object associated with
 ;; the data loaded from that file, or #f it there is no such file loaded.
-(define-public (find-wavefile name)
+;; If PLOT is given, only data loaded from that plot of the file,
+;; as numbered by wavefile-plot, will do.
+(define*-public (find-wavefile name #:optional (plot #f))
   (call-with-current-continuation
    (lambda (exit)
      (for-each (lambda (df)
-		 (if (string=? name (wavefile-file-name df))
+		 (if (and (string=? name (wavefile-file-name df))
+			  (or (not plot) (= plot (wavefile-plot df))))
 		     (exit df)))
               (wavefile-list))
      #f)))
 
 ;; locate a already-loaded wavefile by name, and if that fails,
 ;; try to load it.  If that fails too, return #f.
-(define-public (find-or-load-wavefile name)
-  (let* ((df (find-wavefile name)))
-    (if (not df)
-	(load-wavefile! name)
-	df)))
+;; A file still being read in the background is waited for.
+;; If VARS is a list of variable names, only those are read when
+;; the file is loaded; the others are read if they are displayed later.
+;; PLOT is the number of the plot of the file to find or load; see
+;; load-wavefile-plot!.  All of the variables of a plot other than
+;; the first are read.
+(define*-public (find-or-load-wavefile name #:optional (vars #f) (plot 0))
+  (let* ((df (find-wavefile name plot)))
+    (cond ((and (not df) (= plot 0)) (load-wavefile! name #f vars))
+	  ((not df) (load-wavefile-plot! name plot))
+	  ((wavefile-wait! df) df)
+	  (else #f))))
 
 ;; Write out a guile script that when executed by a future gwave,
 ;; will restore the configuration of waves displayed from 
@@ -474,20 +484,48 @@
 ; If "multi" is #t, multiple file-restoration sections will be written
 ; to this script.  In this case, we don't provide for the "apply script
 ; to (already loaded) file" function.
+; The script loads only the variables that it displays, from the plot
+; of the file that df was loaded from.
 (define (write-wfr-script df multi)
   (if multi
       (begin
 	(print "(let ((df (if script-target-datafile\n"
 	       "           script-target-datafile\n"
 	       "           (find-or-load-wavefile \""
-	       (wavefile-file-name df)  "\"))))\n"))
-      (print "(let ((df (find-or-load-wavefile \""
-	     (wavefile-file-name df) "\")))\n"))
+	       (wavefile-file-name df)  "\" '")
+	(write (wfr-varnames df))
+	(write-wfr-plot df)
+	(print "))))\n"))
+      (begin
+	(print "(let ((df (find-or-load-wavefile \""
+	       (wavefile-file-name df) "\" '")
+	(write (wfr-varnames df))
+	(write-wfr-plot df)
+	(print ")))\n")))
   (let ((panels (wtable-wavepanels)))
     (write-wfrp-lines df panels 0))
   (print ")\n")
   )
 
+; the plot argument for find-or-load-wavefile, unless it is the first.
+(define (write-wfr-plot df)
+  (if (not (= 0 (wavefile-plot df)))
+      (print " " (wavefile-plot df))))
+
+; names of the variables of a wavefile that are displayed, each once.
+(define (wfr-varnames df)
+  (let ((names '()))
+    (for-each
+     (lambda (wp)
+       (for-each
+	(lambda (vw)
+	  (if (and (eq? df (visiblewave-file vw))
+		   (not (member (visiblewave-varname vw) names)))
+	      (set! names (cons (visiblewave-varname vw) names))))
+	(wavepanel-visiblewaves wp)))
+     (wtable-wavepanels))
+    (reverse names)))
+
 ; recursive part of writing script for single wavefile.
 (define (write-wfrp-lines df panels n)
   (if (not (null? panels))
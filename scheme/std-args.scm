@@ -24,6 +24,7 @@
 	   (getopt-long (program-arguments)
 			`((nobacktrace  (single-char #\n))
 			  (panels       (single-char #\p) (value #t))
+			  (memory-budget (single-char #\m) (value #t))
 			  (script       (single-char #\s) (value #t))
 			  (verbose      (single-char #\v))
 			  (debug        (single-char #\x))
@@ -44,6 +45,10 @@
     (if a
         (set! initial-panels (string->number (cdr a)))))
 
+(let ((a (assq 'memory-budget opts)))
+    (if a
+        (set! wavefile-memory-budget (string->number (cdr a)))))
+
 (define startup-script #f)
 (let ((s (assq 'script opts)))
     (if s
@@ -73,17 +78,17 @@
  (lambda ()
    (dbprint "in std-args new-wavewin-hook\n")
    ; load files listed on the command line
-   (for-each (lambda (f)
-	       (load-wavefile! f)) 
-	     cmdline-files)
+   (load-wavefiles! cmdline-files #f #t)
 
    ; add the initial set of panels
    (do ((i 0 (+ i 1))) ((>= i initial-panels))
      (wtable-insert-typed-panel! #f default-wavepanel-type))
 
-   ; execute script specified with -s 
+   ; execute script specified with -s, once the files have been read
    (if startup-script
-       (load startup-script))
+       (begin
+	 (for-each wavefile-wait! (wavefile-list))
+	 (load startup-script)))
 ))
 
 
@@ -133,7 +133,7 @@
        (add-menuitem file-menu "About GWave" show-about-window!)
        (add-menuitem file-menu "Read File..." 
 		     (lambda () (with-selected-filename "Datafile to load"
-				 (lambda (fn) (load-wavefile! fn)))))
+				 (lambda (fn) (load-wavefile! fn #f #f #t)))))
        (add-menuitem file-menu "Plot..." 
 		     (lambda () (popup-plot-dialog (wtable-wavepanels))))
        (add-menuitem file-menu #f #f)
@@ -208,6 +208,20 @@
 	 (gtk-menu-item-set-submenu 
 	  (add-menuitem menu "ToolTips" #f) submenu))
 
+       (let ((submenu (gtk-menu-new))
+	     (group #f))
+	 (gtk-widget-show submenu)
+	 ; "Off" first, because of the immediate callback GTK gives the
+	 ; first radio-menu-item
+	 (set! group (add-radio-menuitem
+		      submenu group "Off" (not (auto-reload-files?))
+		      (lambda () (auto-reload-files! #f))))
+	 (set! group (add-radio-menuitem
+		      submenu group "On" (auto-reload-files?)
+		      (lambda () (auto-reload-files! #t))))
+	 (gtk-menu-item-set-submenu
+	  (add-menuitem menu "Reload Changed Files" #f) submenu))
+
        (let ((submenu (gtk-menu-new)))
 	 (gtk-widget-show submenu)
 	 (gtk-menu-item-set-submenu 
@@ -245,6 +259,9 @@
 	  (menu (menu-create mbar "File")))
        (add-menuitem menu "Reload this File" 
 		     (lambda () (wavefile-reload! df)))
+       (add-menuitem menu "Follow/Stop Following this File"
+		     (lambda () 
+		       (wavefile-follow! df (not (wavefile-following? df)))))
        (add-menuitem menu "Export Data..." 
 		     (lambda () 
 		       (popup-export-dialog (wavefile-all-variables df))))
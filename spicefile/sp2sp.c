@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <glib.h>
 #include "spicestream.h"
+#include "wavefile.h"
 
 #define SWEEP_NONE 0
 #define SWEEP_PREPEND 1
@@ -35,10 +36,12 @@
 int g_verbose = 0;
 int sweep_mode = SWEEP_PREPEND;
 char *progname = "sp2sp";
+WaveFile *range_wf = NULL;	/* with -i, the part of the file wanted */
 
 static void ascii_header_output(SpiceStream *sf, int *enab, int nidx);
 static void ascii_data_output(SpiceStream *sf, int *enab, int nidx,
 			      double begin_val, double end_val, int ndigits);
+static void wf_data_output(WaveFile *wf, int *indices, int nidx, int ndigits);
 static int parse_field_numbers(int **index, int *idxsize, int *nsel,
 			       char *list, int nfields);
 static int parse_field_names(int **index, int *idxsize, int *nsel,
@@ -60,8 +63,12 @@ static void usage()
 	fprintf(stderr, "                instead of end of input.\n");
   
 	fprintf(stderr, "  -f f1,f2,...  Output only fields named f1, f2, etc.\n");
+	fprintf(stderr, "  -i            with -b and -e, seek straight to that part of the input,\n");
+	fprintf(stderr, "                using its index file, which is made the first time\n");
 	fprintf(stderr, "  -n n1,n2,...  Output only fields n1, n2, etc;\n");
 	fprintf(stderr, "                independent variable is field number 0\n");
+	fprintf(stderr, "  -p N          Read plot N of a file with several, such as a spice3\n");
+	fprintf(stderr, "                rawfile; the first is plot 0.  -v lists them\n");
 	fprintf(stderr, "  -u U          Output only variables with units of type; U\n");
 	fprintf(stderr, "                U = volts, amps, etc.\n");
 	fprintf(stderr, "  -s S          Handle sweep parameters as S:\n");
@@ -86,13 +93,15 @@ static void usage()
 int
 main(int argc, char **argv)
 {
-	SpiceStream *sf;
+	SpiceStream *sf, *psf;
 
 	int i;
 	int idx;
 	extern int optind;
 	extern char *optarg;
 	int x_flag = 0;
+	int i_flag = 0;
+	int plot = -1;
 	int errflg = 0;
 	char *infiletype = "hspice";
 	char *outfiletype = "ascii";
@@ -101,13 +110,14 @@ main(int argc, char **argv)
 	int *out_indices = NULL;
 	int outi_size = 0;
 	int nsel;
+	char *want;
 	VarType vartype = UNKNOWN;
 	int c;
 	int ndigits = 7;
 	double begin_val = -DBL_MAX;
 	double end_val = DBL_MAX;
 
-	while ((c = getopt (argc, argv, "b:c:d:e:f:n:s:t:u:vx")) != EOF) {
+	while ((c = getopt (argc, argv, "b:c:d:e:f:in:p:s:t:u:vx")) != EOF) {
 		switch(c) {
 		case 'v':
 			spicestream_msg_level = DBG;
@@ -130,9 +140,15 @@ main(int argc, char **argv)
 		case 'f':
 			fieldnamelist = optarg;
 			break;
+		case 'i':
+			i_flag = 1;
+			break;
 		case 'n':
 			fieldnumlist = optarg;
 			break;
+		case 'p':
+			plot = atoi(optarg);
+			break;
 		case 's':
 			if(strcmp(optarg, "none") == 0)
 				sweep_mode = SWEEP_NONE;
@@ -161,12 +177,27 @@ main(int argc, char **argv)
 		}
 	}
 
+	if(i_flag && plot > 0) {
+		fprintf(stderr, "-i can only be used with the first plot\n");
+		errflg = 1;
+	}
 	if(errflg || optind >= argc)  {
 		usage();
 		exit(1);
 	}
 
-	sf = ss_open(argv[optind], infiletype);
+	if(i_flag) {
+		range_wf = wf_read_range(argv[optind], infiletype, WF_DOUBLE,
+					 begin_val, end_val);
+		sf = range_wf ? range_wf->ss : NULL;
+	} else {
+		sf = ss_open(argv[optind], infiletype);
+		if(sf && plot > 0) {
+			psf = ss_open_plot(sf, plot);
+			ss_delete(sf);
+			sf = psf;
+		}
+	}
 	if(!sf) {
 		if(errno)
 			perror(argv[optind]);
@@ -177,6 +208,13 @@ main(int argc, char **argv)
 		printf("filename: \"%s\"\n", sf->filename);
 		printf("  columns: %d\n", sf->ncols);
 		printf("  tables: %d\n", sf->ntables);
+		if(!range_wf && ss_plots(sf) > 1) {
+			printf("  plots: %d\n", sf->nplots);
+			for(i = 0; i < sf->nplots; i++)
+				printf("  %s plot %d \"%s\"\n",
+				       i == sf->plot ? "*" : " ", i,
+				       sf->plots[i].name ? sf->plots[i].name : "");
+		}
 		printf("independent variable:\n");
 		printf("  name: \"%s\"\n", sf->ivar->name);
 		printf("  type: %s\n", vartype_name_str(sf->ivar->type));
@@ -223,6 +261,16 @@ main(int argc, char **argv)
 		exit(0);
 	}
 
+	/* the reader needn't decode the values of the other variables */
+	if(!range_wf) {
+		want = g_new0(char, sf->ndv+1);
+		for(i = 0; i < nsel; i++)
+			if(out_indices[i] > 0)
+				want[out_indices[i]-1] = 1;
+		ss_select_vars(sf, want);
+		g_free(want);
+	}
+
 	if(strcmp(outfiletype, "cazm") == 0) {
 		printf("* CAZM-format output converted with sp2sp\n");
 		printf("\n");
@@ -241,7 +289,10 @@ main(int argc, char **argv)
 			progname, outfiletype);
 	}
 
-	ss_close(sf);
+	if(range_wf)
+		wf_free(range_wf);
+	else
+		ss_close(sf);
 
 	exit(0);
 }
@@ -281,6 +332,54 @@ ascii_header_output(SpiceStream *sf, int *indices, int nidx)
 	putchar('\n');
 }
 
+/*
+ * print the data of a file read with -i, as ascii_data_output() does.
+ */
+static void
+wf_data_output(WaveFile *wf, int *indices, int nidx, int ndigits)
+{
+	SpiceStream *sf = wf->ss;
+	WvTable *wt;
+	WaveVar *dv;
+	SSIndex row;
+	int i, j, t;
+
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		if(t > 0 && sweep_mode == SWEEP_HEAD) {
+			printf("# sweep %d;", t);
+			for(i = 0; i < sf->nsweepparam; i++) {
+				printf(" %s=%g", sf->spar[i].name, wt->swval);
+			}
+			putchar('\n');
+		}
+		for(row = 0; row < wt->nvalues; row++) {
+			if((sf->nsweepparam > 0) && (sweep_mode == SWEEP_PREPEND)) {
+				printf("%.*g ", ndigits, wt->swval);
+			}
+			for(i = 0; i < nidx; i++) {
+				if(i > 0)
+					putchar(' ');
+				if(indices[i] == 0) {
+					printf("%.*g", ndigits,
+					       wds_get_point(wt->iv->wds, row));
+					continue;
+				}
+				dv = &wt->dv[indices[i]-1];
+				for(j = 0; j < dv->wv_ncols; j++) {
+					if(j > 0)
+						putchar(' ');
+					printf("%.*g", ndigits,
+					       wds_get_point(&dv->wds[j], row));
+				}
+			}
+			putchar('\n');
+		}
+		if(sf->nsweepparam == 0)  /* as for a table ending with -2 */
+			sweep_mode = SWEEP_HEAD;
+	}
+}
+
 /*
  * print data as space-seperated columns.
  */
@@ -295,6 +394,10 @@ ascii_data_output(SpiceStream *sf, int *indices, int nidx,
 	double *spar = NULL;
 	int done;
 
+	if(range_wf) {
+		wf_data_output(range_wf, indices, nidx, ndigits);
+		return;
+	}
 	dvals = g_new(double, sf->ncols);
 	if(sf->nsweepparam > 0)
 		spar = g_new(double, sf->nsweepparam);
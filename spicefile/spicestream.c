@@ -29,6 +29,14 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <glib.h>
 
 #include "spicestream.h"
@@ -42,6 +50,9 @@ extern SpiceStream *sf_rdhdr_s2raw(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_ascii(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_nsout(char *name, FILE *fp);
 static int ss_readrow_none(SpiceStream *, double *ivar, double *dvars);
+static int ss_readsweep_none(SpiceStream *ss, double *svar);
+static int ss_map_fault(SpiceStream *ss);
+static void ss_plots_free(SpiceStream *ss);
 
 SSMsgLevel spicestream_msg_level = WARN;
 
@@ -93,12 +104,215 @@ ss_open_internal(FILE *fp, char *filename, char *format)
 	return NULL;
 }
 
+/*
+ * Decompressors for compressed waveform files, which are recognized by
+ * the magic number at the start of the file.  Each is run as a filter,
+ * using the first of its commands that can be found; where the program
+ * can decompress on several threads, it is told to use them all.
+ */
+typedef struct {
+	char *name;
+	int magiclen;
+	char *magic;
+	char *cmds[2][4];
+} SSCodec;
+
+static SSCodec codec_tab[] = {
+	{"gzip", 2, "\037\213",
+	 {{"pigz", "-dc", NULL}, {"gzip", "-dc", NULL}} },
+	{"zstd", 4, "\050\265\057\375",
+	 {{"zstd", "-dcq", "-T0", NULL}, {NULL}} },
+	{"xz", 6, "\375\067\172\130\132\000",
+	 {{"xz", "-dcq", "-T0", NULL}, {NULL}} },
+};
+static const int NCodecs = sizeof(codec_tab)/sizeof(SSCodec);
+
+#define SS_CANCEL_POLL_US	20000	/* how often a cancel flag is looked at */
+
+/*
+ * has the caller of ss_fopen_cancel() asked for it to stop?
+ */
+static int
+ss_cancelled(int *cancel)
+{
+	int c;
+
+	if(cancel == NULL)
+		return 0;
+	ss_lock();
+	c = *cancel;
+	ss_unlock();
+	return c;
+}
+
+/*
+ * run a decompressor from the file open on fd in to the one open on out.
+ * If cancel isn't NULL, the decompressor is killed if *cancel becomes
+ * nonzero before it has finished.
+ * Returns 0 on success, -1 on failure or if cancelled.
+ */
+static int
+ss_decompress(SSCodec *c, char *name, int in, int out, int *cancel)
+{
+	pid_t pid, rc;
+	int i, status;
+
+	pid = fork();
+	if(pid < 0) {
+		ss_msg(ERR, "ss_fopen", "%s: fork: %s", name, strerror(errno));
+		return -1;
+	}
+	if(pid == 0) {
+		if(dup2(in, 0) < 0 || dup2(out, 1) < 0)
+			_exit(126);
+		for(i = 0; i < 2 && c->cmds[i][0]; i++)
+			execvp(c->cmds[i][0], c->cmds[i]);
+		_exit(127);
+	}
+	for(;;) {
+		rc = waitpid(pid, &status, cancel ? WNOHANG : 0);
+		if(rc == pid)
+			break;
+		if(rc < 0 && errno != EINTR) {
+			ss_msg(ERR, "ss_fopen", "%s: waitpid: %s", name,
+			       strerror(errno));
+			return -1;
+		}
+		if(rc == 0) {
+			if(ss_cancelled(cancel)) {
+				kill(pid, SIGTERM);
+				while(waitpid(pid, &status, 0) < 0
+				      && errno == EINTR)
+					;
+				ss_msg(DBG, "ss_fopen", "%s: cancelled", name);
+				errno = ECANCELED;
+				return -1;
+			}
+			g_usleep(SS_CANCEL_POLL_US);
+		}
+	}
+	if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return 0;
+	if(WIFEXITED(status) && WEXITSTATUS(status) == 127)
+		ss_msg(ERR, "ss_fopen", "%s: can't run %s to decompress it",
+		       name, c->cmds[0][0]);
+	else
+		ss_msg(ERR, "ss_fopen", "%s: %s failed to decompress it",
+		       name, c->cmds[0][0]);
+	errno = EIO;
+	return -1;
+}
+
+/*
+ * create a temporary file, in $TMPDIR or wherever g_get_tmp_dir() says,
+ * with no name, so that it goes away when it is closed.
+ */
+FILE *
+ss_tmpfile(void)
+{
+	char *tname;
+	FILE *fp;
+	int fd;
+
+	tname = g_build_filename(g_get_tmp_dir(), "gwaveXXXXXX", NULL);
+	fd = mkstemp64(tname);
+	if(fd < 0) {
+		g_free(tname);
+		return NULL;
+	}
+	unlink(tname);
+	g_free(tname);
+	fp = fdopen(fd, "w+");
+	if(fp == NULL)
+		close(fd);
+	return fp;
+}
+
+/*
+ * Open a waveform file for reading, as fopen() does, except that a file
+ * compressed with gzip, zstd or xz is decompressed, into an unlinked
+ * temporary file in $TMPDIR, which is returned instead.  Readers can then
+ * map it, seek in it and find their way about it as if it were the file
+ * itself, and seek points noted in it are good for the next copy.
+ * Returns NULL, with errno set, if the file can't be opened or read.
+ */
+FILE *
+ss_fopen(char *name)
+{
+	return ss_fopen_cancel(name, NULL);
+}
+
+/*
+ * As ss_fopen(), except that if cancel isn't NULL, decompression stops,
+ * and NULL is returned with errno set to ECANCELED, as soon as *cancel,
+ * which is read under ss_lock(), is nonzero.
+ */
+FILE *
+ss_fopen_cancel(char *name, int *cancel)
+{
+	FILE *fp, *tfp;
+	unsigned char magic[8];
+	int n, i;
+
+	fp = fopen64(name, "r");
+	if(fp == NULL)
+		return NULL;
+	/* pread, so that a pipe isn't read from */
+	n = pread64(fileno(fp), magic, sizeof(magic), 0);
+	for(i = 0; i < NCodecs; i++)
+		if(n >= codec_tab[i].magiclen
+		   && memcmp(magic, codec_tab[i].magic,
+			     codec_tab[i].magiclen) == 0)
+			break;
+	if(i == NCodecs)
+		return fp;
+
+	ss_msg(DBG, "ss_fopen", "%s: decompressing with %s", name,
+	       codec_tab[i].name);
+	tfp = ss_tmpfile();
+	if(tfp == NULL) {
+		ss_msg(ERR, "ss_fopen", "%s: can't create temporary file in %s: %s",
+		       name, g_get_tmp_dir(), strerror(errno));
+		fclose(fp);
+		errno = EIO;
+		return NULL;
+	}
+	if(ss_decompress(&codec_tab[i], name, fileno(fp), fileno(tfp),
+			 cancel) < 0) {
+		n = errno;
+		fclose(tfp);
+		fclose(fp);
+		errno = n;
+		return NULL;
+	}
+	if(fseeko64(tfp, 0, SEEK_SET) < 0) {
+		fclose(tfp);
+		fclose(fp);
+		errno = EIO;
+		return NULL;
+	}
+	fclose(fp);
+	return tfp;
+}
+
+/*
+ * Is the file open on fd a decompressed copy made by ss_fopen(), rather
+ * than the file itself?  Such copies are regular files with no name.
+ */
+int
+ss_fd_decompressed(int fd)
+{
+	struct stat st;
+
+	return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink == 0;
+}
+
 SpiceStream *
 ss_open(char *filename, char *format)
 {
 	FILE *fp;
 
-	fp = fopen64(filename, "r");
+	fp = ss_fopen(filename);
 	if(fp == NULL) {
 		fprintf(stderr, "fopen(\"%s\"): %s\n", filename, strerror(errno));
 		return NULL;
@@ -148,7 +362,10 @@ void ss_close(SpiceStream *ss)
 {
 	fclose(ss->fp);
 	ss->fp = NULL;
+	ss_par_free(ss);
+	ss_unmap(ss);
 	ss->readrow = ss_readrow_none;
+	ss->readrows = NULL;
 }
 
 /*
@@ -158,6 +375,8 @@ void ss_delete(SpiceStream *ss)
 {
 	if(ss->fp)
 		fclose(ss->fp);
+	ss_par_free(ss);
+	ss_unmap(ss);
 	if(ss->filename)
 		g_free(ss->filename);
 	if(ss->ivar)
@@ -166,9 +385,663 @@ void ss_delete(SpiceStream *ss)
 		g_free(ss->dvar);
 	if(ss->linebuf)
 		g_free(ss->linebuf);
+	if(ss->vbuf)
+		g_free(ss->vbuf);
+	if(ss->rawbuf)
+		g_free(ss->rawbuf);
+	if(ss->colwant)
+		g_free(ss->colwant);
+	ss_plots_free(ss);
 	g_free(ss);
 }
 
+static void
+ss_plots_free(SpiceStream *ss)
+{
+	int i;
+
+	if(ss->plots) {
+		for(i = 0; i < ss->nplots; i++)
+			g_free(ss->plots[i].name);
+		g_free(ss->plots);
+		ss->plots = NULL;
+	}
+}
+
+/*
+ * Number of plots, or sets of results, in the file of a SpiceStream.
+ * They are found the first time, by looking through the file, if its
+ * reader can; a file that can't be looked through, such as a pipe, or
+ * whose reader doesn't know how, has just the one.
+ */
+int
+ss_plots(SpiceStream *ss)
+{
+	int n;
+
+	if(ss->nplots == 0) {
+		n = 0;
+		if(ss->findplots)
+			n = (ss->findplots)(ss);
+		if(n <= 0) {
+			ss_plots_free(ss);
+			n = 1;
+		}
+		ss->nplots = n;
+		ss_msg(DBG, "ss_plots", "%s: %d plots", ss->filename, n);
+	}
+	return ss->nplots;
+}
+
+/*
+ * Open plot n of the file of a SpiceStream, whose plots ss_plots() has
+ * found, as a SpiceStream of its own.  The file is opened again, and
+ * read from the start of the plot's header, without reading the plots
+ * before it.  Returns NULL if there is no such plot, or it can't be read.
+ */
+SpiceStream *
+ss_open_plot(SpiceStream *ss, int n)
+{
+	SpiceStream *nss;
+	FILE *fp;
+	int i;
+
+	if(n < 0 || n >= ss_plots(ss)) {
+		ss_msg(ERR, "ss_open_plot", "%s: no plot %d; there are %d",
+		       ss->filename, n, ss_plots(ss));
+		return NULL;
+	}
+	fp = ss_fopen(ss->filename);
+	if(fp == NULL) {
+		ss_msg(ERR, "ss_open_plot", "%s: %s", ss->filename,
+		       strerror(errno));
+		return NULL;
+	}
+	if(ss->plots && fseeko64(fp, ss->plots[n].hdrpos, SEEK_SET) < 0) {
+		ss_msg(ERR, "ss_open_plot", "%s: %s", ss->filename,
+		       strerror(errno));
+		fclose(fp);
+		return NULL;
+	}
+	nss = ss_open_internal(fp, ss->filename,
+			       ss_filetype_name(ss->filetype));
+	if(nss == NULL) {
+		fclose(fp);
+		return NULL;
+	}
+	nss->nplots = ss->nplots;
+	if(ss->plots) {
+		nss->plots = g_memdup(ss->plots, ss->nplots * sizeof(SSPlot));
+		for(i = 0; i < ss->nplots; i++)
+			nss->plots[i].name = g_strdup(ss->plots[i].name);
+	}
+	nss->plot = n;
+	return nss;
+}
+
+/*
+ * Say which dependent variables will be used, before any rows are read:
+ * want has an element for each, nonzero if it is wanted.  Readers that
+ * can skip over values cheaply don't decode those of the others, which
+ * are left 0.  If want is NULL, all of them are decoded.
+ */
+void
+ss_select_vars(SpiceStream *ss, char *want)
+{
+	int i, j;
+
+	if(ss->colwant) {
+		g_free(ss->colwant);
+		ss->colwant = NULL;
+	}
+	if(want == NULL)
+		return;
+	ss->colwant = g_new0(char, MAX(ss->ncols, 1));
+	for(i = 0; i < ss->ndv; i++)
+		for(j = 0; j < ss->dvar[i].ncols; j++)
+			ss->colwant[ss->dvar[i].col - 1 + j] = want[i] != 0;
+}
+
+/*
+ * Read up to nmax rows.  The independent variable's values go in ivbuf,
+ * and the dependent values in dvbuf, ncols to a row, laid out the
+ * same as the dvars filled in by ss_readrow().
+ * Returns the number of rows read, or when there are no more rows,
+ * the same 0, -1 or -2 that ss_readrow() would return.
+ * Readers without a readrows function are read a row at a time.
+ */
+static int
+ss_readrows_1(SpiceStream *ss, int nmax, double *ivbuf, double *dvbuf)
+{
+	int n, rc;
+
+	if(ss->rows_held) {
+		ss->rows_held = 0;
+		return ss->rows_rc;
+	}
+	if(ss->readrows)
+		return (ss->readrows)(ss, nmax, ivbuf, dvbuf);
+
+	for(n = 0; n < nmax; n++) {
+		rc = (ss->readrow)(ss, &ivbuf[n], &dvbuf[n * ss->ncols]);
+		if(rc <= 0)
+			return ss_rows_done(ss, n, rc);
+	}
+	return n;
+}
+
+int
+ss_readrows(SpiceStream *ss, int nmax, double *ivbuf, double *dvbuf)
+{
+	SSGuard g;
+	int rc;
+
+	if(ss->map == NULL)
+		return ss_readrows_1(ss, nmax, ivbuf, dvbuf);
+	ss_guard_push(&g);
+	if(sigsetjmp(g.env, 0))
+		return ss_map_fault(ss);
+	rc = ss_readrows_1(ss, nmax, ivbuf, dvbuf);
+	ss_guard_pop(&g);
+	return rc;
+}
+
+/*
+ * Read a row: the independent variable's value goes in *ivar, and
+ * the dependent values in dvars, ncols of them.
+ * Returns 1, 0 at the end of the data, -1 on error, or -2 at the start
+ * of another sweep, for which ss_readsweep() is then called.
+ */
+int
+ss_readrow(SpiceStream *ss, double *ivar, double *dvars)
+{
+	SSGuard g;
+	int rc;
+
+	if(ss->map == NULL)
+		return (ss->readrow)(ss, ivar, dvars);
+	ss_guard_push(&g);
+	if(sigsetjmp(g.env, 0))
+		return ss_map_fault(ss);
+	rc = (ss->readrow)(ss, ivar, dvars);
+	ss_guard_pop(&g);
+	return rc;
+}
+
+/*
+ * Read the sweep parameters at the start of a table into svar,
+ * nsweepparam of them.  Returns 1, or 0 or -1 if they can't be read.
+ */
+int
+ss_readsweep(SpiceStream *ss, double *svar)
+{
+	SSGuard g;
+	int rc;
+
+	if(ss->map == NULL)
+		return (ss->readsweep)(ss, svar);
+	ss_guard_push(&g);
+	if(sigsetjmp(g.env, 0))
+		return ss_map_fault(ss);
+	rc = (ss->readsweep)(ss, svar);
+	ss_guard_pop(&g);
+	return rc;
+}
+
+/*
+ * For readrows functions: finish a call that read n rows and then got
+ * status rc from the file.  If any rows were read, rc is held back and
+ * returned by the next call to ss_readrows().
+ */
+int
+ss_rows_done(SpiceStream *ss, int n, int rc)
+{
+	if(n == 0)
+		return rc;
+	ss->rows_held = 1;
+	ss->rows_rc = rc;
+	return n;
+}
+
+/*
+ * The file went away from under its mapping while it was being read:
+ * say so, and return errors from then on.
+ */
+static int
+ss_map_fault(SpiceStream *ss)
+{
+	ss_msg(ERR, "ss_readrow", "%s: file was cut short while being read",
+	       ss->filename);
+	ss_par_free(ss);
+	ss_unmap(ss);
+	ss->rows_held = 0;
+	ss->readrow = ss_readrow_none;
+	ss->readrows = NULL;
+	ss->readsweep = ss_readsweep_none;
+	return -1;
+}
+
+/*
+ * Map the file of a SpiceStream into memory, so that a binary reader can
+ * decode its data straight from the mapping rather than through stdio.
+ * Reading continues from the file's current position.
+ * Pipes, and files that can't be mapped, are left to be read with stdio.
+ * Returns 1 if the file was mapped, else 0.
+ */
+int
+ss_map(SpiceStream *ss)
+{
+#ifdef HAVE_MMAP
+	struct stat st;
+	void *map;
+
+	if(fstat(fileno(ss->fp), &st) < 0 || !S_ISREG(st.st_mode)
+	   || st.st_size == 0 || (size_t)st.st_size != st.st_size)
+		return 0;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+		   fileno(ss->fp), 0);
+	if(map == MAP_FAILED)
+		return 0;
+#ifdef MADV_SEQUENTIAL
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+	ss->map = map;
+	ss->mapsize = st.st_size;
+	ss->mappos = ftello64(ss->fp);
+	ss_msg(DBG, "ss_map", "%s: mapped %lld bytes", ss->filename,
+	       ss->mapsize);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void
+ss_unmap(SpiceStream *ss)
+{
+#ifdef HAVE_MMAP
+	if(ss->map)
+		munmap(ss->map, ss->mapsize);
+#endif
+	ss->map = NULL;
+}
+
+/*
+ * like fread(), from the SpiceStream's file, or its mapping if it has one.
+ */
+size_t
+ss_fread(void *buf, size_t size, size_t n, SpiceStream *ss)
+{
+	off64_t pos;
+	size_t got;
+
+	if(ss->map == NULL && (ss->flags & SSF_FOLLOW)) {
+		/* a file still being written may end part way through
+		 * an item; leave the part there to be read again later. */
+		pos = ftello64(ss->fp);
+		got = fread(buf, size, n, ss->fp);
+		if(got < n)
+			fseeko64(ss->fp, pos + got * size, SEEK_SET);
+		return got;
+	}
+	if(ss->map == NULL)
+		return fread(buf, size, n, ss->fp);
+	n = MIN(n, (ss->mapsize - ss->mappos) / size);
+	memcpy(buf, ss->map + ss->mappos, n * size);
+	ss->mappos += n * size;
+	return n;
+}
+
+/*
+ * For readers decoding straight from the mapping: return a pointer to
+ * the next *np items of the given size, or as many of them as remain,
+ * and move past them.  *np is set to the number of items.
+ * The pointer need not be aligned.
+ */
+char *
+ss_map_take(SpiceStream *ss, size_t size, int *np)
+{
+	char *p = ss->map + ss->mappos;
+
+	*np = MIN(*np, (ss->mapsize - ss->mappos) / size);
+	ss->mappos += *np * size;
+	return p;
+}
+
+/*
+ * position of the next byte to be read, for messages.
+ */
+SSIndex
+ss_tell(SpiceStream *ss)
+{
+	if(ss->map)
+		return ss->mappos;
+	return ftello64(ss->fp);
+}
+
+/*
+ * Read a file that may still be growing, such as the output of
+ * a simulation that is still running: read from the file itself rather
+ * than a mapping of it, so that rows appended later can be read too.
+ * Must be called before any rows have been read.
+ * Rows are then read between ss_mark() and ss_rewind(), so that a row
+ * that has only been partly written yet can be read again once it has
+ * been finished.
+ */
+void
+ss_follow(SpiceStream *ss)
+{
+	ss_par_stop(ss);
+	if(ss->map) {
+		fseeko64(ss->fp, ss->mappos, SEEK_SET);
+		ss_unmap(ss);
+	}
+	ss->flags |= SSF_FOLLOW;
+}
+
+/*
+ * Saved reading state of a SpiceStream, to go back to with ss_rewind().
+ * Only the state of reading rows is saved; it can't be used across
+ * ss_close() or a change of readrow function.
+ */
+struct _SSMark {
+	off64_t pos;
+	int flags;
+	int lineno;
+	int line_length;
+	SSIndex expected_vals;
+	SSIndex read_vals;
+	SSIndex read_rows;
+	int read_tables;
+	int read_sweepparam;
+	double ivval;
+	int rows_held;
+	int rows_rc;
+	int linep;	/* offset of linep in linebuf, or -1 if NULL */
+	char *linebuf;	/* copy of linebuf */
+	int lbufsize;
+	int nvals;	/* number of values not yet taken from vbuf, */
+	double *vals;	/* copy of them */
+	double *datrow;
+};
+
+/*
+ * Save the state of a SpiceStream read from a file, which must not be
+ * mapped, so that reading can go back to here with ss_rewind().
+ * The mark must be freed with ss_mark_free().
+ */
+SSMark *
+ss_mark(SpiceStream *ss)
+{
+	SSMark *m;
+
+	g_assert(ss->map == NULL && ss->par == NULL);
+	m = g_new0(SSMark, 1);
+	m->pos = ftello64(ss->fp);
+	m->flags = ss->flags;
+	m->lineno = ss->lineno;
+	m->line_length = ss->line_length;
+	m->expected_vals = ss->expected_vals;
+	m->read_vals = ss->read_vals;
+	m->read_rows = ss->read_rows;
+	m->read_tables = ss->read_tables;
+	m->read_sweepparam = ss->read_sweepparam;
+	m->ivval = ss->ivval;
+	m->rows_held = ss->rows_held;
+	m->rows_rc = ss->rows_rc;
+	m->linep = ss->linep ? ss->linep - ss->linebuf : -1;
+	if(ss->linebuf) {
+		m->linebuf = g_memdup(ss->linebuf, ss->lbufsize);
+		m->lbufsize = ss->lbufsize;
+	}
+	m->nvals = ss->vbuflen - ss->vbufpos;
+	if(m->nvals > 0)
+		m->vals = g_memdup(ss->vbuf + ss->vbufpos,
+				   m->nvals * sizeof(double));
+	if(ss->datrow)
+		m->datrow = g_memdup(ss->datrow,
+				     (ss->maxindex + 1) * sizeof(double));
+	return m;
+}
+
+/*
+ * Go back to reading a SpiceStream from where it was when the mark was
+ * made, as if nothing had been read since.
+ */
+void
+ss_rewind(SpiceStream *ss, SSMark *m)
+{
+	fseeko64(ss->fp, m->pos, SEEK_SET);
+	ss->flags = m->flags;
+	ss->lineno = m->lineno;
+	ss->line_length = m->line_length;
+	ss->expected_vals = m->expected_vals;
+	ss->read_vals = m->read_vals;
+	ss->read_rows = m->read_rows;
+	ss->read_tables = m->read_tables;
+	ss->read_sweepparam = m->read_sweepparam;
+	ss->ivval = m->ivval;
+	ss->rows_held = m->rows_held;
+	ss->rows_rc = m->rows_rc;
+	if(m->linebuf)	/* the buffer may have grown since, but never shrinks */
+		memcpy(ss->linebuf, m->linebuf, m->lbufsize);
+	ss->linep = (m->linep >= 0) ? ss->linebuf + m->linep : NULL;
+	ss->vbufpos = 0;
+	ss->vbuflen = m->nvals;
+	if(m->nvals > 0)
+		memcpy(ss->vbuf, m->vals, m->nvals * sizeof(double));
+	if(m->datrow)
+		memcpy(ss->datrow, m->datrow,
+		       (ss->maxindex + 1) * sizeof(double));
+}
+
+void
+ss_mark_free(SSMark *m)
+{
+	g_free(m->linebuf);
+	g_free(m->vals);
+	g_free(m->datrow);
+	g_free(m);
+}
+
+/*
+ * Note where a SpiceStream is, between two rows, in a form that can be
+ * kept in a file and given to ss_seek() later, perhaps with another
+ * SpiceStream opened on the same file, to carry on reading from here.
+ * Returns 1, or 0 if the reader is holding on to something that can't be
+ * described that way: part of a line of an hspice ascii file, say,
+ * the first value of the next sweep, or the state of an nsout file.
+ */
+int
+ss_seekpoint(SpiceStream *ss, SSSeekPoint *sp)
+{
+	SSGuard g;
+	int left, rc;
+	char *cp;
+
+	if(ss->rows_held || ss->datrow
+	   || (ss->flags & (SSF_PUSHBACK|SSF_FOLLOW)))
+		return 0;
+	if(ss->linep)
+		for(cp = ss->linep; *cp; cp++)
+			if(!isspace(*cp & 0xff))
+				return 0;
+
+	memset(sp, 0, sizeof(SSSeekPoint));
+	if(ss->par) {
+		ss_guard_push(&g);
+		if(sigsetjmp(g.env, 0))
+			return 0;	/* reading on will say why */
+		rc = ss_par_tell(ss, &sp->pos, &sp->lineno);
+		ss_guard_pop(&g);
+		if(!rc)
+			return 0;
+		sp->read_vals = ss->read_vals;
+	} else {
+		/* binary readers' decoded values came from just before
+		 * the current position, and can be read again */
+		left = ss->vbuflen - ss->vbufpos;
+		if(left > 0 && ss->valsize == 0)
+			return 0;
+		sp->pos = ss_tell(ss) - (SSIndex)left * ss->valsize;
+		sp->read_vals = ss->read_vals - left;
+		sp->lineno = ss->lineno;
+	}
+	sp->expected_vals = ss->expected_vals;
+	sp->read_rows = ss->read_rows;
+	sp->ivval = ss->ivval;
+	sp->read_tables = ss->read_tables;
+	sp->read_sweepparam = ss->read_sweepparam;
+	sp->flags = ss->flags & SSF_ESWAP;
+	return 1;
+}
+
+/*
+ * Carry on reading a SpiceStream from a place noted by ss_seekpoint().
+ * The header must have been read; any of the data may have been read
+ * since.  Returns 1, or 0 if the stream can't be moved there.
+ */
+int
+ss_seek(SpiceStream *ss, SSSeekPoint *sp)
+{
+	if(ss->datrow || (ss->flags & SSF_FOLLOW))
+		return 0;
+	if(ss->par) {
+		if(!ss_par_seek(ss, sp->pos, sp->lineno))
+			return 0;
+	} else if(ss->map) {
+		if(sp->pos > ss->mapsize)
+			return 0;
+		ss->mappos = sp->pos;
+	} else if(fseeko64(ss->fp, sp->pos, SEEK_SET) < 0) {
+		return 0;
+	}
+	ss->flags = (ss->flags & ~(SSF_ESWAP|SSF_PUSHBACK)) | sp->flags;
+	ss->expected_vals = sp->expected_vals;
+	ss->read_vals = sp->read_vals;
+	ss->read_rows = sp->read_rows;
+	ss->ivval = sp->ivval;
+	ss->read_tables = sp->read_tables;
+	ss->read_sweepparam = sp->read_sweepparam;
+	ss->lineno = sp->lineno;
+	ss->rows_held = 0;
+	ss->linep = NULL;
+	ss->vbuflen = ss->vbufpos = 0;
+	return 1;
+}
+
+/*
+ * Read the values in column col of the n rows that start at the seek
+ * point sp, which must all be in the same table, into buf, without
+ * reading the other columns, and move sp past them.  Column 0 is the
+ * independent variable; the others are numbered as SpiceVar.col numbers
+ * them.  Only readers of formats whose values are at places that can
+ * be worked out, such as binary ones with fixed-size rows, can do this,
+ * and only while the file is open.
+ * Returns n, or -1 if the reader can't, or the file ends first.
+ */
+int
+ss_readcol(SpiceStream *ss, SSSeekPoint *sp, int col, SSIndex n,
+	   double *buf)
+{
+	SSIndex i;
+	int k;
+
+	if(ss->readcol == NULL || ss->fp == NULL)
+		return -1;
+	for(i = 0; i < n; i += k) {
+		k = MIN(n - i, SS_VBUFSIZE);
+		if((ss->readcol)(ss, sp, col, k, buf + i) != k)
+			return -1;
+	}
+	return n;
+}
+
+#define SS_PREAD_RUN	65536	/* most bytes ss_pread_items() reads at once */
+
+/*
+ * For readcol functions: read n items of size bytes from the file of
+ * a SpiceStream into buf, the first at offset pos and each of the others
+ * stride bytes after the one before.  Items that are close together are
+ * read a run at a time; those far apart are read one at a time, without
+ * reading what is between them.
+ * Returns the number of items read, less than n if the file ends first.
+ */
+int
+ss_pread_items(SpiceStream *ss, long long pos, long long stride, int size,
+	       int n, char *buf)
+{
+	char *run;
+	ssize_t want, got;
+	int i, j, k, per, fd;
+
+	fd = fileno(ss->fp);
+	if(stride >= SS_PREAD_RUN) {
+		for(i = 0; i < n; i++)
+			if(pread64(fd, buf + i * size, size,
+				   pos + i * stride) != size)
+				return i;
+		return n;
+	}
+	per = SS_PREAD_RUN / stride;
+	run = g_malloc(per * stride);
+	for(i = 0; i < n; i += k) {
+		k = MIN(n - i, per);
+		want = (k - 1) * stride + size;
+		got = pread64(fd, run, want, pos + i * stride);
+		if(got < want)
+			k = (got >= size) ? (got - size) / stride + 1 : 0;
+		for(j = 0; j < k; j++)
+			memcpy(buf + (i + j) * size, run + j * stride, size);
+		if(got < want) {
+			i += k;
+			break;
+		}
+	}
+	g_free(run);
+	return MIN(i, n);
+}
+
+/*
+ * Close a SpiceStream, as ss_close() does, except that if its reader
+ * can read columns with ss_readcol(), its file is kept open for that,
+ * until ss_delete().  A decompressed copy of a file, open only here,
+ * is then kept too, rather than having to be made again.
+ * Returns 1 if the file was kept open, else 0.
+ */
+int
+ss_close_keep(SpiceStream *ss)
+{
+	if(ss->readcol == NULL || ss->fp == NULL) {
+		ss_close(ss);
+		return 0;
+	}
+	ss_par_free(ss);
+	ss_unmap(ss);
+	ss->readrow = ss_readrow_none;
+	ss->readrows = NULL;
+	return 1;
+}
+
+/*
+ * Estimate the total number of rows in the file, over all tables.
+ * This can be useful to aid in memory-use planning by programs
+ * planning to read the entire file.
+ * Returns 0 if the reader can't make an estimate.
+ */
+SSIndex
+ss_guessrows(SpiceStream *ss)
+{
+	SSIndex n;
+
+	if(ss->guessrows == NULL || ss->fp == NULL)
+		return 0;
+	n = (ss->guessrows)(ss);
+	if(n < 0)
+		return 0;
+	return n;
+}
+
 /*
  * row-reading function that always returns EOF.
  */
@@ -178,6 +1051,12 @@ ss_readrow_none(SpiceStream *ss, double *ivar, double *dvars)
 	return 0;
 }
 
+static int
+ss_readsweep_none(SpiceStream *ss, double *svar)
+{
+	return -1;
+}
+
 
 static char *vartype_names[] = {
 	"Unknown", "Time", "Voltage", "Current", "Frequency"
@@ -243,6 +1122,68 @@ char *ss_filetype_name(int n)
 		return NULL;
 }
 
+/* FNV-1a, for ss_header_hash() */
+static guint32
+ss_hash_bytes(guint32 h, const void *p, size_t n)
+{
+	const guchar *s = p;
+
+	while(n-- > 0) {
+		h ^= *s++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static guint32
+ss_hash_var(guint32 h, SpiceVar *sv)
+{
+	gint32 v[3];
+
+	if(sv->name)
+		h = ss_hash_bytes(h, sv->name, strlen(sv->name) + 1);
+	v[0] = sv->type;
+	v[1] = sv->col;
+	v[2] = sv->ncols;
+	return ss_hash_bytes(h, v, sizeof(v));
+}
+
+/*
+ * Return a hash of the parts of a SpiceStream's header that determine
+ * how its data is laid out and stored: the format, the size of values,
+ * and the names, types and columns of the variables.
+ * Files whose headers hash the same can be read into the same WaveFile.
+ */
+unsigned int
+ss_header_hash(SpiceStream *ss)
+{
+	guint32 h = 2166136261U;
+	gint32 v[5];
+	int i;
+
+	v[0] = ss->filetype;
+	v[1] = ss->valsize;
+	v[2] = ss->ndv;
+	v[3] = ss->ncols;
+	v[4] = ss->nsweepparam;
+	h = ss_hash_bytes(h, v, sizeof(v));
+	h = ss_hash_var(h, ss->ivar);
+	for(i = 0; i < ss->ndv; i++)
+		h = ss_hash_var(h, &ss->dvar[i]);
+	for(i = 0; i < ss->nsweepparam; i++)
+		h = ss_hash_var(h, &ss->spar[i]);
+	return h;
+}
+
+/* the stream is locked once per line rather than once per character */
+#ifdef HAVE_GETC_UNLOCKED
+#define ss_getc getc_unlocked
+#else
+#define ss_getc getc
+#define flockfile(fp)
+#define funlockfile(fp)
+#endif
+
 /*
  * utility function to read whole line into buffer, expanding buffer if needed.
  * line buffer must be allocated with g_malloc/g_new, or NULL in which case
@@ -259,13 +1200,15 @@ fread_line(FILE *fp, char **bufp, int *bufsize)
 			*bufsize = 1024;
 		*bufp = g_new(char, *bufsize);
 	}
-	while(((c = getc(fp)) != EOF) && c != '\n') {
+	flockfile(fp);
+	while(((c = ss_getc(fp)) != EOF) && c != '\n') {
 		(*bufp)[n++] = c;
 		if(n >= *bufsize) {
 			*bufsize *= 2;
 			*bufp = g_realloc(*bufp, *bufsize);
 		}
 	}
+	funlockfile(fp);
 	(*bufp)[n] = 0;
 	if(c == EOF)
 		return EOF;
@@ -7,12 +7,18 @@
  *
  */
 
+#ifndef SPICESTREAM_H
+#define SPICESTREAM_H
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
 
 typedef struct _SpiceStream SpiceStream;
 typedef struct _SpiceVar SpiceVar;
+typedef struct _SSMark SSMark;
+typedef struct _SSSeekPoint SSSeekPoint;
+typedef struct _SSPlot SSPlot;
 
 
 typedef enum {
@@ -28,6 +34,7 @@ extern FILE *ss_error_file;
 typedef void (*SSMsgHook) (char *s);
 extern SSMsgHook ss_error_hook;
 extern SSMsgLevel spicestream_msg_level;
+extern int spicestream_nthreads;
 
 /* header data on each variable mentioned in the file
  * For sweep parameters, ncols will be 0.
@@ -39,8 +46,16 @@ struct _SpiceVar {
 	int ncols;  /* number of columns of data for this variable; complex numbers have two */
 };	
 
+/* Row numbers and counts of rows or values.  These are 64 bits even
+ * where long is not, so that very large files can be read. */
+typedef long long SSIndex;
+
 typedef int (*SSReadRow) (SpiceStream *sf, double *ivar, double *dvars);
+typedef int (*SSReadRows) (SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf);
 typedef int (*SSReadSweep) (SpiceStream *sf, double *spar);
+typedef SSIndex (*SSGuessRows) (SpiceStream *sf);
+typedef int (*SSFindPlots) (SpiceStream *sf);
+typedef int (*SSReadCol) (SpiceStream *sf, SSSeekPoint *sp, int col, int n, double *buf);
 
 struct _SpiceStream {
 	char *filename;
@@ -52,12 +67,30 @@ struct _SpiceStream {
 	SpiceVar *spar; /* ptr to array of sweep parameter info */
 
 	SSReadRow readrow;  /* func to read one row of data points */
+	SSReadRows readrows;  /* func to read many rows at once; may be NULL */
 	SSReadSweep readsweep;  /* func to read one row of data points */
+	SSGuessRows guessrows;  /* func to estimate number of rows; may be NULL */
+	SSFindPlots findplots;  /* func to find the plots in the file; may be NULL */
+	SSReadCol readcol;	/* func to read one column of many rows from
+				 * a seek point; may be NULL.  See ss_readcol() */
 	int ntables;	/* number of data tables in the file; not
 			* reliable for all file formats */
 	int nsweepparam; /* number of implicit sweep parameter values at the start
 			  * of each table; may be 0 even for a multi-variate
 			  * sweep in some file formats */
+	int valsize;	/* size in bytes of the values stored in the file:
+			 * sizeof(float) for single-precision formats,
+			 * 0 if unknown or not binary */
+	int events;	/* nonzero if the format records only the values
+			 * that change at each row, as the outputs of
+			 * event-driven simulators do */
+	char *colwant;	/* if not NULL, nonzero for each column of dvars
+			 * that is wanted; readers needn't decode the
+			 * others.  See ss_select_vars(). */
+	int nplots;	/* number of plots in the file, once ss_plots()
+			 * has found them; 0 until then */
+	SSPlot *plots;	/* where they are, if the reader could find them */
+	int plot;	/* which of them this stream reads */
 
 	/* the following stuff is for private use of reader routines */
 	FILE *fp;
@@ -66,13 +99,24 @@ struct _SpiceStream {
 	char *linebuf;
 	int line_length;
 	int lbufsize;
-	int expected_vals;
-	int read_vals;
-	int read_rows;
+	SSIndex expected_vals;
+	SSIndex read_vals;
+	SSIndex read_rows;
 	int read_tables;
 	int read_sweepparam;
 	char *linep;
 	double ivval;
+	double *vbuf;	/* values decoded in bulk by binary readers */
+	int vbufsize;	/* number of values vbuf has room for */
+	int vbuflen;	/* number of values in vbuf */
+	int vbufpos;	/* next value in vbuf to return */
+	void *rawbuf;	/* values as read, before decoding */
+	int rows_held;	/* ss_readrows() has held back a status, */
+	int rows_rc;	/* this one */
+	char *map;	/* the whole file, if ss_map() mapped it */
+	SSIndex mapsize;
+	SSIndex mappos;	/* offset in map of the next byte to read */
+	struct _SSPar *par;	/* state of parallel parsing, see ssthread.c */
 
 	/* following for nsout format */
 	double voltage_resolution;
@@ -83,25 +127,79 @@ struct _SpiceStream {
 	int *nsindexes; /* indexed by dvar, contains ns index number */
 };
 
+/* A place between two rows of a file's data from which reading can
+ * carry on as if everything before it had been read; see ss_seekpoint().
+ * Unlike an SSMark, it holds nothing that can't be written to a file.
+ */
+struct _SSSeekPoint {
+	SSIndex pos;	/* offset in the file of the next row */
+	SSIndex expected_vals;
+	SSIndex read_vals;
+	SSIndex read_rows;
+	double ivval;
+	int read_tables;
+	int read_sweepparam;
+	int lineno;
+	int flags;	/* SSF_ESWAP, if set */
+};
+
+/* One of the sets of results in a file that can hold several, such as
+ * the operating-point, AC and transient "plots" of a spice3 rawfile.
+ * See ss_plots() and ss_open_plot().
+ */
+struct _SSPlot {
+	char *name;	/* as the file names it, such as "AC Analysis" */
+	SSIndex hdrpos;	/* offset in the file of its header */
+	SSIndex datapos; /* and of its data */
+	SSIndex npoints; /* number of rows the header promises */
+	int nvars;	/* including the independent variable */
+};
+
 /* values for flags field */
 #define SSF_ESWAP 1
 #define SSF_PUSHBACK 2
-
-#define ss_readrow(sf, ivp, dvp) ((sf->readrow)(sf, ivp, dvp))
-#define ss_readsweep(sf, swp) ((sf->readsweep)(sf, swp))
+#define SSF_FOLLOW 4	/* file may still be growing; see ss_follow() */
 
 extern SpiceStream *ss_open(char *filename, char *type);
+extern int ss_readrow(SpiceStream *ss, double *ivar, double *dvars);
+extern int ss_readsweep(SpiceStream *ss, double *svar);
 extern SpiceStream *ss_open_fp(FILE *fp, char *type);
+extern FILE *ss_fopen(char *name);
+extern FILE *ss_fopen_cancel(char *name, int *cancel);
+extern int ss_fd_decompressed(int fd);
 extern SpiceStream *ss_open_internal(FILE *fp, char *name, char *type);
 extern SpiceStream *ss_new(FILE *fp, char *name, int ndv, int nspar);
 extern void ss_close(SpiceStream *sf);
+extern void ss_delete(SpiceStream *sf);
 extern char *ss_var_name(SpiceVar *sv, int col, char *buf, int n);
 extern char *vartype_name_str(VarType type);
+extern SSIndex ss_guessrows(SpiceStream *ss);
+extern int ss_readrows(SpiceStream *ss, int nmax, double *ivbuf, double *dvbuf);
+extern void ss_select_vars(SpiceStream *ss, char *want);
+extern int ss_rows_done(SpiceStream *ss, int n, int rc);
+extern int ss_map(SpiceStream *ss);
+extern size_t ss_fread(void *buf, size_t size, size_t n, SpiceStream *ss);
+extern char *ss_map_take(SpiceStream *ss, size_t size, int *np);
+extern SSIndex ss_tell(SpiceStream *ss);
+extern void ss_follow(SpiceStream *ss);
+extern SSMark *ss_mark(SpiceStream *ss);
+extern void ss_rewind(SpiceStream *ss, SSMark *m);
+extern void ss_mark_free(SSMark *m);
+extern int ss_seekpoint(SpiceStream *ss, SSSeekPoint *sp);
+extern int ss_seek(SpiceStream *ss, SSSeekPoint *sp);
+extern int ss_readcol(SpiceStream *ss, SSSeekPoint *sp, int col, SSIndex n,
+		      double *buf);
+extern int ss_close_keep(SpiceStream *ss);
+extern int ss_plots(SpiceStream *ss);
+extern SpiceStream *ss_open_plot(SpiceStream *ss, int n);
 extern int fread_line(FILE *fp, char **bufp, int *bufsize);
 extern void ss_msg(SSMsgLevel type, const char *id, const char *msg, ...);
 extern char *ss_filetype_name(int n);
+extern unsigned int ss_header_hash(SpiceStream *ss);
 
 
 #ifdef __cplusplus
 	   }
 #endif 
+
+#endif /* SPICESTREAM_H */
@@ -38,6 +38,7 @@
  */
 #define _FILE_OFFSET_BITS 64
 
+#include "ssintern.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,6 +50,10 @@
 #include "spicestream.h"
 
 static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_parse_ascii(SpiceStream *sf, const char **pp, const char *end,
+			  double *ivar, double *dvars);
+static const char *sf_find_ascii(SpiceStream *sf, const char *p,
+				 const char *end);
 static SpiceStream *ascii_process_header(char *line, VarType ivtype,
 				  char *fname, int lineno);
 
@@ -101,6 +106,7 @@ sf_rdhdr_cazm(char *name, FILE *fp)
 	sf->lineno = lineno;
 	sf->linebuf = line;
 	sf->lbufsize = linesize;
+	ss_par_start(sf, sf_parse_ascii, sf_find_ascii, 0);
 	return sf;
 
  fail:
@@ -149,6 +155,7 @@ sf_rdhdr_ascii(char *name, FILE *fp)
 	sf->lineno = lineno;
 	sf->linebuf = line;
 	sf->lbufsize = linesize;
+	ss_par_start(sf, sf_parse_ascii, sf_find_ascii, 0);
 	return sf;
 
  fail:
@@ -168,9 +175,11 @@ SpiceStream *ascii_process_header(char *line, VarType ivtype,
 {
 	SpiceStream *sf;
 	char *signam;
+	char *lp;
 	int dvsize = 64;
 
-	signam = strtok(line, " \t\n");
+	lp = line;
+	signam = ss_strtok(&lp, " \t\n");
 	if(!signam) {
 		ss_msg(ERR, "ascii_process_header", "%s:%d: syntax error in header", fname, lineno);
 		return NULL;
@@ -194,7 +203,7 @@ SpiceStream *ascii_process_header(char *line, VarType ivtype,
 	sf->ndv = 0;
 	sf->ncols = 1;
 	sf->ntables = 1;
-	while((signam = strtok(NULL, " \t\n")) != NULL) {
+	while((signam = ss_strtok(&lp, " \t\n")) != NULL) {
 		if(sf->ndv >= dvsize) {
 			dvsize *= 2;
 			sf->dvar = g_realloc(sf->dvar, dvsize * sizeof(SpiceVar));
@@ -225,14 +234,15 @@ static int
 sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
 {
 	int i;
-	char *tok;
+	char *tok, *lp;
 
 	if(fread_line(sf->fp, &sf->linebuf, &sf->lbufsize) == EOF) {
 		return 0;
 	}
 	sf->lineno++;
 
-	tok = strtok(sf->linebuf, " \t\n");
+	lp = sf->linebuf;
+	tok = ss_strtok(&lp, " \t\n");
 	if(!tok) {
 		return 0;  /* blank line can indicate end of data */
 	}
@@ -245,15 +255,84 @@ sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
 		return -1;
 	}
 
-	*ivar = atof(tok);
+	*ivar = ss_strtod(tok, NULL);
 	
 	for(i = 0; i < sf->ncols-1; i++) {
-		tok = strtok(NULL, " \t\n");
+		tok = ss_strtok(&lp, " \t\n");
 		if(!tok) {
 			ss_msg(ERR, "sf_readrow_ascii", "%s:%d: data field %d missing", sf->filename, sf->lineno, i);
 			return -1;
 		}
-		dvars[i] = atof(tok);
+		dvars[i] = SS_WANTCOL(sf, i) ? ss_strtod(tok, NULL) : 0;
 	}
 	return 1;
 }
+
+/*
+ * Find the next whitespace-seperated token on the line ending at eol,
+ * for sf_parse_ascii.  Returns NULL if there isn't one.
+ */
+static const char *
+ascii_token(const char **pp, const char *eol, int *np)
+{
+	const char *p = *pp;
+	const char *tok;
+
+	while(p < eol && (*p == ' ' || *p == '\t'))
+		p++;
+	if(p == eol)
+		return NULL;
+	tok = p;
+	while(p < eol && *p != ' ' && *p != '\t')
+		p++;
+	*np = p - tok;
+	*pp = p;
+	return tok;
+}
+
+/*
+ * Parse one line of an ascii- or cazm- format file, from a mapping,
+ * just as sf_readrow_ascii would read it.
+ */
+static int
+sf_parse_ascii(SpiceStream *sf, const char **pp, const char *end,
+	       double *ivar, double *dvars)
+{
+	const char *p = *pp;
+	const char *eol, *tok;
+	int i, n;
+
+	eol = memchr(p, '\n', end - p);
+	if(eol == NULL)
+		return 0;	/* incomplete last line is ignored */
+
+	tok = ascii_token(&p, eol, &n);
+	if(!tok)
+		return 0;  /* blank line can indicate end of data */
+	for(i = 0; i < n; i++) {
+		if(!tok[i] || !strchr("0123456789eE+-.", tok[i]))
+			return SSP_SERIAL;	/* for the error message */
+	}
+	*ivar = ss_strtod_n(tok, n, NULL);
+
+	for(i = 0; i < sf->ncols-1; i++) {
+		tok = ascii_token(&p, eol, &n);
+		if(!tok)
+			return SSP_SERIAL;
+		dvars[i] = SS_WANTCOL(sf, i) ? ss_strtod_n(tok, n, NULL) : 0;
+	}
+	*pp = eol + 1;
+	return 1;
+}
+
+/*
+ * return the start of the first line at or after p.
+ */
+static const char *
+sf_find_ascii(SpiceStream *sf, const char *p, const char *end)
+{
+	const char *nl;
+
+	nl = memchr(p - 1, '\n', end - (p - 1));
+	return nl ? nl + 1 : end;
+}
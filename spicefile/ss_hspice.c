@@ -32,18 +32,28 @@
 #include <glib.h>
 #include "spicestream.h"
 
+#if defined(__GNUC__) && (__GNUC__ >= 5) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define HS_DECODE_X86 1
+#include <immintrin.h>
+#endif
+
 SpiceStream *sf_rdhdr_hspice(char *name, FILE *fp);
 SpiceStream *sf_rdhdr_hsascii(char *name, FILE *fp);
 SpiceStream *sf_rdhdr_hsbin(char *name, FILE *fp);
 
 static int sf_readrow_hsascii(SpiceStream *sf, double *ivar, double *dvars);
 static int sf_readrow_hsbin(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_hsbin(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf);
+static int sf_readcol_hsbin(SpiceStream *sf, SSSeekPoint *sp, int col, int n, double *buf);
+typedef struct _HSHeader HSHeader;
 static SpiceStream *hs_process_header(int nauto, int nprobe, 
-				      int nsweepparam, char *line, char *name);
+				      int nsweepparam, HSHeader *h, char *name);
 static int sf_readsweep_hsascii(SpiceStream *sf, double *svar);
 static int sf_readsweep_hsbin(SpiceStream *sf, double *svar);
 static int sf_endblock_hsbin(SpiceStream *sf);
 static int sf_readblock_hsbin(FILE *fp, char **bufp, int *bufsize, int offset);
+static SSIndex sf_guessrows_hsbin(SpiceStream *sf);
 
 struct hsblock_header {  /* structure of binary tr0 block headers */
 	gint32 h1;
@@ -52,12 +62,9 @@ struct hsblock_header {  /* structure of binary tr0 block headers */
 	gint32 block_nbytes;
 };
 
-union gint32bytes {
-	gint32 i;
-	gchar b[4];
-};
-
 static void swap_gint32(gint32 *pi, size_t n);
+static void swap_header(struct hsblock_header *hh);
+static void hs_decode_floats(double *dst, char *src, int n, int swap);
 
 /* Read spice-type file header - autosense hspice binary or ascii */
 SpiceStream *
@@ -76,20 +83,177 @@ sf_rdhdr_hspice(char *name, FILE *fp)
 	return NULL;
 }
 
+/*
+ * The variable types and names of an HSPICE file come after some fixed
+ * fields at the start of its header, as whitespace-seperated tokens
+ * ending with "$&%#".  In an ascii file they may be split across lines,
+ * and in a binary file across blocks, in either case anywhere at all,
+ * even in the middle of a name; the pieces are run together.
+ * There may be megabytes of them, so they are read a token at a time,
+ * and each piece is only looked at once.
+ */
+#define HS_ENDMARK	"$&%#"
+#define HS_HDR_SLACK	100	/* pieces that may follow the last name */
+
+struct _HSHeader {
+	FILE *fp;
+	int binary;	/* read by blocks, else by lines */
+	int lineno;	/* for ascii files, lines read */
+	char *buf;	/* the piece being read */
+	int bufsize;
+	int len;	/* its length */
+	int pos;	/* next byte of it to look at */
+	int mark;	/* number of bytes of HS_ENDMARK just seen */
+	int ended;	/* the piece with HS_ENDMARK in it has been read */
+	char *tok;	/* the token returned by hs_hdr_token() */
+	int toksize;
+};
+
+static void
+hs_hdr_init(HSHeader *h, FILE *fp, int binary)
+{
+	memset(h, 0, sizeof(HSHeader));
+	h->fp = fp;
+	h->binary = binary;
+	h->toksize = 64;
+	h->tok = g_new(char, h->toksize);
+}
+
+static void
+hs_hdr_free(HSHeader *h)
+{
+	g_free(h->buf);
+	g_free(h->tok);
+}
+
+/*
+ * read the next piece of the header: a line of an ascii file, without
+ * its newline, or a block of a binary one.
+ * Returns 1, or 0 if there are no more, because the end of the header
+ * has been read or the file ended first.
+ */
+static int
+hs_hdr_fill(HSHeader *h)
+{
+	const char *mark = HS_ENDMARK;
+	int i, n;
+
+	if(h->ended)
+		return 0;
+	if(h->binary) {
+		n = sf_readblock_hsbin(h->fp, &h->buf, &h->bufsize, 0);
+		if(n <= 0)
+			return 0;
+	} else {
+		if(h->buf == NULL) {
+			h->bufsize = 256;
+			h->buf = g_new(char, h->bufsize);
+		}
+		if(fgets(h->buf, h->bufsize, h->fp) == NULL)
+			return 0;
+		h->lineno++;
+		n = strlen(h->buf);
+		if(n > 0 && h->buf[n-1] == '\n')
+			n--;
+	}
+	h->len = n;
+	h->pos = 0;
+
+	/* the end marker may itself be split between pieces */
+	for(i = 0; i < n && !h->ended; i++) {
+		if(h->buf[i] == mark[h->mark])
+			h->mark++;
+		else
+			h->mark = (h->buf[i] == mark[0]);
+		if(mark[h->mark] == '\0')
+			h->ended = 1;
+	}
+	return 1;
+}
+
+/*
+ * copy the next n bytes of the header, which is at the start of
+ * the first piece, into buf, and terminate them.
+ * Returns 1, or 0 if there aren't that many.
+ */
+static int
+hs_hdr_fixed(HSHeader *h, char *buf, int n)
+{
+	int i = 0, k;
+
+	while(i < n) {
+		if(h->pos >= h->len && !hs_hdr_fill(h))
+			return 0;
+		k = MIN(n - i, h->len - h->pos);
+		memcpy(buf + i, h->buf + h->pos, k);
+		h->pos += k;
+		i += k;
+	}
+	buf[n] = '\0';
+	return 1;
+}
+
+/*
+ * return the next token in the header, or NULL if there are no more.
+ * The token stays put until the next call.
+ */
+static char *
+hs_hdr_token(HSHeader *h)
+{
+	int n = 0;
+	int c;
+
+	for(;;) {
+		if(h->pos >= h->len && !hs_hdr_fill(h))
+			break;
+		c = h->buf[h->pos];
+		if(c == ' ' || c == '\t' || c == '\n' || c == '\0') {
+			h->pos++;
+			if(n > 0)
+				break;
+			continue;
+		}
+		if(n + 1 >= h->toksize) {
+			h->toksize *= 2;
+			h->tok = g_realloc(h->tok, h->toksize);
+		}
+		h->tok[n++] = c;
+		h->pos++;
+	}
+	if(n == 0)
+		return NULL;
+	h->tok[n] = '\0';
+	return h->tok;
+}
+
+/*
+ * skip the rest of the header, once all of the names have been read,
+ * through the end of the piece with the end marker in it.  The marker
+ * should be close by.  Returns 1, or 0 if it isn't.
+ */
+static int
+hs_hdr_finish(HSHeader *h)
+{
+	int n;
+
+	for(n = 0; !h->ended; n++)
+		if(n > HS_HDR_SLACK || !hs_hdr_fill(h))
+			return 0;
+	h->pos = h->len;
+	return 1;
+}
+
 /* Read spice-type file header - hspice ascii */
 SpiceStream *
 sf_rdhdr_hsascii(char *name, FILE *fp)
 {
 	SpiceStream *sf = NULL;
-	char *line = NULL;
+	HSHeader h;
 	int nauto, nprobe, nsweepparam, ntables;
 	int lineno = 0;
-	int linesize = 1024;
-	int lineused;
 	char lbuf[256];
 	char nbuf[16];
 	char *cp;
-	int maxlines;
 
 	if(fgets(lbuf, sizeof(lbuf), fp) == NULL)
 		return NULL;
@@ -125,50 +289,27 @@ sf_rdhdr_hsascii(char *name, FILE *fp)
 		ntables = 1;
 	lineno++;
 
-	maxlines = nauto + nprobe + nsweepparam + 100;
 	/* lines making up a fixed-field structure with variable-types and
 	 * variable names.
-	 * variable names can get split across lines! so we remove newlines,
-	 * paste all of the lines together, and then deal with the
-	 * whole header at once.
-	 * A variable name of "$&%#" indicates the end!
 	 */
-	line = g_new0(char, linesize);
-	lineused = 0;
-	do {
-		int len;
-		if(fgets(lbuf, sizeof(lbuf), fp) == NULL)
-			return NULL;
-		lineno++;
-		if((cp = strchr(lbuf, '\n')) != NULL)
-			*cp = 0;
-		len = strlen(lbuf);
-		if(lineused + len + 1 > linesize) {
-			linesize *= 2;
-			if(linesize > 1050000) {
-				ss_msg(ERR, "rdhdr_ascii", "internal error - failed to find end of header\n; linesize=%d line=\n%.200s\n", linesize, line);
-				exit(4);
-			}
-				
-			line = g_realloc(line, linesize);
-		}
-		strcat(line, lbuf);
-		lineused += len;
-
-	} while(!strstr(line, "$&%#") && lineno < maxlines);
-	if(lineno == maxlines) {
-		ss_msg(DBG, "rdhdr_hsascii", "%s:%d: end of hspice header not found", name,lineno);
-		goto fail;
+	hs_hdr_init(&h, fp, 0);
+	h.lineno = lineno;
+	sf = hs_process_header(nauto, nprobe, nsweepparam, &h, name);
+	if(sf && !hs_hdr_finish(&h)) {
+		ss_msg(DBG, "rdhdr_hsascii", "%s:%d: end of hspice header not found", name, h.lineno);
+		ss_delete(sf);
+		sf = NULL;
 	}
-
-	sf = hs_process_header(nauto, nprobe, nsweepparam, line, name);
+	lineno = h.lineno;
+	hs_hdr_free(&h);
 	if(!sf)
-		goto fail;
+		return NULL;
+
 	sf->fp = fp;
 	sf->readrow = sf_readrow_hsascii;
-	sf->linebuf = line;
+	sf->lbufsize = 1024;
+	sf->linebuf = g_new0(char, sf->lbufsize);
 	sf->linep = NULL;
-	sf->lbufsize = linesize;
 	sf->ntables = ntables;
 	sf->read_tables = 0;
 	sf->read_rows = 0;
@@ -180,42 +321,26 @@ sf_rdhdr_hsascii(char *name, FILE *fp)
 	       sf->ntables, sf->ncols);
 
 	return sf;
-
- fail:
-	if(line)
-		g_free(line);
-	return NULL;
-
 }
 
 /* Read spice-type file header - hspice binary */
 SpiceStream *
 sf_rdhdr_hsbin(char *name, FILE *fp)
 {
-
 	SpiceStream *sf = NULL;
-	char *ahdr = NULL;
-	int ahdrsize = 0;
-	int ahdrend = 0;
-	int n;
+	HSHeader h;
+	char ahdr[257];
 	int datasize;
 	int nauto, nprobe, nsweepparam, ntables;
 	char nbuf[16];
 	struct hsblock_header hh;
 	
-	do {
-		n = sf_readblock_hsbin(fp, &ahdr, &ahdrsize, ahdrend);
-		if(n <= 0)
-			goto fail;
-		ahdrend += n;
-		ahdr[ahdrend] = '\0';
-
-	} while(!strstr(ahdr, "$&%#"));
-
-	/* ahdr is an ascii header that describes the variables in
-	 * much the same way that the first lines of the ascii format do,
-	 * except that there are no newlines
+	/* the first 256 bytes of the header are fixed fields, which
+	 * may be all there is of it in the file's first block.
 	 */
+	hs_hdr_init(&h, fp, 1);
+	if(!hs_hdr_fixed(&h, ahdr, 256))
+		goto fail;
 
 	if(strncmp(&ahdr[16], "9007", 4) != 0 	/* version of post format */
 	   && strncmp(&ahdr[16], "9601", 4) != 0)
@@ -236,34 +361,43 @@ sf_rdhdr_hsbin(char *name, FILE *fp)
 	if(ntables == 0)
 		ntables = 1;
 
-	sf = hs_process_header(nauto, nprobe, nsweepparam, &ahdr[256], name);
-	if(!sf)
+	/* the rest of the header is much the same as the variable lines
+	 * of the ascii format, except that there are no newlines
+	 */
+	sf = hs_process_header(nauto, nprobe, nsweepparam, &h, name);
+	if(!sf || !hs_hdr_finish(&h))
 		goto fail;
+	hs_hdr_free(&h);
 	
 	if(fread(&hh, sizeof(hh), 1, fp) != 1) {
 		ss_msg(DBG, "sf_rdhdr_hsbin", "EOF reading block header");
-		goto fail;
+		goto fail_sf;
 	}
 	if(hh.h1 == 0x04000000 && hh.h3 == 0x04000000) {
 		/* detected endian swap */
 		sf->flags |= SSF_ESWAP;
-		swap_gint32((gint32*)&hh, sizeof(hh)/sizeof(gint32));
+		swap_header(&hh);
 	}
 	if(hh.h1 != 4 || hh.h3 != 4) {
 		ss_msg(DBG, "sf_rdhdr_hsbin", "unexepected values in data block header");
-		goto fail;
+		goto fail_sf;
 	}
 
 	datasize = hh.block_nbytes;
 	sf->expected_vals = datasize / sizeof(float);
 	sf->read_vals = 0;
 	
-	ss_msg(DBG, "sf_rdhdr_hsbin", "datasize=%d expect %d columns, %d values;\n  reading first data block at 0x%lx", datasize, sf->ncols, sf->expected_vals, (long)ftello64(fp));
+	ss_msg(DBG, "sf_rdhdr_hsbin", "datasize=%d expect %d columns, %lld values;\n  reading first data block at 0x%llx", datasize, sf->ncols, sf->expected_vals, (long long) ftello64(fp));
 
 
 	sf->fp = fp;
 	sf->readrow = sf_readrow_hsbin;
+	sf->readrows = sf_readrows_hsbin;
 	sf->readsweep = sf_readsweep_hsbin;
+	sf->guessrows = sf_guessrows_hsbin;
+	sf->readcol = sf_readcol_hsbin;
+	ss_map(sf);
+	sf->valsize = sizeof(float);
 
 	sf->ntables = ntables;
 	sf->read_tables = 0;
@@ -272,34 +406,31 @@ sf_rdhdr_hsbin(char *name, FILE *fp)
 
 	return sf;
  fail:
-	if(ahdr)
-		g_free(ahdr);
-	if(sf) {
-		if(sf->dvar)
-			g_free(sf->dvar);
-		g_free(sf);
-	}
-
+	hs_hdr_free(&h);
+ fail_sf:
+	if(sf)
+		ss_delete(sf);
 	return NULL;
 }
 
 /* common code for reading ascii or binary hspice headers.
- * Given a string of ascii header information, set up the
- * SpiceStream structure appropriately.
+ * Given the header positioned at the variable types, set up the
+ * SpiceStream structure appropriately, reading the types and names
+ * of the variables as they come.
  * Returns NULL on failure.
  */
 static SpiceStream *
-hs_process_header(int nauto, int nprobe, int nsweepparam, char *line, char *name)
+hs_process_header(int nauto, int nprobe, int nsweepparam, HSHeader *h,
+		  char *name)
 {
 	char *cp;
 	char *signam;
 	SpiceStream *sf;
 	int i;
-	int ncols;
 	int hstype;
 
 /* type of independent variable */
-	cp = strtok(line, " \t\n");
+	cp = hs_hdr_token(h);
 	if(!cp) {
 		ss_msg(DBG, "hs_process_header", "%s: initial vartype not found on header line.", name);
 		return NULL;
@@ -326,14 +457,14 @@ hs_process_header(int nauto, int nprobe, int nsweepparam, char *line, char *name
 
 /* dependent variable types */
 	for(i = 0; i < sf->ndv; i++) {
-		cp = strtok(NULL, " \t\n");
+		cp = hs_hdr_token(h);
 		if(!cp) {
 			ss_msg(DBG, "hs_process_header", "%s: not enough vartypes on header line", name);
-			return NULL;
+			goto fail;
 		}
 		if(!isdigit(cp[0])) {
 			ss_msg(DBG, "hs_process_header", "%s: bad vartype %d [%s] on header line", name, i, cp);
-			return NULL;
+			goto fail;
 		}
 		hstype = atoi(cp);
 		switch(hstype) {
@@ -362,7 +493,7 @@ hs_process_header(int nauto, int nprobe, int nsweepparam, char *line, char *name
 	}
 
 /* independent variable name */
-	signam = strtok(NULL, " \t\n"); 
+	signam = hs_hdr_token(h);
 	if(!signam) {
 		ss_msg(DBG, "hs_process_header", "%s: no IV name found on header line", name);
 		goto fail;
@@ -371,7 +502,7 @@ hs_process_header(int nauto, int nprobe, int nsweepparam, char *line, char *name
 	
  /* dependent variable names */
 	for(i = 0; i < sf->ndv; i++) {
-		if((signam = strtok(NULL, " \t\n")) == NULL) {
+		if((signam = hs_hdr_token(h)) == NULL) {
 			ss_msg(DBG, "hs_process_header", "%s: not enough DV names found on header line", name);
 			goto fail;
 		}
@@ -379,7 +510,7 @@ hs_process_header(int nauto, int nprobe, int nsweepparam, char *line, char *name
 	}
 /* sweep parameter names */
 	for(i = 0; i < sf->nsweepparam; i++) {
-		if((signam = strtok(NULL, " \t\n")) == NULL) {
+		if((signam = hs_hdr_token(h)) == NULL) {
 			ss_msg(DBG, "hs_process_header", "%s: not enough sweep parameter names found on header line", name);
 			goto fail;
 		}
@@ -417,7 +548,7 @@ sf_readblock_hsbin(FILE *fp, char **bufp, int *bufsize, int offset)
 	if(hh.h1 == 0x04000000 && hh.h3 == 0x04000000) {
 		/* detected endian swap */
 		eswap = 1;
-		swap_gint32((gint32*)&hh, sizeof(hh)/sizeof(gint32));
+		swap_header(&hh);
 	}
 	if(hh.h1 != 0x00000004 || hh.h3 != 0x00000004) {
 		ss_msg(DBG, "sf_readblock_hsbin", "unexepected values in block header");
@@ -458,70 +589,125 @@ sf_readblock_hsbin(FILE *fp, char **bufp, int *bufsize, int offset)
 }
 
 /*
- * helper routine: get next floating-point value from data part of binary
- * hspice file.   Handles the block-structure of hspice files; all blocks
- * encountered are assumed to be data blocks.  We don't use readblock_hsbin because
- * some versions of hspice write very large blocks, which would require a 
- * very large buffer.
+ * helper routine: decode the next run of floating-point values from the
+ * data part of a binary hspice file into sf->vbuf.  Handles the
+ * block-structure of hspice files; all blocks encountered are assumed
+ * to be data blocks.  We don't use readblock_hsbin because some versions
+ * of hspice write very large blocks, which would require a very large
+ * buffer.  Instead, up to SS_VBUFSIZE values of the current block are
+ * read at once, and swapped and widened to double in a single pass.
  * 
  * Returns 0 on EOF, 1 on success, negative on error.
  */
 static int
-sf_getval_hsbin(SpiceStream *sf, double *dval)
+sf_fillbuf_hsbin(SpiceStream *sf)
 {
-	off64_t pos;
-	float val;
-	int i;
+	SSIndex pos;
+	char *cp;
+	int n;
 	struct hsblock_header hh;
 	gint32 trailer;
 
 	if(sf->read_vals >= sf->expected_vals) {
-		pos = ftello64(sf->fp);
-		if(fread(&trailer, sizeof(gint32), 1, sf->fp) != 1) {
-			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block trailer at offset 0x%lx", (long) pos);
+		pos = ss_tell(sf);
+		if(ss_fread(&trailer, sizeof(gint32), 1, sf) != 1) {
+			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block trailer at offset 0x%llx", (long long) pos);
 			return 0;
 		}
 		if(sf->flags & SSF_ESWAP) {
 			swap_gint32(&trailer, 1);
 		}
 		if(trailer != sf->expected_vals * sizeof(float)) {
-			ss_msg(DBG, "sf_getval_hsbin", "block trailer mismatch at offset 0x%lx", (long) pos);
+			ss_msg(DBG, "sf_getval_hsbin", "block trailer mismatch at offset 0x%llx", (long long) pos);
 			return -2;
 		}
 
-		pos = ftello64(sf->fp);
-		if(fread(&hh, sizeof(hh), 1, sf->fp) != 1) {
-			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block header at offset 0x%lx", (long) pos);
+		pos = ss_tell(sf);
+		if(ss_fread(&hh, sizeof(hh), 1, sf) != 1) {
+			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block header at offset 0x%llx", (long long) pos);
 			return 0;
 		}
 		if(hh.h1 == 0x04000000 && hh.h3 == 0x04000000) {
 			/* detected endian swap */
 			sf->flags |= SSF_ESWAP;
-			swap_gint32((gint32*)&hh, sizeof(hh)/sizeof(gint32));
+			swap_header(&hh);
 		} else {
 			sf->flags &= ~SSF_ESWAP;
 		}
 		if(hh.h1 != 0x00000004 || hh.h3 != 0x00000004) {
-			ss_msg(ERR, "sf_getval_hsbin", "unexepected values in block header at offset 0x%lx", pos);
+			ss_msg(ERR, "sf_getval_hsbin", "unexepected values in block header at offset 0x%llx", (long long) pos);
 			return -1;
 		}
 		sf->expected_vals = hh.block_nbytes / sizeof(float);
 		sf->read_vals = 0;
 	}
-	if(fread(&val, sizeof(float), 1, sf->fp) != 1) {
-		pos = ftello64(sf->fp);
-		ss_msg(ERR, "sf_getval_hsbin", "unexepected EOF in data at offset 0x%lx", (long) pos);
+
+	if(sf->vbuf == NULL) {
+		sf->vbufsize = SS_VBUFSIZE;
+		sf->vbuf = g_new(double, sf->vbufsize);
+	}
+	n = MIN(sf->expected_vals - sf->read_vals, sf->vbufsize);
+	if(sf->map) {	/* decode straight from the mapping */
+		cp = ss_map_take(sf, sizeof(float), &n);
+	} else {
+		if(sf->rawbuf == NULL)
+			sf->rawbuf = g_new(float, sf->vbufsize);
+		cp = sf->rawbuf;
+		n = ss_fread(cp, sizeof(float), n, sf);
+	}
+	if(n <= 0) {
+		pos = ss_tell(sf);
+		ss_msg(SS_EOF_LEVEL(sf, ERR), "sf_getval_hsbin", "unexepected EOF in data at offset 0x%llx", (long long) pos);
 		return 0;
 	}
-	sf->read_vals++;
+	sf->read_vals += n;
 
-	if(sf->flags & SSF_ESWAP) {
-		swap_gint32((gint32 *)&val, 1);
+	hs_decode_floats(sf->vbuf, cp, n, sf->flags & SSF_ESWAP);
+	sf->vbuflen = n;
+	sf->vbufpos = 0;
+	return 1;
+}
+
+/*
+ * helper routine: get next floating-point value from data part of binary
+ * hspice file.
+ * Returns 0 on EOF, 1 on success, negative on error.
+ */
+static int
+sf_getval_hsbin(SpiceStream *sf, double *dval)
+{
+	int rc;
+
+	if(sf->vbufpos >= sf->vbuflen) {
+		rc = sf_fillbuf_hsbin(sf);
+		if(rc <= 0)
+			return rc;
 	}
-	*dval = val;
+	*dval = sf->vbuf[sf->vbufpos++];
 	return 1;
 }
 
+/*
+ * helper routine: get the next n values from data part of binary
+ * hspice file, copying them a run at a time.
+ * Returns the number of values gotten, which is less than n on EOF or
+ * error.
+ */
+static int
+sf_getvals_hsbin(SpiceStream *sf, double *dvals, int n)
+{
+	int i, k;
+
+	for(i = 0; i < n; i += k) {
+		if(sf->vbufpos >= sf->vbuflen && sf_fillbuf_hsbin(sf) <= 0)
+			break;
+		k = MIN(n - i, sf->vbuflen - sf->vbufpos);
+		memcpy(dvals + i, sf->vbuf + sf->vbufpos, k * sizeof(double));
+		sf->vbufpos += k;
+	}
+	return i;
+}
+
 /*
  * helper routine: get next value from ascii hspice file.
  * the file is line-oriented, with fixed-width fields on each line.
@@ -529,14 +715,13 @@ sf_getval_hsbin(SpiceStream *sf, double *dval)
 0.66687E-090.21426E+010.00000E+000.00000E+000.25000E+010.71063E-090.17877E+01
  .00000E+00 .30000E+01 .30000E+01 .30000E+01 .30000E+01 .30000E+01 .30092E-05
  * There may be whitespace at the end of the line before the newline.
+ * If val is NULL, the value is skipped over without being decoded.
  *
  * Returns 0 on EOF, 1 on success.
  */
 static int
 sf_getval_hsascii(SpiceStream *sf, double *val)
 {
-	char vbuf[16];
-	char *vp;
 	char *cp;
 	int l;
 
@@ -545,13 +730,20 @@ sf_getval_hsascii(SpiceStream *sf, double *val)
 			return 0;
 		
 		l = strlen(sf->linebuf);
+		if((sf->flags & SSF_FOLLOW) && l && sf->linebuf[l-1] != '\n'
+		   && l < sf->lbufsize - 1) {
+			/* the rest of the line hasn't been written yet */
+			sf->linep = NULL;
+			return 0;
+		}
 		if(l) {  /* delete whitespace at end of line */
 			cp = sf->linebuf + l - 1;
 			while(cp > sf->linebuf && *cp && isspace(*cp))
 				*cp-- = '\0';
+			l = cp - sf->linebuf + 1;
 		}
 		sf->linep = sf->linebuf;
-		sf->line_length = strlen(sf->linep);
+		sf->line_length = l;
 		/* fprintf(stderr, "#line: \"%s\"\n", sf->linebuf); */
 	}
 	if(sf->linep > sf->linebuf + sf->line_length) {
@@ -560,19 +752,17 @@ sf_getval_hsascii(SpiceStream *sf, double *val)
 		return 0;
 	}
 
-	strncpy(vbuf, sf->linep, 11);
+	cp = sf->linep;
 	sf->linep += 11;
-	vbuf[11] = 0;
-	if(strlen(vbuf) != 11) {
+	if(sf->linep > sf->linebuf + sf->line_length) {
 		/* incomplete float value - probably truncated or
 		   partialy-written file */
 		return 0;
 	}
-	vp = vbuf;
-	while(isspace(*vp)) /* atof doesn't like spaces */
-		vp++;
-	*val = atof(vp);
-	/* fprintf(stderr, "#vp=\"%s\" val=%f\n", vp, *val); */
+	/* parse the field in place */
+	if(val)
+		*val = ss_strtod_n(cp, 11, NULL);
+	/* fprintf(stderr, "#val=%f\n", *val); */
 	return 1;
 }
 
@@ -607,8 +797,11 @@ sf_readrow_hsascii(SpiceStream *sf, double *ivar, double *dvars)
 
 	sf->read_rows++;
 	for(i = 0; i < sf->ncols-1; i++) {
-		if(sf_getval_hsascii(sf, &dvars[i]) == 0) {
-			ss_msg(WARN, "sf_readrow_hsascii", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+		if(!SS_WANTCOL(sf, i))
+			dvars[i] = 0;
+		if(sf_getval_hsascii(sf, SS_WANTCOL(sf, i) ? &dvars[i] : NULL)
+		   == 0) {
+			ss_msg(SS_EOF_LEVEL(sf, WARN), "sf_readrow_hsascii", "%s: EOF or error reading data field %d in row %lld of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
 			return 0;
 		}
 	}
@@ -624,10 +817,8 @@ sf_readrow_hsascii(SpiceStream *sf, double *ivar, double *dvars)
 static int 
 sf_readrow_hsbin(SpiceStream *sf, double *ivar, double *dvars)
 {
-	int i;
+	int n;
 	int rc;
-	float val;
-	long pos;
 
 	if(!sf->read_sweepparam) { /* first row of table */
 		if(sf_readsweep_hsbin(sf, NULL) <= 0) /* discard sweep parameters, if any */
@@ -650,13 +841,140 @@ sf_readrow_hsbin(SpiceStream *sf, double *ivar, double *dvars)
 		}
 	}
 	sf->read_rows++;
-	for(i = 0; i < sf->ncols-1; i++) {
-		if(sf_getval_hsbin(sf, &dvars[i]) != 1) {
-			ss_msg(WARN, "sf_readrow_hsbin", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+	n = sf_getvals_hsbin(sf, dvars, sf->ncols-1);
+	if(n < sf->ncols-1) {
+		ss_msg(SS_EOF_LEVEL(sf, WARN), "sf_readrow_hsbin", "%s: EOF or error reading data field %d in row %lld of table %d; file is incomplete.", sf->filename, n, sf->read_rows, sf->read_tables);
+		return 0;
+	}
+	return 1;
+}
+
+/* Read up to nmax rows of values from binary hspice-format file.
+ * Returns the number of rows read, or the status from readrow_hsbin
+ * if there are none.
+ */
+static int
+sf_readrows_hsbin(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf)
+{
+	int n, rc;
+
+	for(n = 0; n < nmax; n++) {
+		rc = sf_readrow_hsbin(sf, &ivbuf[n], &dvbuf[n * sf->ncols]);
+		if(rc <= 0)
+			return ss_rows_done(sf, n, rc);
+	}
+	return n;
+}
+
+/*
+ * move a seek point in a binary hspice file on to the start of the next
+ * block, from the end of the one it is at the end of.
+ * Returns 1, or 0 if there isn't one.
+ */
+static int
+hs_next_block(SpiceStream *sf, SSSeekPoint *sp)
+{
+	struct {
+		gint32 trailer;
+		struct hsblock_header hh;
+	} b;
+
+	if(ss_pread_items(sf, sp->pos, sizeof(b), sizeof(b), 1,
+			  (char *)&b) != 1)
+		return 0;
+	if(sp->flags & SSF_ESWAP)
+		swap_gint32(&b.trailer, 1);
+	if(b.trailer != sp->expected_vals * sizeof(float))
+		return 0;
+	if(b.hh.h1 == 0x04000000 && b.hh.h3 == 0x04000000) {
+		sp->flags |= SSF_ESWAP;
+		swap_header(&b.hh);
+	} else {
+		sp->flags &= ~SSF_ESWAP;
+	}
+	if(b.hh.h1 != 4 || b.hh.h3 != 4 || b.hh.block_nbytes < 0)
+		return 0;
+	sp->pos += sizeof(b);
+	sp->expected_vals = b.hh.block_nbytes / sizeof(float);
+	sp->read_vals = 0;
+	return 1;
+}
+
+/*
+ * move a seek point in a binary hspice file past n values, going on
+ * through the blocks that they run into.  Returns 1, or 0 if the file
+ * ends first.
+ */
+static int
+hs_skip_vals(SpiceStream *sf, SSSeekPoint *sp, SSIndex n)
+{
+	SSIndex left;
+
+	for(;;) {
+		left = sp->expected_vals - sp->read_vals;
+		if(n <= left) {
+			sp->pos += n * sizeof(float);
+			sp->read_vals += n;
+			return 1;
+		}
+		n -= left;
+		sp->pos += left * sizeof(float);
+		sp->read_vals = sp->expected_vals;
+		if(!hs_next_block(sf, sp))
 			return 0;
+	}
+}
+
+/*
+ * Read column col of n rows from a binary hspice file, starting at
+ * the seek point sp.  The values are in blocks, each with a header and
+ * trailer, that rows run across, so the blocks are stepped through by
+ * their headers, and the values of the column in each read from where
+ * they must be.
+ */
+static int
+sf_readcol_hsbin(SpiceStream *sf, SSSeekPoint *sp, int col, int n,
+		 double *buf)
+{
+	char raw[SS_VBUFSIZE * sizeof(float)];
+	SSSeekPoint vp;
+	SSIndex left;
+	int got, k;
+
+	if(!sp->read_sweepparam) {
+		if(!hs_skip_vals(sf, sp, sf->nsweepparam))
+			return -1;
+		sp->read_sweepparam = 1;
+	}
+	for(got = 0; got < n; got += k) {
+		left = sp->expected_vals - sp->read_vals;
+		if(col < left) {
+			/* rows whose value is in this block */
+			k = MIN(n - got, (left - 1 - col) / sf->ncols + 1);
+			k = MIN(k, SS_VBUFSIZE);
+			if(ss_pread_items(sf, sp->pos + col * sizeof(float),
+					  sf->ncols * sizeof(float),
+					  sizeof(float), k, raw) != k)
+				return -1;
+			hs_decode_floats(buf + got, raw, k,
+					 sp->flags & SSF_ESWAP);
+		} else {
+			/* the value is in a later block than the row's start */
+			k = 1;
+			vp = *sp;
+			if(!hs_skip_vals(sf, &vp, col)
+			   || (vp.read_vals == vp.expected_vals
+			       && !hs_next_block(sf, &vp))
+			   || ss_pread_items(sf, vp.pos, sizeof(float),
+					     sizeof(float), 1, raw) != 1)
+				return -1;
+			hs_decode_floats(buf + got, raw, 1,
+					 vp.flags & SSF_ESWAP);
 		}
+		if(!hs_skip_vals(sf, sp, (SSIndex)k * sf->ncols))
+			return -1;
 	}
-	return 1;
+	return n;
 }
 
 /*
@@ -717,10 +1035,9 @@ sf_readsweep_hsbin(SpiceStream *sf, double *svar)
  * to indicate that the length cannot be estimated.
  * If an error occurs, -1 is returned. 
  */
-static long
+static SSIndex
 sf_guessrows_hsbin(SpiceStream *sf)
 {
-	long pos;
 	int rc;
 	struct stat st;
 
@@ -730,23 +1047,139 @@ sf_guessrows_hsbin(SpiceStream *sf)
 	if((st.st_mode & S_IFMT) != S_IFREG)
 		return 0;
 	
-	return st.st_size / (sizeof(float)  * sf->ncols);
+	return (SSIndex) st.st_size / (SSIndex) (sizeof(float) * sf->ncols);
 }
 
 
+/*
+ * reverse the byte order of n 32-bit integers.
+ */
 static void
 swap_gint32(gint32 *pi, size_t n)
 {
-	union gint32bytes *p = (union gint32bytes *)pi;
 	size_t i;
-	gchar temp;
-	for(i = 0; i < n; i++) {
-		temp = p[i].b[3] ;
-		p[i].b[3] = p[i].b[0];
-		p[i].b[0] = temp;
-
-		temp = p[i].b[2] ;
-		p[i].b[2] = p[i].b[1];
-		p[i].b[1] = temp;
+
+	for(i = 0; i < n; i++)
+		pi[i] = GUINT32_SWAP_LE_BE((guint32)pi[i]);
+}
+
+static void
+swap_header(struct hsblock_header *hh)
+{
+	swap_gint32(&hh->h1, 1);
+	swap_gint32(&hh->h2, 1);
+	swap_gint32(&hh->h3, 1);
+	swap_gint32(&hh->block_nbytes, 1);
+}
+
+/*
+ * Vector kernels for hs_decode_floats().  Each handles as many whole
+ * vectors as fit in n values, and returns how many values it did.
+ * They are compiled for their instruction sets with target attributes,
+ * and chosen at run time according to what the CPU supports, so the
+ * library as a whole still runs on any x86.
+ */
+#ifdef HS_DECODE_X86
+
+__attribute__((target("avx2")))
+static int
+hs_decode_avx2(double *dst, char *src, int n, int swap)
+{
+	const __m256i bswap = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i v;
+	__m256 f;
+	int i;
+
+	for(i = 0; i + 8 <= n; i += 8) {
+		v = _mm256_loadu_si256((__m256i *)(src + i * sizeof(float)));
+		if(swap)
+			v = _mm256_shuffle_epi8(v, bswap);
+		f = _mm256_castsi256_ps(v);
+		_mm256_storeu_pd(dst + i,
+				 _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+		_mm256_storeu_pd(dst + i + 4,
+				 _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static int
+hs_decode_sse2(double *dst, char *src, int n, int swap)
+{
+	const __m128i m2 = _mm_set1_epi32(0x00ff0000);
+	const __m128i m1 = _mm_set1_epi32(0x0000ff00);
+	__m128i v;
+	__m128 f;
+	int i;
+
+	for(i = 0; i + 4 <= n; i += 4) {
+		v = _mm_loadu_si128((__m128i *)(src + i * sizeof(float)));
+		if(swap) /* no byte shuffle in SSE2; use shifts */
+			v = _mm_or_si128(
+				_mm_or_si128(_mm_slli_epi32(v, 24),
+					     _mm_srli_epi32(v, 24)),
+				_mm_or_si128(
+				    _mm_and_si128(_mm_slli_epi32(v, 8), m2),
+				    _mm_and_si128(_mm_srli_epi32(v, 8), m1)));
+		f = _mm_castsi128_ps(v);
+		_mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+		_mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+	}
+	return i;
+}
+
+static int
+hs_decode_none(double *dst, char *src, int n, int swap)
+{
+	return 0;
+}
+
+static int (*hs_decode_vec)(double *dst, char *src, int n, int swap);
+
+static void
+hs_decode_choose(void)
+{
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		hs_decode_vec = hs_decode_avx2;
+		ss_msg(DBG, "hs_decode", "using AVX2");
+	} else if(__builtin_cpu_supports("sse2")) {
+		hs_decode_vec = hs_decode_sse2;
+		ss_msg(DBG, "hs_decode", "using SSE2");
+	} else {
+		hs_decode_vec = hs_decode_none;
+	}
+}
+#endif /* HS_DECODE_X86 */
+
+/*
+ * widen n floats from src, which need not be aligned, into dst,
+ * swapping their byte order first if swap is nonzero.
+ */
+static void
+hs_decode_floats(double *dst, char *src, int n, int swap)
+{
+	union { guint32 u; float f; } v;
+	int i = 0;
+
+#ifdef HS_DECODE_X86
+	if(hs_decode_vec == NULL)
+		hs_decode_choose();
+	i = (*hs_decode_vec)(dst, src, n, swap);
+#endif
+	if(swap) {
+		for(; i < n; i++) {
+			memcpy(&v.u, src + i * sizeof(float), sizeof(float));
+			v.u = GUINT32_SWAP_LE_BE(v.u);
+			dst[i] = v.f;
+		}
+	} else {
+		for(; i < n; i++) {
+			memcpy(&v.f, src + i * sizeof(float), sizeof(float));
+			dst[i] = v.f;
+		}
 	}
 }
@@ -64,6 +64,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 	int lineno = 0;
 	int linesize = 1024;
 	char *key, *val;
+	char *lp;
 	int got_ivline = 0;
 	int ndvars;
 	double voltage_resolution = 1.0;
@@ -86,14 +87,15 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 			continue;
 
 		if(line[0] == '.') {
-			key = strtok(&line[1], " \t");
+			lp = &line[1];
+			key = ss_strtok(&lp, " \t");
 			if(!key) {
 				ss_msg(ERR, msgid, "%s:%d: syntax error, expected \"keyword:\"", name, lineno);
 				g_free(line);
 				return NULL;
 			}
 			if(strcmp(key, "time_resolution") == 0) {
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected number", name, lineno);
 					g_free(line);
@@ -102,7 +104,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 				time_resolution = atof(val);
 			}
 			if(strcmp(key, "current_resolution") == 0) {
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected number", name, lineno);
 					g_free(line);
@@ -111,7 +113,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 				current_resolution = atof(val);
 			}
 			if(strcmp(key, "voltage_resolution") == 0) {
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected number", name, lineno);
 					g_free(line);
@@ -122,14 +124,14 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 			if(strcmp(key, "index") == 0) {
 				nsv = g_new0(struct nsvar, 1);
 
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected varname", name, lineno);
 					goto err;
 				}
 				nsv->name = g_strdup(val);
 
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected var-index", name, lineno);
 					goto err;
@@ -138,7 +140,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 				if(nsv->index > maxindex)
 					maxindex = nsv->index;
 				
-				val = strtok(NULL, " \t\n");
+				val = ss_strtok(&lp, " \t\n");
 				if(!val) {
 					ss_msg(ERR, msgid, "%s:%d: syntax error, expected variable type", name, lineno);
 					goto err;
@@ -171,6 +173,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 	sf->nsindexes = g_new0(int, ndvars);
 	sf->ncols = 1;
 	sf->ntables = 1;
+	sf->events = 1;
 	sf->ivar->name = g_strdup("TIME");
 	sf->ivar->type = TIME;
 	sf->ivar->col = 0;
@@ -195,7 +198,7 @@ sf_rdhdr_nsout(char *name, FILE *fp)
 	sf->lineno = lineno;
 	sf->linebuf = line;
 	sf->lbufsize = linesize;
-	ss_msg(DBG, msgid, "Done with header at offset 0x%lx", (long) ftello64(sf->fp));
+	ss_msg(DBG, msgid, "Done with header at offset 0x%llx", (long long) ftello64(sf->fp));
 	
 	return sf;
 err:
@@ -222,16 +225,18 @@ sf_readrow_nsout(SpiceStream *sf, double *ivar, double *dvars)
 	int idx;
 	char *sidx;
 	char *sval;
+	char *lp;
 	double v;
 	double scale;
 	SpiceVar *dvp;
+	int eof = 1;
 
 	if(feof(sf->fp)) {
 		return 0;
 	}
 
 	// process iv line
-	v = atof(sf->linebuf) * sf->time_resolution * 1e-9; /* ns */
+	v = ss_strtod(sf->linebuf, NULL) * sf->time_resolution * 1e-9; /* ns */
 	*ivar = v;
 	
 	// read and process dv lines until we see another iv line
@@ -240,24 +245,30 @@ sf_readrow_nsout(SpiceStream *sf, double *ivar, double *dvars)
 		if(sf->linebuf[0] == ';')
 			continue;
 		
-		sidx = strtok(sf->linebuf, " \t");
+		lp = sf->linebuf;
+		sidx = ss_strtok(&lp, " \t");
 		if(!sidx) {
 			ss_msg(ERR, msgid, "%s:%d: expected value", 
 			       sf->filename, sf->lineno);
 			return -1;
 		}
 
-		sval = strtok(NULL, " \t"); 
-		if(!sval)
+		sval = ss_strtok(&lp, " \t");
+		if(!sval) {
 			/* no value token: this is the ivar line for the
 			    next row */
+			eof = 0;
 			break;
+		}
 
 		idx = atoi(sidx);
 		if(idx <= sf->maxindex) {
-			sf->datrow[idx] = atof(sval);
+			sf->datrow[idx] = ss_strtod(sval, NULL);
 		}
 	}
+	/* in a file still being written, more of this row may follow */
+	if(eof && (sf->flags & SSF_FOLLOW))
+		return 0;
 
 	for(i = 0; i < sf->ndv; i++) {
 		dvp = &sf->dvar[i];
@@ -37,6 +37,7 @@
 #include "spicestream.h"
 
 static int sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_s2raw(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf);
 static char *msgid = "s2raw";
 
 /* Read spice-type file header - Berkeley Spice2G6 "raw" format */
@@ -74,7 +75,7 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 
 	ndv = s2hdr.nvars - 1;
 	sf = ss_new(fp, name, ndv, 0);
-	sf->ncols = ndv;
+	sf->ncols = ndv + 1;
 	sf->ivar->name = g_strdup(s2vname.name);
 	sf->ivar->type = TIME;
 	sf->ivar->col = 0;
@@ -89,7 +90,7 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 
 		sf->dvar[i].name = g_strdup(s2vname.name);
 		sf->dvar[i].type = VOLTAGE;  /* FIXME:sgt: get correct type */
-		sf->dvar[i].col = i; /* FIXME:sgt: handle complex */
+		sf->dvar[i].col = i + 1; /* FIXME:sgt: handle complex */
 		sf->dvar[i].ncols = 1;
 	}
 
@@ -110,9 +111,11 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 		goto err;
 	s2title.title[23] = 0;
 	ss_msg(DBG, msgid, "title=\"%s\"", s2title.title);
-	ss_msg(DBG, msgid, "done with header at offset=0x%lx", (long) ftello64(fp));
+	ss_msg(DBG, msgid, "done with header at offset=0x%llx", (long long) ftello64(fp));
 
 	sf->readrow = sf_readrow_s2raw;
+	sf->readrows = sf_readrows_s2raw;
+	sf->valsize = sizeof(double);
 	return sf;
 err:
 	if(sf) {
@@ -133,7 +136,7 @@ sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars)
 	spice_var_t val;
 
 	/* independent var */
-	if ((rc = fread (&val,sizeof(val),1, sf->fp)) != 1)
+	if ((rc = ss_fread (&val,sizeof(val),1, sf)) != 1)
 		if(rc == 0)
 			return 0;
 		else
@@ -144,11 +147,45 @@ sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars)
 	
 	/* dependent vars */
 	for(i = 0; i < sf->ndv; i++) {
-		if(fread(&val, sizeof(val), 1, sf->fp) != 1) {
-			ss_msg(ERR, msgid, "unexpected EOF at dvar %d", i);
+		if(ss_fread(&val, sizeof(val), 1, sf) != 1) {
+			ss_msg(SS_EOF_LEVEL(sf, ERR), msgid, "unexpected EOF at dvar %d", i);
 			return -1;
 		}
 		dvars[i] = val.val;
 	}
 	return 1;
 }
+
+/*
+ * Read up to nmax rows of values from a spice2 rawfile,
+ * with a single fread for all of them.
+ */
+static int
+sf_readrows_s2raw(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf)
+{
+	spice_var_t *vp;
+	int rowlen = sf->ndv + 1;
+	int n, got;
+
+	if(sf->vbufsize < nmax * rowlen) {
+		sf->vbufsize = nmax * rowlen;
+		sf->vbuf = g_renew(double, sf->vbuf, sf->vbufsize);
+	}
+	got = ss_fread(sf->vbuf, sizeof(spice_var_t), nmax * rowlen, sf);
+	vp = (spice_var_t *)sf->vbuf;
+	for(n = 0; n < got / rowlen; n++, vp += rowlen) {
+		if (memcmp(vp, SPICE_MAGIC, 8) == 0) /* another analysis */
+			return ss_rows_done(sf, n, 0);
+		ivbuf[n] = vp[0].val;
+		memcpy(&dvbuf[n * sf->ncols], &vp[1], sf->ndv * sizeof(double));
+	}
+	if(n == nmax)
+		return n;
+
+	/* short read: EOF, perhaps in the middle of a row */
+	if(got % rowlen == 0 || memcmp(vp, SPICE_MAGIC, 8) == 0)
+		return ss_rows_done(sf, n, ferror(sf->fp) ? -1 : 0);
+	ss_msg(SS_EOF_LEVEL(sf, ERR), msgid, "unexpected EOF at dvar %d",
+	       got % rowlen - 1);
+	return ss_rows_done(sf, n, -1);
+}
@@ -27,6 +27,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <config.h>
 #include <glib.h>
@@ -35,6 +37,14 @@
 static int sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars);
 char *msgid = "s3raw";
 static int sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_s3bin(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf);
+static int sf_readcol_s3bin(SpiceStream *sf, SSSeekPoint *sp, int col, int n, double *buf);
+static SSIndex sf_guessrows_s3raw(SpiceStream *sf);
+static int sf_findplots_s3raw(SpiceStream *sf);
+static int sf_parse_s3raw(SpiceStream *sf, const char **pp, const char *end,
+			  double *ivar, double *dvars);
+static const char *sf_find_s3raw(SpiceStream *sf, const char *p,
+				 const char *end);
 
 /* convert variable type string from spice3 raw file to 
  * our type numbers
@@ -65,7 +75,9 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 	int linesize = 1024;
 	int dvsize = 128;
 	char *key, *val;
-	int nvars, npoints;
+	char *lp;
+	int nvars;
+	SSIndex npoints;
 	int got_nvars = 0;
 	int got_values = 0;
 	int dtype_complex = 0;
@@ -82,14 +94,15 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 			return NULL;
 		}
 
-		key = strtok(line, ":");
+		lp = line;
+		key = ss_strtok(&lp, ":");
 		if(!key) {
 			ss_msg(ERR, msgid, "%s:%d: syntax error, expected \"keyword:\"", name, lineno);
 			g_free(line);
 			return NULL;
 		}
 		if(strcmp(key, "Flags") == 0) {
-			while(val = strtok(NULL, " ,\t\n")) {
+			while(val = ss_strtok(&lp, " ,\t\n")) {
 				if(strcmp(val, "real") == 0) {
 					dtype_complex = 0;
 				}
@@ -98,7 +111,7 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 				}
 			}
 		} else if(strcmp(key, "No. Variables") == 0) {
-			val = strtok(NULL, " \t\n");
+			val = ss_strtok(&lp, " \t\n");
 			if(!val) {
 				ss_msg(ERR, msgid, "%s:%d: syntax error, expected integer", name, lineno);
 				g_free(line);
@@ -107,13 +120,13 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 			nvars = atoi(val);
 			got_nvars = 1;
 		} else if(strcmp(key, "No. Points") == 0) {
-			val = strtok(NULL, " \t\n");
+			val = ss_strtok(&lp, " \t\n");
 			if(!val) {
 				ss_msg(ERR, msgid, "%s:%d: syntax error, expected integer", name, lineno);
 				g_free(line);
 				return NULL;
 			}
-			npoints = atoi(val);
+			npoints = strtoll(val, NULL, 10);
 		} else if(strcmp(key, "Variables") == 0) {
 			if(!got_nvars) {
 				ss_msg(ERR, msgid, "%s:%d: \"Variables:\" before \"No. Variables:\"", name, lineno, i);
@@ -126,7 +139,7 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 			/* first variable may be described on the same line
 			 * as "Variables:" keyword
 			 */
-			vnum = strtok(NULL, " \t\n");
+			vnum = ss_strtok(&lp, " \t\n");
 
 			for(i = 0; i < nvars; i++) {
 				if(i || !vnum) {
@@ -135,10 +148,11 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 						goto err;
 					}
 					lineno++;
-					vnum = strtok(line, " \t\n");
+					lp = line;
+					vnum = ss_strtok(&lp, " \t\n");
 				}
-				vname = strtok(NULL, " \t\n");
-				vtypestr = strtok(NULL, " \t\n");
+				vname = ss_strtok(&lp, " \t\n");
+				vtypestr = ss_strtok(&lp, " \t\n");
 				if(!vnum || !vname || !vtypestr) {
 					ss_msg(ERR, msgid, "%s:%d: expected number name type", name, lineno);
 					goto err;
@@ -189,16 +203,25 @@ sf_rdhdr_s3raw(char *name, FILE *fp)
 
 	if(binary) {
 		sf->readrow = sf_readrow_s3bin;
+		sf->readrows = sf_readrows_s3bin;
+		sf->readcol = sf_readcol_s3bin;
+		sf->valsize = sizeof(double);
 	} else {
 		sf->readrow = sf_readrow_s3raw;
 	}
+	sf->guessrows = sf_guessrows_s3raw;
+	sf->findplots = sf_findplots_s3raw;
 	sf->read_rows = 0;
 	sf->expected_vals = npoints * (sf->ncols + (dtype_complex ? 1 : 0));
-	ss_msg(DBG, msgid, "expecting %d values\n", sf->expected_vals);
+	ss_msg(DBG, msgid, "expecting %lld values\n", sf->expected_vals);
 	sf->lineno = lineno;
 	sf->linebuf = line;
 	sf->lbufsize = linesize;
-	ss_msg(DBG, msgid, "Done with header at offset 0x%lx\n", (long) ftello64(sf->fp));
+	ss_msg(DBG, msgid, "Done with header at offset 0x%llx\n", (long long) ftello64(sf->fp));
+	if(binary)
+		ss_map(sf);
+	else
+		ss_par_start(sf, sf_parse_s3raw, sf_find_s3raw, SSP_IVSPLIT);
 	
 	return sf;
 err:
@@ -278,8 +301,14 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 //			       sf->filename, sf->lineno);
 //			return -1;
 		}
+		if(strncmp(tok, "Title:", 6) == 0) {
+			/* the next plot; see ss_open_plot() */
+			ss_msg(DBG, msgid, "%s:%d: end of plot",
+			       sf->filename, sf->lineno);
+			return 0;
+		}
 		if(!isdigit(*tok)) {
-			ss_msg(WARN, msgid, "%s:%d: expected row number, got \"%s\". Note: only one dataset per file is supported, extra garbage ignored", 
+			ss_msg(WARN, msgid, "%s:%d: expected row number, got \"%s\"; the rest of the file is ignored", 
 			       sf->filename, sf->lineno, tok);
 			return 0;
 		}
@@ -292,7 +321,7 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 			       sf->filename, sf->lineno);
 			return -1;
 		}
-		v = atof(tok);
+		v = ss_strtod(tok, NULL);
 		if(v < sf->ivval) {
 			/* independent-variable value decreased, this must
 			 * be the start of another sweep.  hold the value and
@@ -317,11 +346,17 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 
 		tok = sf_nexttoken(sf);
 		if(!tok) {
-			ss_msg(ERR, msgid, "%s:%d: expected value", 
+			ss_msg(SS_EOF_LEVEL(sf, ERR), msgid, "%s:%d: expected value", 
 			       sf->filename, sf->lineno);
 			return -1;
 		}
-		dvars[dv->col-1] = atof(tok);
+		if(!SS_WANTCOL(sf, dv->col-1)) {
+			dvars[dv->col-1] = 0;
+			if(dv->ncols > 1)
+				dvars[dv->col] = 0;
+			continue;
+		}
+		dvars[dv->col-1] = ss_strtod(tok, NULL);
 
 		if(dv->ncols > 1) {
 			tok = strchr(tok, ',');
@@ -331,7 +366,7 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 				return -1;
 			}
 			tok++;
-			dvars[dv->col] = atof(tok);
+			dvars[dv->col] = ss_strtod(tok, NULL);
 		}
 	}
 	sf->read_rows++;
@@ -339,33 +374,175 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 }
 
 /*
- * Read a single value from binary spice3 rawfile, and do
- * the related error-checking.
+ * Find the next whitespace-seperated token, for sf_parse_s3raw.
+ * Returns NULL if there isn't one before end, or if it is at the start
+ * of a line and start is 0, or isn't and start is 1.
  */
+static const char *
+s3raw_token(const char **pp, const char *end, int start, int *np)
+{
+	const char *p = *pp;
+	const char *tok;
 
+	while(p < end && isspace(*p))
+		p++;
+	if(p == end || (p[-1] == '\n') != start)
+		return NULL;
+	tok = p;
+	while(p < end && !isspace(*p))
+		p++;
+	*np = p - tok;
+	*pp = p;
+	return tok;
+}
+
+/*
+ * Parse one row of an ascii spice3 raw file, from a mapping, just as
+ * sf_readrow_s3raw would read it.  sf_readrow_s3raw doesn't care how
+ * the values are arranged on lines, but records are found by looking
+ * for a row number at the start of a line, so insist on that, and on
+ * nothing else starting a line.
+ */
 static int
-sf_getval_s3bin(SpiceStream *sf, double *dval)
+sf_parse_s3raw(SpiceStream *sf, const char **pp, const char *end,
+	       double *ivar, double *dvars)
 {
-	off64_t pos;
-	double val;
-	int i;
+	const char *p = *pp;
+	const char *tok, *eol, *cp;
+	SpiceVar *dv;
+	int i, n;
+
+	while(p < end && isspace(*p))
+		p++;
+	if(p == end)
+		return 0;
+	tok = s3raw_token(&p, end, 1, &n);
+	if(!tok || !isdigit(*tok))
+		return SSP_SERIAL;
+	tok = s3raw_token(&p, end, 0, &n);
+	if(!tok)
+		return SSP_SERIAL;
+	*ivar = ss_strtod_n(tok, n, NULL);
+
+	for(i = 0; i < sf->ndv; i++) {
+		dv = &sf->dvar[i];
+		tok = s3raw_token(&p, end, 0, &n);
+		if(!tok)
+			return SSP_SERIAL;
+		if(!SS_WANTCOL(sf, dv->col-1)) {
+			dvars[dv->col-1] = 0;
+			if(dv->ncols > 1)
+				dvars[dv->col] = 0;
+			continue;
+		}
+		dvars[dv->col-1] = ss_strtod_n(tok, n, NULL);
+
+		if(dv->ncols > 1) {
+			/* the second value may be anywhere later on the line */
+			eol = memchr(tok, '\n', end - tok);
+			if(eol == NULL)
+				eol = end;
+			cp = memchr(tok, ',', eol - tok);
+			if(!cp || cp + 1 == eol)
+				return SSP_SERIAL;
+			cp++;
+			dvars[dv->col] = ss_strtod_n(cp, eol - cp, NULL);
+		}
+	}
+	while(p < end && isspace(*p))
+		p++;
+	*pp = p;
+	return 1;
+}
+
+/*
+ * return the start of the first line at or after p that doesn't start
+ * with whitespace.
+ */
+static const char *
+sf_find_s3raw(SpiceStream *sf, const char *p, const char *end)
+{
+	const char *nl;
+
+	for(p--; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		if(nl == NULL || nl + 1 == end)
+			return end;
+		if(!isspace(nl[1]))
+			return nl + 1;
+	}
+	return end;
+}
+
+/*
+ * Read the next run of up to SS_VBUFSIZE values from binary spice3
+ * rawfile into sf->vbuf, and do the related error-checking.
+ */
+static int
+sf_fillbuf_s3bin(SpiceStream *sf)
+{
+	SSIndex pos;
+	int n;
 
 	if(sf->read_vals >= sf->expected_vals) {
-		pos = ftello64(sf->fp);
-		ss_msg(DBG, "sf_getval_s3bin", "past last expected value offset 0x%lx", (long) pos);
+		pos = ss_tell(sf);
+		ss_msg(DBG, "sf_getval_s3bin", "past last expected value offset 0x%llx", (long long) pos);
 		return 0;
 	}
-	if(fread(&val, sizeof(double), 1, sf->fp) != 1) {
-		pos = ftello64(sf->fp);
-		ss_msg(ERR, "sf_getval_s3bin", "unexepected EOF in data at offset 0x%lx", (long) pos);
+	if(sf->vbuf == NULL) {
+		sf->vbufsize = SS_VBUFSIZE;
+		sf->vbuf = g_new(double, sf->vbufsize);
+	}
+	n = MIN(sf->expected_vals - sf->read_vals, sf->vbufsize);
+	n = ss_fread(sf->vbuf, sizeof(double), n, sf);
+	if(n <= 0) {
+		pos = ss_tell(sf);
+		ss_msg(SS_EOF_LEVEL(sf, ERR), "sf_getval_s3bin", "unexepected EOF in data at offset 0x%llx", (long long) pos);
 		return -1;
 	}
-	sf->read_vals++;
+	sf->read_vals += n;
+	sf->vbuflen = n;
+	sf->vbufpos = 0;
+	return 1;
+}
+
+/*
+ * Get a single value from binary spice3 rawfile.
+ */
+static int
+sf_getval_s3bin(SpiceStream *sf, double *dval)
+{
+	int rc;
 
-	*dval = val;
+	if(sf->vbufpos >= sf->vbuflen) {
+		rc = sf_fillbuf_s3bin(sf);
+		if(rc <= 0)
+			return rc;
+	}
+	*dval = sf->vbuf[sf->vbufpos++];
 	return 1;
 }
 
+/*
+ * Get the next n values from binary spice3 rawfile, copying them a run
+ * at a time.  Returns the number of values gotten, which is less than n
+ * at the end of the data or on error.
+ */
+static int
+sf_getvals_s3bin(SpiceStream *sf, double *dvals, int n)
+{
+	int i, k;
+
+	for(i = 0; i < n; i += k) {
+		if(sf->vbufpos >= sf->vbuflen && sf_fillbuf_s3bin(sf) <= 0)
+			break;
+		k = MIN(n - i, sf->vbuflen - sf->vbufpos);
+		memcpy(dvals + i, sf->vbuf + sf->vbufpos, k * sizeof(double));
+		sf->vbufpos += k;
+	}
+	return i;
+}
+
 
 /*
  * Read row of values from a binay spice3 raw file
@@ -373,7 +550,7 @@ sf_getval_s3bin(SpiceStream *sf, double *dval)
 static int
 sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
 {
-	int i, rc;
+	int n, rc;
 	double v;
 	double dummy;
 	
@@ -392,11 +569,18 @@ sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
 		}
 		if(v < sf->ivval) {
 			/* independent-variable value decreased, this must
-			 * be the start of another sweep.  hold the value and
-			 * return flag to caller.
+			 * be the start of another sweep.  Leave the value
+			 * to be read again if it is still in vbuf, so that
+			 * ss_seekpoint() can note where the sweep starts,
+			 * else hold it; return flag to caller.
 			 */
-			sf->ivval = v;
-			sf->flags |= SSF_PUSHBACK;
+			if(sf->vbufpos >= sf->ivar->ncols) {
+				sf->vbufpos -= sf->ivar->ncols;
+				sf->ivval = -DBL_MAX;
+			} else {
+				sf->ivval = v;
+				sf->flags |= SSF_PUSHBACK;
+			}
 			return -2;
 		} else {
 			sf->ivval = v;
@@ -408,13 +592,225 @@ sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
 		*ivar = sf->ivval;
 	}
 
-	for(i = 0; i < sf->ncols-1; i++) {
-		if(sf_getval_s3bin(sf, &dvars[i]) != 1) {
-			ss_msg(WARN, "sf_readrow_s3bin", "%s: EOF or error reading data field %d in row %d; file is incomplete.", sf->filename, i, sf->read_rows);
-			return 0;
-		}
+	n = sf_getvals_s3bin(sf, dvars, sf->ncols-1);
+	if(n < sf->ncols-1) {
+		ss_msg(WARN, "sf_readrow_s3bin", "%s: EOF or error reading data field %d in row %lld; file is incomplete.", sf->filename, n, sf->read_rows);
+		return 0;
 	}
 
 	sf->read_rows++;
 	return 1;
 }
+
+/*
+ * Read up to nmax rows of values from a binary spice3 raw file
+ */
+static int
+sf_readrows_s3bin(SpiceStream *sf, int nmax, double *ivbuf, double *dvbuf)
+{
+	int n, rc;
+
+	for(n = 0; n < nmax; n++) {
+		rc = sf_readrow_s3bin(sf, &ivbuf[n], &dvbuf[n * sf->ncols]);
+		if(rc <= 0)
+			return ss_rows_done(sf, n, rc);
+	}
+	return n;
+}
+
+/*
+ * Read column col of n rows from a binary spice3 raw file, starting at
+ * the seek point sp: all rows are the same size, so each value is read
+ * from where it must be.
+ */
+static int
+sf_readcol_s3bin(SpiceStream *sf, SSSeekPoint *sp, int col, int n,
+		 double *buf)
+{
+	int rowvals, idx;
+
+	/* complex files have a dummy imaginary part for the ivar */
+	rowvals = sf->ivar->ncols + sf->ncols - 1;
+	idx = (col == 0) ? 0 : sf->ivar->ncols - 1 + col;
+	if(ss_pread_items(sf, sp->pos + idx * sizeof(double),
+			  (SSIndex)rowvals * sizeof(double), sizeof(double),
+			  n, (char *)buf) != n)
+		return -1;
+	sp->pos += (SSIndex)n * rowvals * sizeof(double);
+	sp->read_vals += (SSIndex)n * rowvals;
+	return n;
+}
+
+/*
+ * Return the number of rows in the file, from the "No. Points"
+ * line in the header.  
+ */
+static SSIndex
+sf_guessrows_s3raw(SpiceStream *sf)
+{
+	/* complex files have a dummy imaginary part for the ivar */
+	return sf->expected_vals / (sf->ncols + (sf->ivar->ncols - 1));
+}
+
+/*
+ * Read the header of a plot from fp, which is at the start of it, as far
+ * as its "Values:" or "Binary:" line, noting what sf_findplots_s3raw
+ * needs to know about it.
+ * Returns 1 on success, 0 if there isn't a whole header there.
+ */
+static int
+s3raw_plot_header(FILE *fp, SSPlot *p, int *binaryp, int *complexp,
+		  char **linep, int *sizep)
+{
+	char *lp, *key, *val;
+	int i, skip;
+
+	p->name = NULL;
+	p->nvars = 0;
+	p->npoints = 0;
+	*binaryp = *complexp = 0;
+	if(fread_line(fp, linep, sizep) == EOF
+	   || strncmp(*linep, "Title:", 6) != 0)
+		return 0;
+	while(fread_line(fp, linep, sizep) != EOF) {
+		lp = *linep;
+		key = ss_strtok(&lp, ":");
+		if(!key)
+			break;
+		if(strcmp(key, "Plotname") == 0) {
+			g_free(p->name);
+			p->name = g_strdup(g_strstrip(lp));
+		} else if(strcmp(key, "Flags") == 0) {
+			while((val = ss_strtok(&lp, " ,\t\n")) != NULL)
+				if(strcmp(val, "complex") == 0)
+					*complexp = 1;
+				else if(strcmp(val, "real") == 0)
+					*complexp = 0;
+		} else if(strcmp(key, "No. Variables") == 0) {
+			p->nvars = atoi(lp);
+		} else if(strcmp(key, "No. Points") == 0) {
+			p->npoints = strtoll(lp, NULL, 10);
+		} else if(strcmp(key, "Variables") == 0) {
+			/* the first may be on the same line */
+			skip = p->nvars;
+			if(ss_strtok(&lp, " \t\n"))
+				skip--;
+			for(i = 0; i < skip; i++)
+				if(fread_line(fp, linep, sizep) == EOF)
+					goto fail;
+		} else if(strcmp(key, "Values") == 0) {
+			return p->nvars > 0;
+		} else if(strcmp(key, "Binary") == 0) {
+			*binaryp = 1;
+			return p->nvars > 0;
+		}
+	}
+ fail:
+	g_free(p->name);
+	p->name = NULL;
+	return 0;
+}
+
+#define S3_SCANBUF 65536
+
+/*
+ * Offset of the start of the next line in fp that starts with "Title:",
+ * the header of another plot, or -1 if there isn't one.  fp is at the
+ * start of a line, which may be that one: the next plot's header follows
+ * straight on from one with no points.
+ */
+static SSIndex
+s3raw_next_title(FILE *fp)
+{
+	char *buf, *p, *end;
+	SSIndex base;	/* offset in the file of buf[0] */
+	SSIndex start;
+	size_t n, keep;
+
+	buf = g_new(char, S3_SCANBUF + 6);
+	base = start = ftello64(fp);
+	keep = 0;
+	while((n = fread(buf + keep, 1, S3_SCANBUF, fp)) > 0) {
+		end = buf + keep + n;
+		if(base == start && end - buf >= 6
+		   && memcmp(buf, "Title:", 6) == 0) {
+			g_free(buf);
+			return base;
+		}
+		for(p = buf; (p = memchr(p, '\n', end - p)) != NULL; p++) {
+			if(end - p <= 6)
+				break;
+			if(memcmp(p + 1, "Title:", 6) == 0) {
+				base += p + 1 - buf;
+				g_free(buf);
+				return base;
+			}
+		}
+		/* the start of a match may be in the last few bytes */
+		keep = MIN(6, end - buf);
+		memmove(buf, end - keep, keep);
+		base += (end - buf) - keep;
+	}
+	g_free(buf);
+	return -1;
+}
+
+/*
+ * Find the plots in a spice3 rawfile, such as those ngspice writes for
+ * the operating point and each analysis of a run.  Only their headers
+ * are read: the data of a binary plot is stepped over, and that of an
+ * ascii one looked through for the line that starts the next header.
+ * Returns the number found, or 0 if the file can't be looked through.
+ */
+static int
+sf_findplots_s3raw(SpiceStream *sf)
+{
+	FILE *fp;
+	struct stat st;
+	GArray *plots;
+	SSPlot p;
+	SSIndex pos;
+	char *line = NULL;
+	int linesize = 1024;
+	int binary, complex, c;
+
+	fp = ss_fopen(sf->filename);
+	if(fp == NULL)
+		return 0;
+	if(fstat(fileno(fp), &st) < 0 || !S_ISREG(st.st_mode)) {
+		fclose(fp);
+		return 0;
+	}
+	plots = g_array_new(0, 0, sizeof(SSPlot));
+	pos = 0;
+	while(fseeko64(fp, pos, SEEK_SET) == 0) {
+		/* binary data may be followed by a newline or two */
+		while((c = getc(fp)) != EOF && isspace(c))
+			pos++;
+		if(c == EOF)
+			break;
+		ungetc(c, fp);
+		if(!s3raw_plot_header(fp, &p, &binary, &complex,
+				      &line, &linesize))
+			break;
+		p.hdrpos = pos;
+		p.datapos = ftello64(fp);
+		g_array_append_val(plots, p);
+		ss_msg(DBG, "sf_findplots_s3raw", "%s: plot %d \"%s\" at offset %lld, %d variables, %lld points",
+		       sf->filename, plots->len - 1, p.name ? p.name : "",
+		       p.hdrpos, p.nvars, p.npoints);
+		if(binary)
+			pos = p.datapos + p.npoints * p.nvars
+				* (complex ? 2 : 1) * sizeof(double);
+		else
+			pos = s3raw_next_title(fp);
+		if(pos < 0 || pos >= st.st_size)
+			break;
+	}
+	g_free(line);
+	fclose(fp);
+
+	sf->nplots = plots->len;
+	sf->plots = (SSPlot *)g_array_free(plots, plots->len == 0);
+	return sf->nplots;
+}
@@ -31,12 +31,88 @@
 
 #define _LARGEFILE64_SOURCE 1
 #include <unistd.h>
+#include <stdio.h>
+#include <setjmp.h>
 
 #if !defined(_LFS64_STDIO)
 #define fopen64 fopen
 #define ftello64 ftello
+#define fseeko64 fseeko
+#define mkstemp64 mkstemp
 #define off64_t off_t
 #endif
+/* number of values binary readers decode at a time into SpiceStream.vbuf */
+#define SS_VBUFSIZE	4096
+
+/* ssparse.c */
+extern double ss_strtod(const char *s, char **endp);
+extern double ss_strtod_n(const char *s, int n, char **endp);
+extern char *ss_strtok(char **sp, const char *delim);
+
+struct _SpiceStream;
+
+/* ssthread.c */
+/*
+ * Parse the record at *pp, which ends before end, into *ivar and dvars,
+ * and advance *pp past it.  Returns 1, or else leaves *pp at the record
+ * and returns 0 at the end of the data, or SSP_SERIAL if the record
+ * must be read by readrow - because it calls for a message, or might
+ * not be read the same way.  Called on several threads at once.
+ */
+typedef int (*SSParseRow)(struct _SpiceStream *ss, const char **pp,
+			  const char *end, double *ivar, double *dvars);
+/* return the start of the first record at or after p */
+typedef const char *(*SSParFind)(struct _SpiceStream *ss, const char *p,
+				 const char *end);
+#define SSP_SERIAL	(-3)
+#define SSP_FAULT	(-4)	/* parse status: the mapping went away */
+#define SSP_IVSPLIT	1	/* new table when the ivar decreases */
+
+extern int ss_par_start(struct _SpiceStream *ss, SSParseRow parse,
+			SSParFind find, int flags);
+extern int ss_par_readrow(struct _SpiceStream *ss, double *ivar, double *dvars);
+extern int ss_par_readrows(struct _SpiceStream *ss, int nmax, double *ivbuf,
+			   double *dvbuf);
+extern void ss_par_free(struct _SpiceStream *ss);
+extern void ss_par_stop(struct _SpiceStream *ss);
+extern int ss_par_tell(struct _SpiceStream *ss, long long *posp, int *linenop);
+extern int ss_par_seek(struct _SpiceStream *ss, long long pos, int lineno);
+/*
+ * A guard against SIGBUS from reading a mapped file after it has been
+ * cut short: push one, call sigsetjmp(g.env, 0), and if that returns
+ * nonzero the mapping was read past the end of the file.  Pop it when
+ * done with the mapping.  Guards are per thread, and nest.
+ */
+typedef struct _SSGuard {
+	sigjmp_buf env;
+	struct _SSGuard *prev;
+} SSGuard;
+extern void ss_guard_push(SSGuard *g);
+extern void ss_guard_pop(SSGuard *g);
+extern int ss_nthreads(void);
+typedef void *(*SSJobFunc)(void *arg);
+typedef void (*SSJobDone)(int i, void *result, void *data);
+extern void ss_run_jobs(int n, SSJobFunc func, void **args, SSJobDone done,
+			void *data);
+extern void ss_lock(void);
+extern void ss_unlock(void);
+typedef struct _SSThread SSThread;
+extern SSThread *ss_thread_start(SSJobFunc func, void *arg);
+extern void *ss_thread_join(SSThread *t);
+
+/* spicestream.c */
+extern void ss_unmap(struct _SpiceStream *ss);
+extern FILE *ss_tmpfile(void);
+extern int ss_pread_items(struct _SpiceStream *ss, long long pos,
+			  long long stride, int size, int n, char *buf);
+
+/* should the reader decode column i of dvars?  see ss_select_vars() */
+#define SS_WANTCOL(ss, i) ((ss)->colwant == NULL || (ss)->colwant[i])
+
+/* level for messages about data ending part way through a row, which
+ * is to be expected of a file that is still being written */
+#define SS_EOF_LEVEL(ss, lev) (((ss)->flags & SSF_FOLLOW) ? DBG : (lev))
+
 /* wish there was a way to portably printf either a 64-bit or 32-bit off_t
  * without cluttering the rest of the source with #ifdefs.
  */
@@ -0,0 +1,216 @@
+/*
+ * ssparse.c - number parsing and tokenizing for the ascii readers
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * ss_strtod() gives exactly the same results as strtod(), but is
+ * much faster for the sort of numbers simulators write.
+ *
+ * Numbers with up to 19 significant digits are gathered into a 64-bit
+ * integer mantissa m and a decimal exponent e.  When m < 2^53 and
+ * |e| <= 22, both m and 10^e are exact doubles, so the single
+ * multiplication or division m * 10^e is correctly rounded
+ * (Clinger's fast path), and so equal to what strtod() returns.
+ * Anything else - more digits, large exponents, hex, inf, nan -
+ * is handed to strtod() itself.
+ *
+ * The fast path depends on double arithmetic being done in double
+ * precision; where it isn't (x87 without SSE2), strtod() is always used.
+ */
+
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <config.h>
+#include <glib.h>
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define SS_FASTPATH 1
+#endif
+
+#ifdef SS_FASTPATH
+static const double pow10_tab[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAXDIGITS	19	/* always fit in a guint64 */
+#define MAXEXACT	(G_GINT64_CONSTANT(1) << 53)
+
+/* same set of characters that isspace() accepts in the C locale */
+#define IS_SPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/*
+ * Parse a number from the characters between s and end, if it can be done
+ * on the fast path.  Returns 1 and fills in *valp and *endp on success,
+ * or 0 if strtod() must be used instead.
+ */
+static int
+ss_parse_fast(const char *s, const char *end, double *valp, char **endp)
+{
+	const char *p = s;
+	const char *q;
+	guint64 m = 0;
+	int nd = 0;	/* significant digits in m */
+	int e = 0;	/* decimal exponent */
+	int ex, exneg;
+	int neg = 0;
+	int any = 0;
+	double v;
+
+	while(p < end && IS_SPACE(*p))
+		p++;
+	if(p < end && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		p++;
+	}
+	if(p >= end)
+		return 0;
+	if(*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X'))
+		return 0;	/* hex */
+
+	for(; p < end && IS_DIGIT(*p); p++) {
+		any = 1;
+		if(m == 0 && *p == '0')
+			continue;
+		if(nd == MAXDIGITS)
+			return 0;
+		m = m * 10 + (*p - '0');
+		nd++;
+	}
+	if(p < end && *p == '.') {
+		for(p++; p < end && IS_DIGIT(*p); p++) {
+			any = 1;
+			e--;
+			if(m == 0 && *p == '0')
+				continue;
+			if(nd == MAXDIGITS)
+				return 0;
+			m = m * 10 + (*p - '0');
+			nd++;
+		}
+	}
+	if(!any)
+		return 0;	/* no digits; inf, nan, or not a number */
+
+	/* the exponent only counts if it has at least one digit */
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		q = p + 1;
+		exneg = 0;
+		if(q < end && (*q == '-' || *q == '+')) {
+			exneg = (*q == '-');
+			q++;
+		}
+		if(q < end && IS_DIGIT(*q)) {
+			ex = 0;
+			for(; q < end && IS_DIGIT(*q); q++)
+				if(ex < 10000)
+					ex = ex * 10 + (*q - '0');
+			e += exneg ? -ex : ex;
+			p = q;
+		}
+	}
+
+	if(m == 0)
+		v = 0.0;
+	else if(m > MAXEXACT || e < -22 || e > 22)
+		return 0;
+	else if(e < 0)
+		v = (double)m / pow10_tab[-e];
+	else
+		v = (double)m * pow10_tab[e];
+
+	*valp = neg ? -v : v;
+	if(endp)
+		*endp = (char *)p;
+	return 1;
+}
+#endif /* SS_FASTPATH */
+
+/*
+ * Exactly like strtod(s, endp), but faster for ordinary numbers.
+ */
+double
+ss_strtod(const char *s, char **endp)
+{
+#ifdef SS_FASTPATH
+	double v;
+	size_t n = strnlen(s, 64);
+
+	/* leave very long strings, which may hold very long numbers, to strtod */
+	if(n < 64 && ss_parse_fast(s, s + n, &v, endp))
+		return v;
+#endif
+	return strtod(s, endp);
+}
+
+/*
+ * Like strtod() applied to a copy of the n characters at s, for
+ * fixed-width fields and for text that isn't nul-terminated, such as
+ * a mapped file.  Nothing past s + n is looked at.
+ */
+double
+ss_strtod_n(const char *s, int n, char **endp)
+{
+	char buf[64];
+	char *cp, *ep;
+	double v;
+
+#ifdef SS_FASTPATH
+	if(ss_parse_fast(s, s + n, &v, endp))
+		return v;
+#endif
+	cp = (n < sizeof(buf)) ? buf : g_malloc(n + 1);
+	memcpy(cp, s, n);
+	cp[n] = '\0';
+	v = strtod(cp, &ep);
+	if(endp)
+		*endp = (char *)s + (ep - cp);
+	if(cp != buf)
+		g_free(cp);
+	return v;
+}
+
+/*
+ * Return the next token from the string at *sp, separated by any of
+ * the characters in delim, and nul-terminate it.  *sp is advanced past
+ * the token, so that the next call finds the one after.
+ * Returns NULL when there are no more tokens.
+ * Like strtok_r(), but with the state kept where the caller can see it.
+ */
+char *
+ss_strtok(char **sp, const char *delim)
+{
+	char *s = *sp + strspn(*sp, delim);
+	char *e;
+
+	if(*s == '\0') {
+		*sp = s;
+		return NULL;
+	}
+	e = s + strcspn(s, delim);
+	if(*e)
+		*e++ = '\0';
+	*sp = e;
+	return s;
+}
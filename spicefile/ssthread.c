@@ -0,0 +1,701 @@
+/*
+ * ssthread.c - parse the data of ascii-format files on several threads
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * Once the header of a large ascii file has been read, the file is mapped
+ * and its data is cut into chunks of about SS_PAR_CHUNK bytes, each
+ * starting at the beginning of a record, as found by the reader's
+ * SSParFind function.  A batch of chunks, one per thread, is parsed at a
+ * time by the reader's SSParseRow function into per-chunk buffers of
+ * rows, which are then handed out in order by ss_readrow() and
+ * ss_readrows().
+ *
+ * Everything that depends on the rows before it - the check for a
+ * decreasing independent variable that marks a new sweep, line numbers
+ * for messages - is done as the rows are handed out, so the results are
+ * the same as reading the file a row at a time.  If a parser finds
+ * something it can't be sure of handling the same way, or anything
+ * that calls for a message, it says so, and reading carries on from that
+ * record with the reader's ordinary readrow function.
+ */
+
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <config.h>
+#include <glib.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define SS_THREADS 1
+#include <pthread.h>
+#endif
+
+#include "spicestream.h"
+
+/* bytes of file in each chunk */
+#ifndef SS_PAR_CHUNK
+#define SS_PAR_CHUNK	(1024*1024)
+#endif
+
+/*
+ * number of threads to use for parsing ascii files, and for reading
+ * several files at once: 0 for one per processor, 1 to do everything
+ * on the calling thread.
+ */
+int spicestream_nthreads = 0;
+
+#ifdef SS_THREADS
+static pthread_mutex_t ss_global_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ss_guard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ss_guard_key;
+#else
+static int ss_guard_inited;
+static SSGuard *ss_guard_top;
+#endif
+static struct sigaction ss_guard_oldbus;
+
+typedef struct {
+	const char *start;	/* bytes to parse */
+	const char *end;
+	double *iv;		/* rows parsed */
+	double *dv;
+	const char **rowp;	/* where each row starts */
+	int nrows;
+	int nalloc;
+	int pos;		/* next row to hand out */
+	int rc;			/* 1 if all parsed, else status from parser */
+	const char *stop;	/* where the parser stopped, if not all parsed */
+} SSChunk;
+
+struct _SSPar {
+	SSParseRow parse;
+	SSParFind find;
+	int flags;
+	int nthreads;
+	SSReadRow serial_readrow;	/* to carry on without us */
+	SSReadRows serial_readrows;
+	SSChunk *chunks;	/* the current batch */
+	int nchunks;
+	int cur;		/* chunk rows are being handed out from */
+	int pushback;		/* next row starts a new sweep, already reported */
+	int done;
+	const char *base;	/* start of data, at line baseline */
+	int baseline;
+	const char *linep;	/* last place ss_par_lineno() was asked */
+	int lineno;		/* about, and its answer */
+};
+
+typedef struct _SSPar SSPar;
+
+/*
+ * A file that is truncated while it is mapped raises SIGBUS when the part
+ * that is gone is touched.  Code reading a mapping pushes an SSGuard, and
+ * the handler jumps back to the innermost one on the faulting thread.
+ * A SIGBUS anywhere else is passed on to whatever handled it before.
+ */
+static SSGuard *
+ss_guard_top_get(void)
+{
+#ifdef SS_THREADS
+	return pthread_getspecific(ss_guard_key);
+#else
+	return ss_guard_top;
+#endif
+}
+
+static void
+ss_guard_top_set(SSGuard *g)
+{
+#ifdef SS_THREADS
+	pthread_setspecific(ss_guard_key, g);
+#else
+	ss_guard_top = g;
+#endif
+}
+
+static void
+ss_guard_handler(int sig, siginfo_t *si, void *ctx)
+{
+	SSGuard *g = ss_guard_top_get();
+
+	if(g) {
+		ss_guard_top_set(g->prev);
+		siglongjmp(g->env, 1);
+	}
+	if(ss_guard_oldbus.sa_flags & SA_SIGINFO)
+		(ss_guard_oldbus.sa_sigaction)(sig, si, ctx);
+	else if(ss_guard_oldbus.sa_handler != SIG_DFL
+		&& ss_guard_oldbus.sa_handler != SIG_IGN)
+		(ss_guard_oldbus.sa_handler)(sig);
+	else	/* the fault happens again on return, and is fatal */
+		signal(sig, SIG_DFL);
+}
+
+static void
+ss_guard_init(void)
+{
+	struct sigaction sa;
+
+#ifdef SS_THREADS
+	pthread_key_create(&ss_guard_key, NULL);
+#endif
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = ss_guard_handler;
+	sigemptyset(&sa.sa_mask);
+	/* SA_NODEFER, since guards jump out with sigsetjmp(env, 0) */
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigaction(SIGBUS, &sa, &ss_guard_oldbus);
+}
+
+void
+ss_guard_push(SSGuard *g)
+{
+#ifdef SS_THREADS
+	pthread_once(&ss_guard_once, ss_guard_init);
+#else
+	if(!ss_guard_inited) {
+		ss_guard_init();
+		ss_guard_inited = 1;
+	}
+#endif
+	g->prev = ss_guard_top_get();
+	ss_guard_top_set(g);
+}
+
+void
+ss_guard_pop(SSGuard *g)
+{
+	ss_guard_top_set(g->prev);
+}
+
+/*
+ * number of threads to use
+ */
+int
+ss_nthreads(void)
+{
+	int n = spicestream_nthreads;
+
+#ifdef SS_THREADS
+#ifdef _SC_NPROCESSORS_ONLN
+	if(n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#else
+	n = 1;
+#endif
+	return MAX(n, 1);
+}
+
+/*
+ * Set up to parse the rest of a SpiceStream's file in parallel, once its
+ * header has been read and readrow set.  parse reads a record,
+ * find finds the start of the first record at or after a place in the file.
+ * flags may include SSP_IVSPLIT, to start a new table whenever the
+ * independent variable decreases, as for the row readers that return -2.
+ * Small files, pipes, and files that can't be mapped are left alone.
+ * Returns 1 if the file will be parsed in parallel, else 0.
+ */
+int
+ss_par_start(SpiceStream *ss, SSParseRow parse, SSParFind find, int flags)
+{
+	SSPar *par;
+	int nthreads = ss_nthreads();
+
+	if(nthreads < 2 || !ss_map(ss))
+		return 0;
+	if(ss->mapsize - ss->mappos < 2 * SS_PAR_CHUNK) {
+		ss_unmap(ss);
+		return 0;
+	}
+
+	par = g_new0(SSPar, 1);
+	par->parse = parse;
+	par->find = find;
+	par->flags = flags;
+	par->nthreads = nthreads;
+	par->serial_readrow = ss->readrow;
+	par->serial_readrows = ss->readrows;
+	par->chunks = g_new0(SSChunk, nthreads);
+	par->base = ss->map + ss->mappos;
+	par->baseline = ss->lineno;
+	ss->par = par;
+	ss->readrow = ss_par_readrow;
+	ss->readrows = ss_par_readrows;
+	ss_msg(DBG, "ss_par_start", "%s: parsing with %d threads",
+	       ss->filename, nthreads);
+	return 1;
+}
+
+void
+ss_par_free(SpiceStream *ss)
+{
+	SSPar *par = ss->par;
+	int i;
+
+	if(par == NULL)
+		return;
+	for(i = 0; i < par->nthreads; i++) {
+		g_free(par->chunks[i].iv);
+		g_free(par->chunks[i].dv);
+		g_free(par->chunks[i].rowp);
+	}
+	g_free(par->chunks);
+	g_free(par);
+	ss->par = NULL;
+}
+
+/*
+ * line number of the line containing p.  Counts on from the place
+ * asked about last time, if p is after it.
+ */
+static int
+ss_par_lineno(SSPar *par, const char *p)
+{
+	const char *cp = par->base;
+	int n = par->baseline + 1;
+
+	if(par->linep && par->linep <= p) {
+		cp = par->linep;
+		n = par->lineno;
+	}
+	for(; cp < p; cp++)
+		if(*cp == '\n')
+			n++;
+	par->linep = p;
+	par->lineno = n;
+	return n;
+}
+
+/*
+ * parse a chunk.  Run on the worker threads.
+ */
+static void
+ss_par_parse_chunk(SpiceStream *ss, SSChunk *ck)
+{
+	SSPar *par = ss->par;
+	const char *p = ck->start;
+	SSGuard g;
+	int rc;
+
+	ck->nrows = 0;
+	ck->pos = 0;
+	ss_guard_push(&g);
+	if(sigsetjmp(g.env, 0)) {
+		/* the rows parsed before the fault are still good */
+		ck->rc = SSP_FAULT;
+		return;
+	}
+	while(p < ck->end) {
+		if(ck->nrows >= ck->nalloc) {
+			ck->nalloc = MAX(1024, ck->nalloc * 2);
+			ck->iv = g_renew(double, ck->iv, ck->nalloc);
+			ck->dv = g_renew(double, ck->dv, ck->nalloc * ss->ncols);
+			ck->rowp = g_renew(const char *, ck->rowp, ck->nalloc);
+		}
+		ck->rowp[ck->nrows] = p;
+		rc = (par->parse)(ss, &p, ck->end, &ck->iv[ck->nrows],
+				  &ck->dv[ck->nrows * ss->ncols]);
+		if(rc != 1) {
+			ck->rc = rc;
+			ck->stop = p;
+			ss_guard_pop(&g);
+			return;
+		}
+		ck->nrows++;
+	}
+	ck->rc = 1;
+	ss_guard_pop(&g);
+}
+
+#ifdef SS_THREADS
+typedef struct {
+	SpiceStream *ss;
+	SSChunk *ck;
+} SSParJob;
+
+static void *
+ss_par_thread(void *arg)
+{
+	SSParJob *job = arg;
+
+	ss_par_parse_chunk(job->ss, job->ck);
+	return NULL;
+}
+#endif
+
+/*
+ * cut the next batch of chunks from the mapping, and parse them.
+ * Returns the number of chunks, 0 at the end of the file.
+ */
+static int
+ss_par_fetch(SpiceStream *ss)
+{
+	SSPar *par = ss->par;
+	const char *p = ss->map + ss->mappos;
+	const char *mapend = ss->map + ss->mapsize;
+	const char *e;
+	int i, n;
+#ifdef SS_THREADS
+	pthread_t *tid;
+	SSParJob *job;
+#endif
+
+	par->cur = 0;
+	for(n = 0; n < par->nthreads && p < mapend; n++) {
+		if(mapend - p <= SS_PAR_CHUNK)
+			e = mapend;
+		else
+			e = (par->find)(ss, p + SS_PAR_CHUNK, mapend);
+		par->chunks[n].start = p;
+		par->chunks[n].end = e;
+		p = e;
+	}
+	ss->mappos = p - ss->map;
+	par->nchunks = n;
+
+#ifdef SS_THREADS
+	/* chunk 0 is parsed on this thread, the rest each on one of their own */
+	tid = g_new(pthread_t, n);
+	job = g_new0(SSParJob, n);
+	for(i = 1; i < n; i++) {
+		job[i].ss = ss;
+		job[i].ck = &par->chunks[i];
+		if(pthread_create(&tid[i], NULL, ss_par_thread, &job[i]) != 0)
+			job[i].ss = NULL;
+	}
+	if(n > 0)
+		ss_par_parse_chunk(ss, &par->chunks[0]);
+	for(i = 1; i < n; i++) {
+		if(job[i].ss)
+			pthread_join(tid[i], NULL);
+		else
+			ss_par_parse_chunk(ss, &par->chunks[i]);
+	}
+	g_free(tid);
+	g_free(job);
+#else
+	for(i = 0; i < n; i++)
+		ss_par_parse_chunk(ss, &par->chunks[i]);
+#endif
+	return n;
+}
+
+/*
+ * Give up on parallel parsing, and carry on with the ordinary
+ * readrow function from the record at p.
+ */
+static void
+ss_par_serial(SpiceStream *ss, const char *p)
+{
+	SSPar *par = ss->par;
+
+	ss_msg(DBG, "ss_par_serial", "%s: reading serially from offset %lld",
+	       ss->filename, (SSIndex)(p - ss->map));
+	ss->lineno = ss_par_lineno(par, p) - 1;
+	ss->linep = NULL;
+	fseeko64(ss->fp, p - ss->map, SEEK_SET);
+	ss->readrow = par->serial_readrow;
+	ss->readrows = par->serial_readrows;
+	ss_par_free(ss);
+	ss_unmap(ss);
+}
+
+/*
+ * Stop parsing in parallel before any rows have been read, and read
+ * the rest of the file with the reader's own functions.
+ */
+void
+ss_par_stop(SpiceStream *ss)
+{
+	if(ss->par)
+		ss_par_serial(ss, ss->map + ss->mappos);
+}
+
+/*
+ * offset in the file, and number of lines before it, of the next row
+ * to be handed out, for ss_seekpoint().  At the start of a sweep, that
+ * row's value of the independent variable is already in ss->ivval,
+ * so it won't be taken for the start of another sweep when read again.
+ * Returns 0 after the end of the data.
+ */
+int
+ss_par_tell(SpiceStream *ss, long long *posp, int *linenop)
+{
+	SSPar *par = ss->par;
+	SSChunk *ck;
+	const char *p;
+
+	if(par->done)
+		return 0;
+	if(par->cur >= par->nchunks) {
+		p = ss->map + ss->mappos;
+	} else {
+		ck = &par->chunks[par->cur];
+		if(ck->pos < ck->nrows)
+			p = ck->rowp[ck->pos];
+		else if(ck->rc == 1)
+			p = ck->end;
+		else
+			p = ck->stop;
+	}
+	*posp = p - ss->map;
+	*linenop = ss_par_lineno(par, p) - 1;
+	return 1;
+}
+
+/*
+ * carry on parsing from the record at offset pos in the file,
+ * after lineno lines, for ss_seek().
+ */
+int
+ss_par_seek(SpiceStream *ss, long long pos, int lineno)
+{
+	SSPar *par = ss->par;
+
+	if(pos > ss->mapsize)
+		return 0;
+	ss->mappos = pos;
+	par->cur = par->nchunks = 0;
+	par->pushback = 0;
+	par->done = 0;
+	par->linep = ss->map + pos;
+	par->lineno = lineno + 1;
+	return 1;
+}
+
+/*
+ * readrows function for files being parsed in parallel
+ */
+int
+ss_par_readrows(SpiceStream *ss, int nmax, double *ivbuf, double *dvbuf)
+{
+	SSPar *par = ss->par;
+	SSChunk *ck;
+	int n = 0;
+	int rc;
+
+	while(n < nmax) {
+		if(par->done)
+			return ss_rows_done(ss, n, 0);
+		if(par->cur >= par->nchunks && ss_par_fetch(ss) == 0) {
+			par->done = 1;
+			continue;
+		}
+		ck = &par->chunks[par->cur];
+		if(ck->pos < ck->nrows) {
+			if((par->flags & SSP_IVSPLIT) && !par->pushback
+			   && ck->iv[ck->pos] < ss->ivval) {
+				/* the start of another sweep */
+				ss->ivval = ck->iv[ck->pos];
+				par->pushback = 1;
+				return ss_rows_done(ss, n, -2);
+			}
+			par->pushback = 0;
+			ss->ivval = ivbuf[n] = ck->iv[ck->pos];
+			memcpy(&dvbuf[n * ss->ncols], &ck->dv[ck->pos * ss->ncols],
+			       ss->ncols * sizeof(double));
+			ss->read_rows++;
+			ck->pos++;
+			n++;
+			continue;
+		}
+
+		rc = ck->rc;
+		if(rc == 1) {
+			par->cur++;
+			continue;
+		}
+		if(rc == SSP_SERIAL) {
+			ss_par_serial(ss, ck->stop);
+			if(n > 0)
+				return n;
+			return ss_readrows(ss, nmax, ivbuf, dvbuf);
+		}
+		if(rc == SSP_FAULT) {
+			ss_msg(ERR, "ss_par_readrows",
+			       "%s: file was cut short while being read",
+			       ss->filename);
+			rc = -1;
+		}
+		par->done = 1;
+		return ss_rows_done(ss, n, rc);
+	}
+	return n;
+}
+
+/*
+ * readrow function for files being parsed in parallel
+ */
+int
+ss_par_readrow(SpiceStream *ss, double *ivar, double *dvars)
+{
+	return ss_par_readrows(ss, 1, ivar, dvars);
+}
+
+/*
+ * The lock for state shared by all SpiceStreams and WaveFiles, such as
+ * the memory budget of paged datasets.  Not recursive.
+ */
+void
+ss_lock(void)
+{
+#ifdef SS_THREADS
+	pthread_mutex_lock(&ss_global_lock);
+#endif
+}
+
+void
+ss_unlock(void)
+{
+#ifdef SS_THREADS
+	pthread_mutex_unlock(&ss_global_lock);
+#endif
+}
+
+#ifdef SS_THREADS
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	SSJobFunc func;
+	void **args;
+	void **results;
+	int n;
+	int next;	/* next job to start */
+	int *finished;	/* jobs in the order they finished */
+	int nfinished;
+} SSJobs;
+
+static void *
+ss_job_thread(void *arg)
+{
+	SSJobs *jobs = arg;
+	void *res;
+	int i;
+
+	for(;;) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+		if(i >= jobs->n)
+			break;
+		res = (jobs->func)(jobs->args[i]);
+		pthread_mutex_lock(&jobs->lock);
+		jobs->results[i] = res;
+		jobs->finished[jobs->nfinished++] = i;
+		pthread_cond_signal(&jobs->cond);
+		pthread_mutex_unlock(&jobs->lock);
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * Run func on each of the n args, on up to ss_nthreads() threads at once.
+ * As each job finishes, done is called on the calling thread with
+ * the job's index in args, func's result, and data.
+ */
+void
+ss_run_jobs(int n, SSJobFunc func, void **args, SSJobDone done, void *data)
+{
+	int i;
+#ifdef SS_THREADS
+	SSJobs jobs;
+	pthread_t *tid;
+	int nthreads, nstarted;
+
+	nthreads = MIN(ss_nthreads(), n);
+	if(nthreads > 1) {
+		pthread_mutex_init(&jobs.lock, NULL);
+		pthread_cond_init(&jobs.cond, NULL);
+		jobs.func = func;
+		jobs.args = args;
+		jobs.results = g_new0(void *, n);
+		jobs.n = n;
+		jobs.next = 0;
+		jobs.finished = g_new(int, n);
+		jobs.nfinished = 0;
+		tid = g_new(pthread_t, nthreads);
+		for(nstarted = 0; nstarted < nthreads; nstarted++)
+			if(pthread_create(&tid[nstarted], NULL, ss_job_thread,
+					  &jobs) != 0)
+				break;
+		if(nstarted == 0)
+			ss_job_thread(&jobs);
+
+		for(i = 0; i < n; i++) {
+			pthread_mutex_lock(&jobs.lock);
+			while(jobs.nfinished <= i)
+				pthread_cond_wait(&jobs.cond, &jobs.lock);
+			pthread_mutex_unlock(&jobs.lock);
+			(done)(jobs.finished[i], jobs.results[jobs.finished[i]],
+			       data);
+		}
+
+		while(nstarted > 0)
+			pthread_join(tid[--nstarted], NULL);
+		g_free(tid);
+		g_free(jobs.results);
+		g_free(jobs.finished);
+		pthread_cond_destroy(&jobs.cond);
+		pthread_mutex_destroy(&jobs.lock);
+		return;
+	}
+#endif
+	for(i = 0; i < n; i++)
+		(done)(i, (func)(args[i]), data);
+}
+
+/*
+ * Start a thread running func(arg).  Returns a handle to pass to
+ * ss_thread_join(), or NULL, without calling func, if there are no threads.
+ */
+SSThread *
+ss_thread_start(SSJobFunc func, void *arg)
+{
+#ifdef SS_THREADS
+	pthread_t *tid;
+
+	tid = g_new(pthread_t, 1);
+	if(pthread_create(tid, NULL, func, arg) == 0)
+		return (SSThread *)tid;
+	g_free(tid);
+#endif
+	return NULL;
+}
+
+/*
+ * wait for a thread started by ss_thread_start() to finish,
+ * and return what its function returned.
+ */
+void *
+ss_thread_join(SSThread *t)
+{
+	void *res = NULL;
+
+#ifdef SS_THREADS
+	pthread_join(*(pthread_t *)t, &res);
+	g_free(t);
+#endif
+	return res;
+}
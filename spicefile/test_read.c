@@ -33,36 +33,77 @@
 void test_interp(WvTable *wt, double mytm);
 void dump_table_info(WvTable *wt);
 void dump_wavevar(gpointer p, gpointer u);
+void dump_wavefile(WaveFile *wf, int l_flag, int v_flag);
+void read_done(WaveFile *wf, int i, gpointer data);
+WaveFile *load_watch(char *name, char *filetype, int flags);
+WaveFile *follow_watch(char *name, char *filetype, int flags, int secs);
+WaveFile *reload_watch(char *name, char *filetype, int flags, int secs);
 
 int
 main(int argc, char **argv)
 {
 	WaveFile *wf;
-	WvTable *wt;
-	int i, j;
+	WaveFile **wfs;
+	int i;
 	extern int optind;
 	extern char *optarg;
+	int a_flag = 0;
 	int v_flag = 0;
 	int x_flag = 0;
 	int l_flag = 0;
+	int f_secs = 0;
+	int r_secs = -1;
+	int flags = 0;
 	int errflg = 0;
 	char *filetype = NULL;
 	int c;
 
-	while ((c = getopt (argc, argv, "lt:vx")) != EOF) {
+	while ((c = getopt (argc, argv, "ab:cdf:j:klr:st:vxz")) != EOF) {
 		switch(c) {
+		case 'a':
+			a_flag = 1;
+			break;
 		case 'v':
 			v_flag = 1;
 			break;
 		case 'l':
 			l_flag = 1;
 			break;
+		case 'b':
+			wds_set_budget(strtoll(optarg, NULL, 10));
+			flags |= WF_PAGED;
+			break;
+		case 'c':
+			flags |= WF_PACK;
+			break;
+		case 'd':
+			flags |= WF_DOUBLE;
+			break;
+		case 'f':
+			f_secs = atoi(optarg);
+			flags |= WF_FOLLOW;
+			break;
+		case 'j':
+			spicestream_nthreads = atoi(optarg);
+			break;
+		case 'k':
+			flags |= WF_CACHE;
+			break;
+		case 'r':
+			r_secs = atoi(optarg);
+			break;
+		case 's':
+			flags |= WF_SINGLE;
+			break;
 		case 't':
 			filetype = optarg;
 			break;
 		case 'x':
 			x_flag = 1;
 			break;
+		case 'z':
+			flags |= WF_LAZY;
+			break;
 		default:
 			errflg = 1;
 			break;
@@ -70,18 +111,156 @@ main(int argc, char **argv)
 	}
 
 	if(errflg || optind >= argc)  {
-		fprintf(stderr, "usage: %s [-ltvx] file\n", argv[0]);
+		fprintf(stderr, "usage: %s [-acdklstvxz] [-b budget] [-f secs] [-j threads] [-r secs] file ...\n", argv[0]);
 		exit(1);
 	}
 	
 	spicestream_msg_level = DBG;
-	wf = wf_read(argv[optind], filetype);
+	if(argc - optind > 1) {
+		/* several files: read them all at once, then dump them in order */
+		wfs = g_new0(WaveFile *, argc - optind);
+		wf_read_many(argc - optind, &argv[optind], filetype, flags,
+			     read_done, wfs);
+		for(i = 0; i < argc - optind; i++) {
+			if(!wfs[i]) {
+				fprintf(stderr, "test_read: unable to read %s\n",
+					argv[optind + i]);
+				errflg = 1;
+				continue;
+			}
+			dump_wavefile(wfs[i], l_flag, v_flag);
+		}
+		exit(errflg);
+	}
+	if(flags & WF_FOLLOW)
+		wf = follow_watch(argv[optind], filetype, flags, f_secs);
+	else if(r_secs >= 0)
+		wf = reload_watch(argv[optind], filetype, flags, r_secs);
+	else if(a_flag)
+		wf = load_watch(argv[optind], filetype, flags);
+	else
+		wf = wf_read_opt(argv[optind], filetype, flags);
 	if(!wf) {
 		if(errno)
 			perror(argv[1]);
 		fprintf(stderr, "test_read: unable to read file\n");
 		exit(1);
 	}
+	dump_wavefile(wf, l_flag, v_flag);
+	exit(0);
+}
+
+void
+read_done(WaveFile *wf, int i, gpointer data)
+{
+	WaveFile **wfs = data;
+
+	wfs[i] = wf;
+}
+
+/*
+ * read a file in the background, reporting progress and previews
+ * on stderr as it is read.
+ */
+WaveFile *
+load_watch(char *name, char *filetype, int flags)
+{
+	WFLoad *ld;
+	WaveFile *pwf;
+	WvTable *wt;
+	double frac;
+	SSIndex n;
+	int i;
+
+	ld = wf_load_start(name, filetype, flags);
+	while(wf_load_status(ld, &frac) == WFL_LOADING) {
+		pwf = wf_load_preview(ld);
+		if(pwf) {
+			for(n = 0, i = 0; i < pwf->wf_ntables; i++) {
+				wt = wf_wtable(pwf, i);
+				n += wt->nvalues;
+			}
+			fprintf(stderr, "%5.1f%%: preview of %lld rows in %d tables\n",
+				frac * 100, n, pwf->wf_ntables);
+			wf_free(pwf);
+		}
+		g_usleep(10000);
+	}
+	return wf_load_finish(ld);
+}
+
+/*
+ * read a file, and keep reading rows as they are added to it until
+ * it hasn't grown for secs seconds, reporting them on stderr.
+ */
+WaveFile *
+follow_watch(char *name, char *filetype, int flags, int secs)
+{
+	WaveFile *wf;
+	SSIndex n;
+	int idle = 0;
+
+	wf = wf_read_opt(name, filetype, flags);
+	if(!wf)
+		return NULL;
+	while(idle < secs * 10) {
+		n = wf_follow(wf);
+		if(n < 0)
+			break;
+		if(n > 0) {
+			fprintf(stderr, "%lld new rows; %d tables\n",
+				n, wf->wf_ntables);
+			idle = 0;
+		} else {
+			idle++;
+		}
+		g_usleep(100000);
+	}
+	wf_follow_stop(wf);
+	return wf;
+}
+
+/*
+ * read a file, and reload it whenever it changes until it hasn't
+ * for secs seconds, reporting what wf_reload() did on stderr.
+ */
+WaveFile *
+reload_watch(char *name, char *filetype, int flags, int secs)
+{
+	static char *what[] = {"same", "appended", "reread", "new header"};
+	WaveFile *wf;
+	int rc;
+	int idle = 0;
+
+	wf = wf_read_opt(name, filetype, flags);
+	if(!wf)
+		return NULL;
+	while(idle < secs * 10) {
+		rc = wf_reload(wf, NULL);
+		if(rc == WFR_FAILED || rc == WFR_NEWHEADER) {
+			fprintf(stderr, "reload: %s\n",
+				rc == WFR_FAILED ? "failed" : what[rc]);
+			break;
+		}
+		if(rc != WFR_SAME) {
+			fprintf(stderr, "reload: %s; %d tables\n", what[rc],
+				wf->wf_ntables);
+			idle = 0;
+		} else {
+			idle++;
+		}
+		g_usleep(100000);
+	}
+	return wf;
+}
+
+void
+dump_wavefile(WaveFile *wf, int l_flag, int v_flag)
+{
+	WvTable *wt;
+	int i;
+	SSIndex n;
+
 	printf("filename: \"%s\" #tables=%d\n", 
 	       wf->wf_filename, wf->wf_ntables);
 
@@ -110,11 +289,11 @@ main(int argc, char **argv)
 				printf(" %10s", wt->dv[i].wv_name);
 			}
 			putchar('\n');
-			for(j = 0; j < wt->nvalues; j++) {
-				printf("[%3d] %10g", j, wds_get_point(wt->iv->wds, j));
+			for(n = 0; n < wt->nvalues; n++) {
+				printf("[%3lld] %10g", n, wds_get_point(wt->iv->wds, n));
 				for(i = 0; i < wt->wt_ndv; i++) {
 					printf(" %10g", 
-					       wds_get_point(&wt->dv[i].wds[0], j));
+					       wds_get_point(&wt->dv[i].wds[0], n));
 				}
 				putchar('\n');
 			}
@@ -136,7 +315,6 @@ main(int argc, char **argv)
 		putchar('\n');
 		test_interp(wt, mytm);
    	}
-	exit(0);
 }
 
 void dump_table_info(WvTable *wt)
@@ -147,11 +325,13 @@ void dump_table_info(WvTable *wt)
 	printf("independent variable:\n");
 	printf("  name: \"%s\"\n", wt->iv->wv_name);
 	printf("  type: %s\n", vartype_name_str(wt->iv->wv_type));
-	printf("  npts: %d\n", wt->nvalues);
+	printf("  npts: %lld\n", wt->nvalues);
 	printf("  min: %g\n", wt->iv->wds->min);
 	printf("  max: %g\n", wt->iv->wds->max);
-	printf("  blocks: %d/%d\n", wt->iv->wds->bpused, wt->iv->wds->bpsize);
+	printf("  alloc: %lld/%lld\n", wt->nvalues, wt->iv->wds->nalloc);
 	printf("  reallocs: %d\n", wt->iv->wds->nreallocs);
+	if(wt->iv->wds->dstype == WDS_PACKED)
+		printf("  packed: %lld\n", (long long) wt->iv->wds->psize);
 
 	printf("columns: %d\n", wf->wf_ncols);
 	printf("dependent variables: %d\n", wf->wf_ndv);
@@ -164,6 +344,8 @@ dump_wavevar(gpointer p, gpointer u)
 	WaveFile *wf = wv->wv_file;
 	int j;
 
+	if(wv_is_lazy(wv) && wv_load(wv) < 0)
+		return;
 	printf(" dv \"%s\" ", wv->wv_name);
 	printf(" (type=%s)", vartype_name_str(wv->wv_type));
 
@@ -173,8 +355,13 @@ dump_wavevar(gpointer p, gpointer u)
 	for(j = 0; j < wv->wv_ncols; j++) {
 		if(wv->wv_ncols > 1)
 			printf("    col[%d] ", j);
-		printf("blocks=%d/%d ",
-		       wv->wds[j].bpused, wv->wds[j].bpsize);
+		printf("alloc=%lld/%lld%s ",
+		       wv->wv_nvalues, wv->wds[j].nalloc,
+		       wv->wds[j].dstype == WDS_FLOAT ? " float" : "");
+		if(wv->wds[j].dstype == WDS_PACKED)
+			printf("packed=%lld ", (long long) wv->wds[j].psize);
+		if(wv->wds[j].dstype == WDS_SPARSE)
+			printf("changes=%lld ", wv->wds[j].nchanges);
 		printf("min=%g ",wv->wds[j].min);
 		printf("max=%g ", wv->wds[j].max);
 		printf("first=%g ", wds_get_point(&wv->wds[j], 0));
@@ -0,0 +1,627 @@
+/*
+ * wavecache.c - cache files of parsed waveform data, for fast reloading.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * When a file is read with WF_CACHE, its parsed contents are written to
+ * a "sidecar" file named .NAME.wfc in the same directory.  The next time
+ * the file is read, if its size, modification time to the nanosecond
+ * where the system records it, and a hash of its last few kilobytes (see
+ * wf_tail_hash()) still match those recorded in the cache, the cache is
+ * mapped into memory instead and the WDataSets point directly into the
+ * mapping.
+ *
+ * Cache file layout, all in the native byte order of the machine that
+ * wrote it:
+ *	WFCHeader
+ *	WFCVar[1 + ndv + nsweepparam]	ivar, dvars, sweep parameters
+ *	WFCTable[ntables]
+ *	WFCDataSet[ntables * ndsets]	iv, then each column of each dv
+ *	string table, padded to a multiple of 8 bytes
+ *	column data, each column padded to a multiple of 8 bytes
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#include <glib.h>
+#include "wavefile.h"
+
+#define WFC_MAGIC	"gwavewfc"
+#define WFC_VERSION	3
+#define WFC_BYTEORDER	0x01020304
+
+typedef struct {
+	char magic[8];
+	guint32 byteorder;
+	guint32 version;
+	gint64 srcsize;		/* size and mtime of the file cached */
+	gint64 srcmtime;
+	gint64 srcnsec;
+	guint32 tailhash;	/* wf_tail_hash() of the file cached */
+	gint32 pad;
+	gint32 filetype;
+	gint32 valsize;
+	gint32 dstype;
+	gint32 ndv;
+	gint32 ncols;
+	gint32 nsweepparam;
+	gint32 ntables;
+	gint32 ndsets;		/* datasets per table */
+	gint64 strsize;		/* size of string table */
+	gint64 size;		/* size of whole cache file */
+} WFCHeader;
+
+typedef struct {
+	gint32 name;		/* offset in string table */
+	gint32 type;
+	gint32 col;
+	gint32 ncols;
+} WFCVar;
+
+typedef struct {
+	double swval;
+	gint32 name;		/* offset in string table, or -1 */
+	gint32 pad;
+	gint64 nvalues;
+} WFCTable;
+
+typedef struct {
+	double min;
+	double max;
+	gint64 offset;		/* offset of values from start of file */
+	gint32 esize;		/* size of each value: 4 or 8 */
+	gint32 pad;
+} WFCDataSet;
+
+#define WFC_ALIGN(n)	(((n) + 7) & ~(gint64)7)
+
+/* to make temporary names unique when files are read on several threads */
+static int wfc_tmpseq;
+
+/*
+ * return the name of a sidecar file for a waveform file: .NAME.ext
+ * in the same directory.  The caller must g_free it.
+ */
+char *
+wf_sidecar_name(char *name, char *ext)
+{
+	char *dir, *base, *cname;
+
+	dir = g_path_get_dirname(name);
+	base = g_path_get_basename(name);
+	cname = g_strdup_printf("%s/.%s.%s", dir, base, ext);
+	g_free(dir);
+	g_free(base);
+	return cname;
+}
+
+/*
+ * size of the values stored in a dataset, as they will be in the cache.
+ */
+static int
+wds_cache_esize(WDataSet *ds)
+{
+	if(ds->dstype == WDS_FLOAT)
+		return sizeof(float);
+	if(ds->dstype == WDS_PACKED && ds->pmethod == WDS_PACK_XOR32)
+		return sizeof(float);
+	if(ds->dstype == WDS_PAGED)
+		return ds->pesize;
+	return sizeof(double);
+}
+
+/* fetch the i'th dataset of a table: 0 is the iv, then dv columns */
+static WDataSet *
+wt_nth_dataset(WvTable *wt, int i)
+{
+	int d;
+
+	if(i == 0)
+		return wt->iv->wds;
+	i--;
+	for(d = 0; d < wt->wt_ndv; d++) {
+		if(i < wt->dv[d].wv_ncols)
+			return &wt->dv[d].wds[i];
+		i -= wt->dv[d].wv_ncols;
+	}
+	return NULL;
+}
+
+static gint32
+wfc_add_string(GString *strs, char *s)
+{
+	gint32 off;
+
+	if(s == NULL)
+		return -1;
+	off = strs->len;
+	g_string_append_len(strs, s, strlen(s) + 1);
+	return off;
+}
+
+static void
+wfc_fill_var(WFCVar *cv, SpiceVar *sv, GString *strs)
+{
+	cv->name = wfc_add_string(strs, sv->name);
+	cv->type = sv->type;
+	cv->col = sv->col;
+	cv->ncols = sv->ncols;
+}
+
+/*
+ * write the values of a dataset to the cache file, padded to 8 bytes.
+ */
+static int
+wfc_write_dataset(FILE *fp, WDataSet *ds, SSIndex n, int esize)
+{
+	double buf[WDS_CHUNK];
+	float fbuf[WDS_CHUNK];
+	double *dp;
+	SSIndex i;
+	int j, k;
+	static char zeros[8];
+
+	for(i = 0; i < n; i += k) {
+		k = MIN(n - i, WDS_CHUNK);
+		if(esize == sizeof(float)) {
+			if(ds->dstype == WDS_FLOAT) {
+				if(fwrite(ds->fptr + i, sizeof(float), k, fp) != k)
+					return -1;
+				continue;
+			}
+			dp = wds_get_range(ds, i, k, buf);
+			for(j = 0; j < k; j++)
+				fbuf[j] = dp[j];
+			if(fwrite(fbuf, sizeof(float), k, fp) != k)
+				return -1;
+		} else {
+			dp = wds_get_range(ds, i, k, buf);
+			if(fwrite(dp, sizeof(double), k, fp) != k)
+				return -1;
+		}
+	}
+	k = WFC_ALIGN((gint64)n * esize) - (gint64)n * esize;
+	if(k && fwrite(zeros, 1, k, fp) != k)
+		return -1;
+	return 0;
+}
+
+/*
+ * Write the cache file for a WaveFile that has just been read.
+ * Failure isn't an error; we just won't have a cache next time.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+wf_cache_write(WaveFile *wf)
+{
+	SpiceStream *ss = wf->ss;
+	struct stat st;
+	WFCHeader h;
+	WFCVar *cv;
+	WFCTable *ct;
+	WFCDataSet *cd;
+	WvTable *wt;
+	WDataSet *ds;
+	GString *strs;
+	char *cname, *tname;
+	FILE *fp;
+	gint64 off;
+	int nvars, nds, i, t;
+	int rc = -1;
+
+#ifndef HAVE_MMAP
+	return -1;
+#endif
+	/* if the file has changed since it was read, what we have
+	 * isn't what it holds */
+	if(stat(ss->filename, &st) < 0 || wf->srcsize < 0
+	   || st.st_size != wf->srcsize || st.st_mtime != wf->srcmtime
+	   || wf_mtime_nsec(&st) != wf->srcnsec)
+		return -1;
+	if(wf->dstype == WDS_SPARSE) {	/* would be far bigger than they are */
+		ss_msg(DBG, "wf_cache_write", "%s: sparse datasets aren't cached",
+		       ss->filename);
+		return -1;
+	}
+	for(t = 0; t < wf->wf_ntables; t++) {	/* nothing worth caching */
+		wt = wf_wtable(wf, t);
+		if(wt->nvalues < 1)
+			return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, WFC_MAGIC, sizeof(h.magic));
+	h.byteorder = WFC_BYTEORDER;
+	h.version = WFC_VERSION;
+	h.srcsize = wf->srcsize;
+	h.srcmtime = wf->srcmtime;
+	h.srcnsec = wf->srcnsec;
+	h.tailhash = wf->tailhash;
+	h.filetype = ss->filetype;
+	h.valsize = ss->valsize;
+	h.dstype = wf->dstype;
+	h.ndv = ss->ndv;
+	h.ncols = ss->ncols;
+	h.nsweepparam = ss->nsweepparam;
+	h.ntables = wf->wf_ntables;
+	h.ndsets = 1;
+	for(i = 0; i < ss->ndv; i++)
+		h.ndsets += ss->dvar[i].ncols;
+
+	strs = g_string_new(NULL);
+	nvars = 1 + ss->ndv + ss->nsweepparam;
+	cv = g_new0(WFCVar, nvars);
+	wfc_fill_var(&cv[0], ss->ivar, strs);
+	for(i = 0; i < ss->ndv; i++)
+		wfc_fill_var(&cv[1 + i], &ss->dvar[i], strs);
+	for(i = 0; i < ss->nsweepparam; i++)
+		wfc_fill_var(&cv[1 + ss->ndv + i], &ss->spar[i], strs);
+
+	ct = g_new0(WFCTable, h.ntables);
+	for(t = 0; t < h.ntables; t++) {
+		wt = wf_wtable(wf, t);
+		ct[t].swval = wt->swval;
+		ct[t].name = wfc_add_string(strs, wt->name);
+		ct[t].nvalues = wt->nvalues;
+	}
+	h.strsize = WFC_ALIGN(strs->len);
+
+	nds = h.ntables * h.ndsets;
+	cd = g_new0(WFCDataSet, nds);
+	off = sizeof(WFCHeader) + nvars * sizeof(WFCVar)
+		+ h.ntables * sizeof(WFCTable) + nds * sizeof(WFCDataSet)
+		+ h.strsize;
+	for(t = 0; t < h.ntables; t++) {
+		wt = wf_wtable(wf, t);
+		for(i = 0; i < h.ndsets; i++) {
+			ds = wt_nth_dataset(wt, i);
+			cd[t * h.ndsets + i].min = ds->min;
+			cd[t * h.ndsets + i].max = ds->max;
+			cd[t * h.ndsets + i].offset = off;
+			cd[t * h.ndsets + i].esize = wds_cache_esize(ds);
+			off += WFC_ALIGN((gint64)wt->nvalues * wds_cache_esize(ds));
+		}
+	}
+	h.size = off;
+
+	/* write to a temporary name and rename, so that a reader never
+	 * sees a partial cache file.
+	 */
+	cname = wf_sidecar_name(ss->filename, "wfc");
+	ss_lock();
+	tname = g_strdup_printf("%s.%d.%d", cname, (int)getpid(), ++wfc_tmpseq);
+	ss_unlock();
+	fp = fopen64(tname, "w");
+	if(fp == NULL) {
+		ss_msg(DBG, "wf_cache_write", "%s: %s", tname, strerror(errno));
+		goto out;
+	}
+	while(strs->len < h.strsize)
+		g_string_append_c(strs, '\0');
+	if(fwrite(&h, sizeof(h), 1, fp) != 1
+	   || fwrite(cv, sizeof(WFCVar), nvars, fp) != nvars
+	   || fwrite(ct, sizeof(WFCTable), h.ntables, fp) != h.ntables
+	   || fwrite(cd, sizeof(WFCDataSet), nds, fp) != nds
+	   || fwrite(strs->str, 1, h.strsize, fp) != h.strsize)
+		goto fail;
+	for(t = 0; t < h.ntables; t++) {
+		wt = wf_wtable(wf, t);
+		for(i = 0; i < h.ndsets; i++) {
+			if(wfc_write_dataset(fp, wt_nth_dataset(wt, i),
+					     wt->nvalues,
+					     cd[t * h.ndsets + i].esize) < 0)
+				goto fail;
+		}
+	}
+	if(fclose(fp) != 0) {
+		fp = NULL;
+		goto fail;
+	}
+	fp = NULL;
+	if(rename(tname, cname) < 0)
+		goto fail;
+	ss_msg(DBG, "wf_cache_write", "%s: wrote cache %s", ss->filename, cname);
+	rc = 0;
+	goto out;
+
+ fail:
+	ss_msg(DBG, "wf_cache_write", "%s: %s", tname, strerror(errno));
+	if(fp)
+		fclose(fp);
+	unlink(tname);
+ out:
+	g_free(cname);
+	g_free(tname);
+	g_free(cv);
+	g_free(ct);
+	g_free(cd);
+	g_string_free(strs, 1);
+	return rc;
+}
+
+#ifdef HAVE_MMAP
+/*
+ * check that the counts in a cache file's header agree with each other,
+ * and that everything they describe lies within the file, so that
+ * a corrupt cache is never read outside its mapping.
+ */
+static int
+wfc_check_layout(WFCHeader *h, size_t size)
+{
+	char *map = (char *)h;
+	WFCVar *cv;
+	WFCTable *ct;
+	WFCDataSet *cd;
+	char *strs;
+	gint64 left, nvars, nds, k, end;
+	int i, t;
+
+	if(h->ndv < 0 || h->nsweepparam < 0 || h->ntables < 0
+	   || h->ndsets < 1 || h->strsize < 0)
+		return 0;
+	left = size - sizeof(WFCHeader);
+	nvars = 1 + (gint64)h->ndv + h->nsweepparam;
+	if(nvars > left / sizeof(WFCVar))
+		return 0;
+	left -= nvars * sizeof(WFCVar);
+	if(h->ntables > left / sizeof(WFCTable))
+		return 0;
+	left -= h->ntables * sizeof(WFCTable);
+	if(h->ntables > 0
+	   && h->ndsets > left / sizeof(WFCDataSet) / h->ntables)
+		return 0;
+	nds = (gint64)h->ntables * h->ndsets;
+	left -= nds * sizeof(WFCDataSet);
+	if(h->strsize > left)
+		return 0;
+
+	cv = (WFCVar *)(map + sizeof(WFCHeader));
+	ct = (WFCTable *)(cv + nvars);
+	cd = (WFCDataSet *)(ct + h->ntables);
+	strs = (char *)(cd + nds);
+	if(h->strsize > 0 && strs[h->strsize - 1] != '\0')
+		return 0;
+
+	/* one dataset for the independent variable, and one for each
+	 * column of each dependent variable */
+	k = 1;
+	for(i = 0; i < h->ndv; i++) {
+		if(cv[1 + i].ncols < 0)
+			return 0;
+		k += cv[1 + i].ncols;
+	}
+	if(k != h->ndsets)
+		return 0;
+
+	for(t = 0; t < h->ntables; t++) {
+		if(ct[t].nvalues < 0)
+			return 0;
+		for(k = t * h->ndsets; k < (t + 1) * h->ndsets; k++) {
+			if((cd[k].esize != sizeof(float)
+			    && cd[k].esize != sizeof(double))
+			   || cd[k].offset < 0 || cd[k].offset > size
+			   || cd[k].offset % cd[k].esize != 0)
+				return 0;
+			end = size - cd[k].offset;
+			if(ct[t].nvalues > end / cd[k].esize)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * check that a cache file's header is sane, matches the file it caches,
+ * open on fd, and that the data in it is stored the way the flags ask for.
+ * Anything that fails is treated as a stale cache.
+ */
+static int
+wfc_check_header(WFCHeader *h, size_t size, int fd, struct stat *st,
+		 char *format, int flags)
+{
+	if(size < sizeof(WFCHeader)
+	   || memcmp(h->magic, WFC_MAGIC, sizeof(h->magic)) != 0
+	   || h->byteorder != WFC_BYTEORDER
+	   || h->version != WFC_VERSION
+	   || h->size != size)
+		return 0;
+	if(h->srcsize != st->st_size || h->srcmtime != st->st_mtime
+	   || h->srcnsec != wf_mtime_nsec(st))
+		return 0;
+	if(format && strcmp(format, ss_filetype_name(h->filetype)) != 0)
+		return 0;
+	if(h->dstype != wf_choose_dstype(flags, h->valsize))
+		return 0;
+	if(h->tailhash != wf_tail_hash(fd, st->st_size))
+		return 0;
+	return wfc_check_layout(h, size);
+}
+
+static char *
+wfc_string(char *strs, WFCHeader *h, gint32 off)
+{
+	if(off < 0 || off >= h->strsize)
+		return NULL;
+	return g_strdup(strs + off);
+}
+
+static void
+wfc_get_var(SpiceVar *sv, WFCVar *cv, char *strs, WFCHeader *h)
+{
+	sv->name = wfc_string(strs, h, cv->name);
+	sv->type = cv->type;
+	sv->col = cv->col;
+	sv->ncols = cv->ncols;
+}
+
+/*
+ * point a dataset at its values in the mapped cache file.
+ */
+static void
+wfc_map_dataset(WDataSet *ds, WFCDataSet *cd, char *map, SSIndex nvalues)
+{
+	ds->min = cd->min;
+	ds->max = cd->max;
+	if(cd->esize == sizeof(float)) {
+		ds->dstype = WDS_FLOAT;
+		ds->fptr = (float *)(map + cd->offset);
+	} else {
+		ds->dstype = WDS_DOUBLE;
+		ds->dptr = (double *)(map + cd->offset);
+	}
+	ds->nalloc = nvalues;
+	ds->mapped = 1;
+}
+#endif
+
+/*
+ * Try to read a waveform file from its cache file.
+ * Returns NULL if there is no cache, or it is stale or unusable.
+ */
+WaveFile *
+wf_cache_read(char *name, char *format, int flags)
+{
+#ifdef HAVE_MMAP
+	struct stat st, cst;
+	WFCHeader *h;
+	WFCVar *cv;
+	WFCTable *ct;
+	WFCDataSet *cd;
+	WaveFile *wf;
+	WvTable *wt;
+	SpiceStream *ss;
+	char *cname, *map, *strs;
+	int sfd, fd, nvars, i, j, k, t;
+
+	sfd = open(name, O_RDONLY);
+	if(sfd < 0)
+		return NULL;
+	if(fstat(sfd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(sfd);
+		return NULL;
+	}
+	cname = wf_sidecar_name(name, "wfc");
+	fd = open(cname, O_RDONLY);
+	g_free(cname);
+	if(fd < 0) {
+		close(sfd);
+		return NULL;
+	}
+	if(fstat(fd, &cst) < 0 || cst.st_size < sizeof(WFCHeader)) {
+		close(fd);
+		close(sfd);
+		return NULL;
+	}
+	map = mmap(NULL, cst.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		close(sfd);
+		return NULL;
+	}
+
+	h = (WFCHeader *)map;
+	if(!wfc_check_header(h, cst.st_size, sfd, &st, format, flags)) {
+		ss_msg(DBG, "wf_cache_read", "%s: cache is stale", name);
+		munmap(map, cst.st_size);
+		close(sfd);
+		return NULL;
+	}
+	nvars = 1 + h->ndv + h->nsweepparam;
+	cv = (WFCVar *)(map + sizeof(WFCHeader));
+	ct = (WFCTable *)(cv + nvars);
+	cd = (WFCDataSet *)(ct + h->ntables);
+	strs = (char *)(cd + h->ntables * h->ndsets);
+
+	ss = ss_new(NULL, name, h->ndv, h->nsweepparam);
+	ss->filetype = h->filetype;
+	ss->valsize = h->valsize;
+	ss->ncols = h->ncols;
+	ss->ntables = h->ntables;
+	wfc_get_var(ss->ivar, &cv[0], strs, h);
+	for(i = 0; i < h->ndv; i++)
+		wfc_get_var(&ss->dvar[i], &cv[1 + i], strs, h);
+	for(i = 0; i < h->nsweepparam; i++)
+		wfc_get_var(&ss->spar[i], &cv[1 + h->ndv + i], strs, h);
+
+	wf = g_new0(WaveFile, 1);
+	wf->ss = ss;
+	wf->tables = g_ptr_array_new();
+	wf->flags = flags;
+	wf->dstype = h->dstype;
+	wf->map = map;
+	wf->mapsize = cst.st_size;
+	wf_stamp(wf, sfd);
+	close(sfd);
+
+	for(t = 0; t < h->ntables; t++) {
+		wt = g_new0(WvTable, 1);
+		wt->wf = wf;
+		wt->swindex = t;
+		wt->name = wfc_string(strs, h, ct[t].name);
+		wt->swval = ct[t].swval;
+		wt->nvalues = ct[t].nvalues;
+		wt->iv = g_new0(WaveVar, 1);
+		wt->iv->sv = ss->ivar;
+		wt->iv->wtable = wt;
+		wt->iv->wds = g_new0(WDataSet, 1);
+		k = t * h->ndsets;
+		wfc_map_dataset(wt->iv->wds, &cd[k++], map, wt->nvalues);
+		wt->dv = g_new0(WaveVar, ss->ndv);
+		for(i = 0; i < ss->ndv; i++) {
+			wt->dv[i].wtable = wt;
+			wt->dv[i].sv = &ss->dvar[i];
+			wt->dv[i].wds = g_new0(WDataSet, ss->dvar[i].ncols);
+			for(j = 0; j < ss->dvar[i].ncols; j++)
+				wfc_map_dataset(&wt->dv[i].wds[j], &cd[k++],
+						map, wt->nvalues);
+		}
+		if(flags & WF_PACK)
+			wt_pack(wt);
+		g_ptr_array_add(wf->tables, wt);
+	}
+	ss_msg(INFO, "wf_read", "%s: read from cache", name);
+	return wf;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * release the mapping of a WaveFile's cache file.
+ */
+void
+wf_cache_unmap(WaveFile *wf)
+{
+#ifdef HAVE_MMAP
+	if(wf->map)
+		munmap(wf->map, wf->mapsize);
+#endif
+	wf->map = NULL;
+}
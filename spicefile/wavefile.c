@@ -23,10 +23,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <glib.h>
 #include "wavefile.h"
+#include "spice2.h"
 
 
 #ifdef HAVE_POSIX_REGEXP
@@ -58,20 +64,59 @@ regexp_compile(char *str)
 #define regexp_compile(s) regcomp(s)
 #endif
 
-WaveFile *wf_finish_read(SpiceStream *ss);
-WvTable *wf_read_table(SpiceStream *ss, WaveFile *wf, int *statep, double *ivalp, double *dvals);
-void wf_init_dataset(WDataSet *ds);
-inline void wf_set_point(WDataSet *ds, int n, double val);
+static WaveFile *wf_read_file(char *name, char *format, int flags,
+			      WFLoad *ld);
+static SpiceStream *wf_open_file(char *name, char *format, int *cancel);
+static int wf_format_match(int i, char *name);
+WaveFile *wf_finish_read(SpiceStream *ss, int flags, char *dvload, WFLoad *ld);
+/* rows read from a SpiceStream but not yet stored in a table,
+ * and how to store them */
+typedef struct {
+	double *iv;	/* independent variable's values */
+	double *dv;	/* dependent values, ncols to a row */
+	int n;		/* number of rows */
+	int pos;	/* next row to store */
+	double start;	/* only rows whose independent variable is */
+	double end;	/* in this range are stored */
+	int stop;	/* stop reading a table at the first row after end */
+	int mark;	/* note seek points in the WaveFile */
+	int resume;	/* the next table to read has been started: */
+	SSIndex row;	/* the stream is at this row of it, */
+	double swval;	/* and this is its sweep value */
+} WFRowBatch;
+
+static void wf_rows_init(WFRowBatch *rb, SpiceStream *ss);
+static int wf_want_seek(WaveFile *wf, SpiceStream *ss);
+static WaveFile *wf_new(SpiceStream *ss, int flags, char *dvload);
+static void wf_add_table(WaveFile *wf, WvTable *wt);
+static int wf_read_tables(SpiceStream *ss, WaveFile *wf, WFRowBatch *rb,
+			  SSIndex nest);
+
+WvTable *wf_read_table(SpiceStream *ss, WaveFile *wf, int *statep, WFRowBatch *rb,
+		       SSIndex nest, WvTable *reuse, SSIndex keep);
+static void wt_clear(WvTable *wt);
+void wf_init_dataset(WDataSet *ds, int dstype, SSIndex nest);
+inline void wf_set_point(WDataSet *ds, SSIndex n, double val);
+void wf_trim_dataset(WDataSet *ds, SSIndex n);
 void wf_free_dataset(WDataSet *ds);
-WvTable *wvtable_new(WaveFile *wf);
+void wt_trim(WvTable *wt);
+WvTable *wvtable_new(WaveFile *wf, SSIndex nest);
 void wt_free(WvTable *wt);
 
 typedef struct {
 	char *name;
 	char *fnrexp;
 	REGEXP_T *creg;/* compiled form of regexp */
+	int (*sniff)(char *buf, int n);	/* see wf_sniff() */
 } DFormat;
 
+static int sniff_hspice(char *buf, int n);
+static int sniff_cazm(char *buf, int n);
+static int sniff_s3raw(char *buf, int n);
+static int sniff_s2raw(char *buf, int n);
+static int sniff_nsout(char *buf, int n);
+static int sniff_ascii(char *buf, int n);
+
 /* table associating file typenames with filename regexps.
  * Typenames should be those supported by spicefile.c.
  *
@@ -79,20 +124,233 @@ typedef struct {
  * regular expressions, NOT shell-style globs.
  */
 static DFormat format_tab[] = {
-	{"hspice", "\\.(tr|sw|ac)[0-9]$" },
-	{"cazm", "\\.[BNW]$" },
-	{"spice3raw", "\\.raw$" },
-	{"spice2raw", "\\.rawspice$" },
-	{"nsout", "\\.out$" },
-	{"ascii", "\\.(asc|acs|ascii)$" }, /* ascii / ACS format */
+	{"hspice", "\\.(tr|sw|ac)[0-9]$", NULL, sniff_hspice },
+	{"cazm", "\\.[BNW]$", NULL, sniff_cazm },
+	{"spice3raw", "\\.raw$", NULL, sniff_s3raw },
+	{"spice2raw", "\\.rawspice$", NULL, sniff_s2raw },
+	{"nsout", "\\.out$", NULL, sniff_nsout },
+	{"ascii", "\\.(asc|acs|ascii)$", NULL, sniff_ascii }, /* ascii / ACS format */
 };
 static const int NFormats = sizeof(format_tab)/sizeof(DFormat);
 
+/*
+ * a copy of a file's name, without any suffix that compressing it added,
+ * to match against the regexps.
+ */
+static char *
+wf_match_name(char *name)
+{
+	static char *suffixes[] = { ".gz", ".zst", ".xz" };
+	char *mname;
+	int i, n, k;
+
+	mname = g_strdup(name);
+	n = strlen(mname);
+	for(i = 0; i < sizeof(suffixes)/sizeof(char *); i++) {
+		k = strlen(suffixes[i]);
+		if(n > k && strcmp(mname + n - k, suffixes[i]) == 0) {
+			mname[n - k] = '\0';
+			break;
+		}
+	}
+	return mname;
+}
+
+/*
+ * does the filename match the regexp for format_tab[i]?
+ * Files may be read on several threads at once, so the regexps are
+ * compiled, and with Henry Spencer's regexec(), used, under the lock.
+ */
+static int
+wf_format_match(int i, char *name)
+{
+	int rc;
+
+	name = wf_match_name(name);
+	ss_lock();
+	if(!format_tab[i].creg)
+		format_tab[i].creg = regexp_compile(format_tab[i].fnrexp);
+#ifdef HAVE_POSIX_REGEXP
+	ss_unlock();
+	rc = regexp_test(format_tab[i].creg, name);
+#else
+	rc = regexp_test(format_tab[i].creg, name);
+	ss_unlock();
+#endif
+	g_free(name);
+	return rc;
+}
+
+/*
+ * Content sniffing.  Each sniff_*() function looks at the first
+ * WF_SNIFFSIZE bytes of a file, NUL-terminated after the n bytes read,
+ * and returns how sure it is that they begin a file in its format:
+ * 0 if they can't, up to 100 for a file that carries a magic number.
+ */
+#define WF_SNIFFSIZE 8192
+
+/* return the start of the line after the one at lp, or NULL */
+static char *
+sniff_next_line(char *lp)
+{
+	lp = strchr(lp, '\n');
+	return lp ? lp + 1 : NULL;
+}
+
+/* hspice ascii, or binary with the same header in its first block */
+static int
+sniff_hspice(char *buf, int n)
+{
+	gint32 hh[4];
+	int i;
+
+	if(n >= sizeof(hh) && (buf[0] & 0xff) < ' ') {
+		memcpy(hh, buf, sizeof(hh));
+		if(!(hh[0] == 4 && hh[2] == 4)
+		   && !(hh[0] == 0x04000000 && hh[2] == 0x04000000))
+			return 0;
+		buf += sizeof(hh);
+		n -= sizeof(hh);
+	}
+	if(n < 20)
+		return 0;
+	for(i = 0; i < 16; i++)
+		if(!isdigit(buf[i] & 0xff))
+			return 0;
+	if(strncmp(&buf[16], "9007", 4) == 0
+	   || strncmp(&buf[16], "9601", 4) == 0)
+		return 100;
+	return 0;
+}
+
+static int
+sniff_cazm(char *buf, int n)
+{
+	char *lp;
+	int lineno;
+
+	for(lp = buf, lineno = 0; lp && lineno < 30;
+	    lp = sniff_next_line(lp), lineno++) {
+		if(strncmp(lp, "TRANSIENT", 9) == 0
+		   || strncmp(lp, "AC ANALYSIS", 11) == 0
+		   || strncmp(lp, "TRANSFER", 8) == 0) {
+			if(strncmp(buf, "* CAZM", 6) == 0)
+				return 100;
+			return 70;
+		}
+	}
+	return 0;
+}
+
+static int
+sniff_s3raw(char *buf, int n)
+{
+	if(strncmp(buf, "Title: ", 7) != 0)
+		return 0;
+	if(strstr(buf, "\nPlotname:") || strstr(buf, "\nNo. Variables:"))
+		return 100;
+	return 60;
+}
+
+static int
+sniff_s2raw(char *buf, int n)
+{
+	if(n >= 8 && memcmp(buf, SPICE_MAGIC, 8) == 0)
+		return 100;
+	return 0;
+}
+
+static int
+sniff_nsout(char *buf, int n)
+{
+	if(strncmp(buf, ";! output_format", 16) == 0)
+		return 100;
+	return 0;
+}
+
+/*
+ * ascii: a line of variable names, then lines of numbers.
+ * Having no magic number, it never scores higher than 70,
+ * and that only when the first name is "time".
+ */
+static int
+sniff_ascii(char *buf, int n)
+{
+	char *cp, *lp, *end;
+	int nnum = 0;
+
+	lp = sniff_next_line(buf);
+	if(!lp)
+		return 0;
+	for(cp = buf; cp < lp - 1; cp++)
+		if(!isgraph(*cp & 0xff) && *cp != ' ' && *cp != '\t'
+		   && *cp != '\r')
+			return 0;
+	for(cp = lp; *cp && *cp != '\n'; ) {
+		if(isspace(*cp & 0xff)) {
+			cp++;
+			continue;
+		}
+		strtod(cp, &end);
+		if(end == cp || (*end && !isspace(*end & 0xff)))
+			return 0;
+		nnum++;
+		cp = end;
+	}
+	if(nnum == 0)
+		return 0;
+	for(cp = buf; *cp == '#' || *cp == ' ' || *cp == '\t'; cp++)
+		;
+	if(g_ascii_strncasecmp(cp, "time", 4) == 0 && isspace(cp[4] & 0xff))
+		return 70;
+	return 50;
+}
+
+/*
+ * Score every format against the start of the file, and put the indices
+ * of those that might read it in order[], best first.
+ * Returns how many there are.  Leaves fp at the start of the file.
+ */
+static int
+wf_sniff(FILE *fp, char *name, int *order)
+{
+	char *buf;
+	int score[sizeof(format_tab)/sizeof(DFormat)];
+	int n, i, j, k, nc;
+
+	buf = g_malloc(WF_SNIFFSIZE + 1);
+	n = fread(buf, 1, WF_SNIFFSIZE, fp);
+	buf[n] = '\0';
+	if(fseek(fp, 0L, SEEK_SET) < 0) {
+		perror(name);
+		g_free(buf);
+		return 0;
+	}
+
+	nc = 0;
+	for(i = 0; i < NFormats; i++) {
+		score[i] = format_tab[i].sniff(buf, n);
+		if(score[i] == 0)
+			continue;
+		for(j = nc; j > 0 && score[order[j-1]] < score[i]; j--)
+			order[j] = order[j-1];
+		order[j] = i;
+		nc++;
+	}
+	g_free(buf);
+
+	for(k = 0; k < nc; k++)
+		ss_msg(DBG, "wf_sniff", "%s: format \"%s\" scores %d",
+		       name, format_tab[order[k]].name, score[order[k]]);
+	return nc;
+}
+
 /*
  * Read a waveform data file.
  *  If the format name is non-NULL, only tries reading in specified format.
  *  If format not specified, tries to guess based on filename, and if
- *  that fails, tries all of the readers until one sucedes.
+ *  that fails, looks at the start of the file and tries the reader
+ *  for the format that it most resembles.
  *  Returns NULL on failure after printing an error message.
  * 
  * TODO: use some kind of callback or exception so that client
@@ -100,31 +358,281 @@ static const int NFormats = sizeof(format_tab)/sizeof(DFormat);
  */
 WaveFile *wf_read(char *name, char *format)
 {
-	FILE *fp;
+	return wf_read_opt(name, format, 0);
+}
+
+/*
+ * Read a waveform data file, as for wf_read(), with flags
+ * that control how the data is read and stored:
+ *	WF_SINGLE - store dependent variables in single precision
+ *	WF_DOUBLE - store dependent variables in double precision,
+ *		even if the file contains single-precision data.
+ *	WF_PACK - compress the data in memory.
+ *	WF_CACHE - use the file's cache, if it is up to date, instead of
+ *		parsing the file.  Otherwise parse it and write the cache.
+ *	WF_PAGED - keep the data in pages, which are written out to a
+ *		temporary file when they exceed the budget set with
+ *		wds_set_budget().
+ *	WF_LAZY - read only the independent variables.  The data for each
+ *		dependent variable is read when wv_load() is called for it.
+ *		For binary formats with rows of a fixed size, the file is
+ *		kept open, and only the values of those variables are read
+ *		then; see ss_readcol().  No cache is written for a file
+ *		read lazily.
+ *	WF_FOLLOW - read the file as it is now, and leave it open so that
+ *		rows added to it later can be read with wf_follow().
+ *		Not used with WF_CACHE, WF_PACK or WF_LAZY.
+ *	WF_INDEX - note a seek point every WF_SEEKSTRIDE rows or so, and
+ *		write them to the file's seek index for wf_read_range().
+ *	WF_SPARSE - store dependent variables as lists of the rows at which
+ *		their values change.  Always used for formats that record
+ *		only changes, such as nanosim's.
+ * With neither WF_SINGLE nor WF_DOUBLE,
+ * single precision is used if the file is single.
+ * A file compressed with gzip, zstd or xz is decompressed as it is read,
+ * into a temporary file in $TMPDIR (g_get_tmp_dir()), which needs room
+ * for all of it; see ss_fopen().  A background load can be cancelled
+ * while this is going on.  Its cache and index are kept as for any other
+ * file, so with WF_CACHE it is only decompressed and parsed the first
+ * time.  It can't be followed.
+ */
+WaveFile *wf_read_opt(char *name, char *format, int flags)
+{
+	return wf_read_load(name, format, flags, NULL);
+}
+
+/*
+ * Read a waveform data file, as for wf_read_opt(), telling ld, if it
+ * isn't NULL, how far the read has got.  See waveload.c.
+ */
+WaveFile *
+wf_read_load(char *name, char *format, int flags, WFLoad *ld)
+{
+	WaveFile *wf;
+
+	if(flags & WF_FOLLOW)
+		flags &= ~(WF_CACHE|WF_PACK|WF_LAZY);
+	if(flags & WF_CACHE) {
+		wf = wf_cache_read(name, format, flags);
+		if(wf)
+			return wf;
+	}
+	wf = wf_read_file(name, format, flags, ld);
+	if(wf && (flags & WF_CACHE) && !(flags & WF_LAZY))
+		wf_cache_write(wf);
+	return wf;
+}
+
+/*
+ * Read only the dependent variables named in varlist, a NULL-terminated
+ * array of names, from a waveform data file, as for wf_read_opt().
+ * The others are left unloaded, as if the file had been read with
+ * WF_LAZY, until wv_load() is called for them: they get no storage,
+ * and readers that can skip over their values don't decode them.
+ * Names that aren't in the file are ignored.
+ */
+WaveFile *
+wf_read_select(char *name, char *format, int flags, char **varlist)
+{
 	SpiceStream *ss;
+	WaveFile *wf;
+	char *want;
+	int i, j, n;
+
+	flags &= ~(WF_FOLLOW|WF_LAZY);
+	if(flags & WF_CACHE) {	/* only the pages used are read */
+		wf = wf_cache_read(name, format, flags);
+		if(wf)
+			return wf;
+	}
+	ss = wf_open_file(name, format, NULL);
+	if(ss == NULL)
+		return NULL;
+	want = g_new0(char, MAX(ss->ndv, 1));
+	for(i = n = 0; i < ss->ndv; i++) {
+		for(j = 0; varlist[j]; j++)
+			if(strcmp(ss->dvar[i].name, varlist[j]) == 0)
+				break;
+		if(varlist[j]) {
+			want[i] = 1;
+			n++;
+		}
+	}
+	ss_msg(DBG, "wf_read_select", "%s: reading %d of %d variables",
+	       name, n, ss->ndv);
+	wf = wf_finish_read(ss, flags | WF_LAZY, want, NULL);
+	g_free(want);
+	return wf;
+}
+
+/*
+ * Read one of the plots, or sets of results, in a waveform data file
+ * that can hold several, such as the operating point, AC and transient
+ * plots of an ngspice rawfile, as for wf_read_opt().  Plot 0 is the one
+ * the other readers read; see wf_plot_names() for the others.  Only the
+ * first plot of a file is cached or indexed, so WF_CACHE and WF_INDEX
+ * are ignored for the others, as is WF_FOLLOW.
+ */
+WaveFile *
+wf_read_plot(char *name, char *format, int flags, int plot)
+{
+	return wf_read_plot_load(name, format, flags, plot, NULL);
+}
+
+/*
+ * Read a plot, as for wf_read_plot(), telling ld, if it isn't NULL,
+ * how far the read has got.
+ */
+WaveFile *
+wf_read_plot_load(char *name, char *format, int flags, int plot, WFLoad *ld)
+{
+	SpiceStream *ss, *pss;
+
+	if(plot == 0)
+		return wf_read_load(name, format, flags, ld);
+	ss = wf_open_file(name, format, ld ? wfl_cancel_flag(ld) : NULL);
+	if(ss == NULL)
+		return NULL;
+	pss = ss_open_plot(ss, plot);
+	ss_delete(ss);
+	if(pss == NULL)
+		return NULL;
+	flags &= ~(WF_CACHE|WF_INDEX|WF_FOLLOW);
+	return wf_finish_read(pss, flags, NULL, ld);
+}
+
+/*
+ * The names of the plots in a waveform data file, for wf_read_plot(),
+ * as a NULL-terminated array to be freed with g_strfreev(), or NULL if
+ * the file can't be read.  A file with only one set of results has just
+ * the one, whose name may be "".
+ */
+char **
+wf_plot_names(char *name, char *format)
+{
+	SpiceStream *ss;
+	char **names;
+	int i, n;
+
+	ss = wf_open_file(name, format, NULL);
+	if(ss == NULL)
+		return NULL;
+	n = ss_plots(ss);
+	names = g_new0(char *, n + 1);
+	for(i = 0; i < n; i++) {
+		if(ss->plots && ss->plots[i].name)
+			names[i] = g_strdup(ss->plots[i].name);
+		else
+			names[i] = g_strdup("");
+	}
+	ss_delete(ss);
+	return names;
+}
+
+typedef struct {
+	char *name;
+	char *format;
+	int flags;
+} WFReadJob;
+
+typedef struct {
+	WFReadDone done;
+	gpointer data;
+} WFReadDoneArgs;
+
+static void *
+wf_read_job(void *arg)
+{
+	WFReadJob *job = arg;
+
+	return wf_read_opt(job->name, job->format, job->flags);
+}
+
+static void
+wf_read_job_done(int i, void *wf, void *arg)
+{
+	WFReadDoneArgs *da = arg;
+
+	(da->done)(wf, i, da->data);
+}
+
+/*
+ * Read n waveform data files, as for wf_read_opt(), several at a time
+ * on up to spicestream_nthreads threads.
+ * As each file is read, done is called on the calling thread with
+ * the WaveFile, or NULL if it couldn't be read, the file's index
+ * in names, and data.  The files may finish in any order.
+ */
+void
+wf_read_many(int n, char **names, char *format, int flags,
+	     WFReadDone done, gpointer data)
+{
+	WFReadJob *jobs;
+	void **args;
+	WFReadDoneArgs da;
 	int i;
 
+	jobs = g_new(WFReadJob, n);
+	args = g_new(void *, n);
+	for(i = 0; i < n; i++) {
+		jobs[i].name = names[i];
+		jobs[i].format = format;
+		jobs[i].flags = flags;
+		args[i] = &jobs[i];
+	}
+	da.done = done;
+	da.data = data;
+	ss_run_jobs(n, wf_read_job, args, wf_read_job_done, &da);
+	g_free(args);
+	g_free(jobs);
+}
+
+/*
+ * Parse a waveform data file.
+ */
+static WaveFile *
+wf_read_file(char *name, char *format, int flags, WFLoad *ld)
+{
+	SpiceStream *ss;
+
+	ss = wf_open_file(name, format, ld ? wfl_cancel_flag(ld) : NULL);
+	if(ss == NULL)
+		return NULL;
+	return wf_finish_read(ss, flags, NULL, ld);
+}
+
+/*
+ * Open a waveform data file and read its header, in the given format,
+ * or, if format is NULL, in the one that the file's name or contents
+ * suggest.
+ */
+static SpiceStream *
+wf_open_file(char *name, char *format, int *cancel)
+{
+	FILE *fp;
+	SpiceStream *ss;
+	int i, k, nc;
+	int order[sizeof(format_tab)/sizeof(DFormat)];
+
 	unsigned int tried = 0; /* bitmask of formats. */
 
 	g_assert(NFormats <= 8*sizeof(tried));
-	fp = fopen64(name, "r");
+	fp = ss_fopen_cancel(name, cancel);
 	if(fp == NULL) {
-		perror(name);
+		if(errno != ECANCELED)
+			perror(name);
 		return NULL;
 	}
 
 	if(format == NULL) {
 		for(i = 0; i < NFormats; i++) {
-			if(!format_tab[i].creg) {
-				format_tab[i].creg = regexp_compile(format_tab[i].fnrexp);
-			}
-			if(regexp_test(format_tab[i].creg, name))
+			if(wf_format_match(i, name))
 			{
 				tried |= 1<<i;
 				ss = ss_open_internal(fp, name, format_tab[i].name);
 				if(ss) {
 					ss_msg(INFO, "wf_read", "%s: read with format \"%s\"", name, format_tab[i].name);
-					return wf_finish_read(ss);
+					return ss;
 				}
 
 				if(fseek(fp, 0L, SEEK_SET) < 0) {
@@ -136,178 +644,775 @@ WaveFile *wf_read(char *name, char *format)
 		}
 		if(tried == 0)
 			ss_msg(INFO, "wf_read", "%s: couldn't guess a format from filename suffix.", name);
-		/* no success with formats whose regexp matched filename,
-		* try the others.
-		*/
-		for(i = 0; i < NFormats; i++) {
-			if((tried & (1<<i)) == 0) {
-				ss = ss_open_internal(fp, name, format_tab[i].name);
-				if(ss)
-					return wf_finish_read(ss);
-				tried |= 1<<i;
-				if(fseek(fp, 0L, SEEK_SET) < 0) {
-					perror(name);
-					return NULL;
-				}
-			}
+		/* no success with formats whose regexp matched filename;
+		 * look at the file's contents and try the best candidate
+		 * that we haven't tried already.
+		 */
+		nc = wf_sniff(fp, name, order);
+		for(k = 0; k < nc; k++) {
+			i = order[k];
+			if((tried & (1<<i)) == 0)
+				break;
+		}
+		if(k == nc) {
+			ss_msg(ERR, "wf_read", "%s: couldn't recognize the file's format\n", name);
+			return NULL;
 		}
-		ss_msg(ERR, "wf_read", "%s: couldn't read with any format\n", name);
+		ss_msg(INFO, "wf_read", "%s: contents look like format \"%s\"", name, format_tab[i].name);
+		ss = ss_open_internal(fp, name, format_tab[i].name);
+		if(ss)
+			return ss;
+		ss_msg(ERR, "wf_read", "%s: couldn't read with format \"%s\"\n", name, format_tab[i].name);
 		return NULL;
 	} else { /* use specified format only */
-		ss = ss_open_internal(fp, name, format);
-		if(ss)
-			return wf_finish_read(ss);
-		else
-			return NULL;
+		return ss_open_internal(fp, name, format);
 	}
 }
 
-/* 
- * read all of the data from a SpiceStream and store it in the WaveFile
- * structure.
+/*
+ * return the storage type to use for dependent variables, according
+ * to the WF_* flags and the size of the values in the file.
  */
-WaveFile *wf_finish_read(SpiceStream *ss)
+int
+wf_choose_dstype(int flags, int valsize)
+{
+	if(flags & WF_DOUBLE)
+		return WDS_DOUBLE;
+	else if((flags & WF_SINGLE) || valsize == sizeof(float))
+		return WDS_FLOAT;
+	else
+		return WDS_DOUBLE;
+}
+
+/*
+ * a new WaveFile, with no tables yet, for the data of a SpiceStream
+ * whose header has been read.
+ */
+static WaveFile *
+wf_new(SpiceStream *ss, int flags, char *dvload)
 {
 	WaveFile *wf;
-	int rc;
-	double ival;
-	double *dvals;
-	WvTable *wt;
-	int state;
-	double *spar = NULL;
 
 	wf = g_new0(WaveFile, 1);
 	wf->ss = ss;
 	wf->tables = g_ptr_array_new();
-	dvals = g_new(double, ss->ncols);
+	wf->flags = flags;
+	wf->dstype = wf_choose_dstype(flags, ss->valsize);
+	if((flags & WF_SPARSE) || ss->events)
+		wf->dstype = WDS_SPARSE;
+	if(dvload)
+		wf->dvload = g_memdup(dvload, MAX(ss->ndv, 1));
+	else if(flags & WF_LAZY)
+		wf->dvload = g_new0(char, MAX(ss->ndv, 1));
+	ss_select_vars(ss, wf->dvload);
+	wf_stamp(wf, fileno(ss->fp));
+	return wf;
+}
+
+/*
+ * set up an empty batch of rows, to store all of the rows read
+ */
+static void
+wf_rows_init(WFRowBatch *rb, SpiceStream *ss)
+{
+	rb->iv = g_new(double, WDS_CHUNK);
+	rb->dv = g_new(double, WDS_CHUNK * ss->ncols);
+	rb->n = rb->pos = 0;
+	rb->start = -G_MAXDOUBLE;
+	rb->end = G_MAXDOUBLE;
+	rb->stop = 0;
+	rb->mark = 0;
+	rb->resume = 0;
+	rb->row = 0;
+	rb->swval = 0;
+}
+
+/*
+ * should seek points be noted as a WaveFile is read from ss?  They are for
+ * its index, and for wv_load() to read the columns of a file read lazily.
+ */
+static int
+wf_want_seek(WaveFile *wf, SpiceStream *ss)
+{
+	return (wf->flags & WF_INDEX)
+		|| ((wf->flags & WF_LAZY) && ss->readcol);
+}
+
+/*
+ * add a table just read to the end of a WaveFile's tables
+ */
+static void
+wf_add_table(WaveFile *wf, WvTable *wt)
+{
+	wt->swindex = wf->wf_ntables;
+	g_ptr_array_add(wf->tables, wt);
+	if(!wt->name)
+		wt->name = g_strdup_printf("tbl%d", wf->wf_ntables);
+}
+
+/*
+ * read the tables of a SpiceStream from where it is to the end, adding
+ * them to the WaveFile.  nest is the estimated number of rows in the
+ * first of them.  Returns 0, or -1 on error.
+ */
+static int
+wf_read_tables(SpiceStream *ss, WaveFile *wf, WFRowBatch *rb, SSIndex nest)
+{
+	WvTable *wt;
+	int state;
 
 	state = 0;
 	do {
-		wt = wf_read_table(ss, wf, &state, &ival, dvals);
+		wt = wf_read_table(ss, wf, &state, rb, nest, NULL, 0);
 		if(wt) {
-			ss_msg(DBG, "wf_finish_read", "table with %d rows; state=%d", wt->nvalues, state);
-			wt->swindex = wf->wf_ntables;
-			g_ptr_array_add(wf->tables, wt);
-			if(!wt->name) {
-				char tmp[128];
-				sprintf(tmp, "tbl%d", wf->wf_ntables);
-				wt->name = g_strdup(tmp);
-			}
+			ss_msg(DBG, "wf_read_tables", "table with %lld rows; state=%d", wt->nvalues, state);
+			nest = wt->nvalues + 1;
+			wf_add_table(wf, wt);
 		} else {
-			ss_msg(DBG, "wf_finish_read", "NULL table; state=%d", state);
+			ss_msg(DBG, "wf_read_tables", "NULL table; state=%d", state);
 		}
 	} while(state > 0);
+	return state;
+}
 
-	g_free(dvals);
-	g_free(spar);
-	ss_close(ss);
+/* 
+ * read all of the data from a SpiceStream and store it in the WaveFile
+ * structure.
+ * If dvload is non-NULL, it has an element for each dependent variable,
+ * and only those that are nonzero are read.
+ * If ld is non-NULL, it is told of the header and each batch of rows read.
+ */
+WaveFile *wf_finish_read(SpiceStream *ss, int flags, char *dvload, WFLoad *ld)
+{
+	WaveFile *wf;
+	WFRowBatch rb;
+	int state;
+	SSIndex nest;
+
+	if((flags & WF_FOLLOW) && ss->fp && ss_fd_decompressed(fileno(ss->fp))) {
+		ss_msg(INFO, "wf_finish_read", "%s: compressed; reading it as it is, without following it", ss->filename);
+		flags &= ~WF_FOLLOW;
+	}
+	wf = wf_new(ss, flags, dvload);
+	wf->load = ld;
+	if(ld)
+		wfl_header(ld, ss);
+
+	if(flags & WF_FOLLOW) {
+		if(!wf_follow_start(wf) || wf_follow(wf) < 0) {
+			wf->load = NULL;
+			wf_free(wf);
+			return NULL;
+		}
+		wf->load = NULL;
+		return wf;
+	}
+
+	/* size the first table's columns from the reader's estimate, 
+	 * if it has one.  Later tables, such as the sweeps of a monte-carlo
+	 * run, are usually the same length as the one before.
+	 */
+	nest = ss_guessrows(ss);
+	if(nest > 0 && ss->ntables > 1)
+		nest /= ss->ntables;
+	ss_msg(DBG, "wf_finish_read", "estimate %lld rows in first table", nest);
+
+	wf_rows_init(&rb, ss);
+	rb.mark = wf_want_seek(wf, ss);
+	state = wf_read_tables(ss, wf, &rb, nest);
+
+	g_free(rb.iv);
+	g_free(rb.dv);
+	if(flags & WF_LAZY)
+		ss_close_keep(ss);
+	else
+		ss_close(ss);
+	wf->load = NULL;
 
 	if(state < 0) {
 		wf_free(wf);
 		return NULL;
+	}
+	if(flags & WF_INDEX)
+		wf_index_write(wf);
+	return wf;
+}
+
+/*
+ * Read only the rows of a waveform file whose independent variable is
+ * between start and end, in each of its tables, as for wf_read_opt().
+ * The file's seek index, .NAME.wfx, is used to start reading each table
+ * near the first of those rows, and reading stops at the first row after
+ * end.  A table with none of them is there, but empty.
+ * If the file has no index, or the index is out of date, all of the file
+ * is read, and the index is written for next time.
+ */
+WaveFile *
+wf_read_range(char *name, char *format, int flags, double start, double end)
+{
+	SpiceStream *ss;
+	WaveFile *wf;
+	WFRowBatch rb;
+	WFSeekPoint *p;
+	WvTable *wt;
+	int ntables, state, t, cur;
+
+	ss = wf_open_file(name, format, NULL);
+	if(ss == NULL)
+		return NULL;
+	flags = (flags | WF_INDEX) & ~(WF_CACHE|WF_LAZY|WF_FOLLOW);
+	wf = wf_new(ss, flags, NULL);
+	wf_rows_init(&rb, ss);
+	rb.start = start;
+	rb.end = end;
+
+	ntables = wf_index_read(wf);
+	if(ntables < 0) {
+		ss_msg(INFO, "wf_read_range", "%s: no seek index; reading all of it", name);
+		rb.mark = 1;
+		state = wf_read_tables(ss, wf, &rb, 0);
+		if(state == 0)
+			wf_index_write(wf);
+		goto done;
+	}
+
+	/* cur is the table the stream is in, at row rb.row,
+	 * or -1 before the first */
+	cur = -1;
+	state = 1;
+	for(t = 0; t < ntables; t++) {
+		p = wf_seek_find(wf, t, start);
+		if(p && (p->table > cur
+			 || (p->table == cur && p->row > rb.row))) {
+			ss_msg(DBG, "wf_read_range", "table %d: seek to table %d row %lld at offset %lld", t, p->table, p->row, p->sp.pos);
+			if(!ss_seek(ss, &p->sp)) {
+				state = -1;
+				break;
+			}
+			rb.n = rb.pos = 0;
+			rb.resume = 1;
+			rb.row = p->row;
+			rb.swval = p->swval;
+			cur = p->table;
+		} else if(cur < 0) {
+			cur = 0;
+		}
+
+		/* read through the rest of any table before this one */
+		while(cur < t) {
+			rb.start = G_MAXDOUBLE;
+			rb.stop = 0;
+			wt = wf_read_table(ss, wf, &state, &rb, 0, NULL, 0);
+			if(wt)
+				wt_free(wt);
+			if(state <= 0)
+				break;
+			cur++;
+			rb.row = 0;
+		}
+		if(state <= 0)
+			break;
+
+		rb.start = start;
+		rb.stop = 1;
+		wt = wf_read_table(ss, wf, &state, &rb, 0, NULL, 0);
+		if(wt == NULL)
+			break;
+		ss_msg(DBG, "wf_read_range", "table %d: %lld rows", t, wt->nvalues);
+		wf_add_table(wf, wt);
+		if(state == 3) {	/* stopped part way through */
+			rb.resume = 1;
+			rb.swval = wt->swval;
+		} else {
+			cur++;
+			rb.row = 0;
+		}
+		if(state <= 0)
+			break;
+	}
+	if(state > 0)
+		state = 0;
+
+ done:
+	g_free(rb.iv);
+	g_free(rb.dv);
+	ss_close(ss);
+	if(state < 0) {
+		wf_free(wf);
+		return NULL;
+	}
+	return wf;
+}
+
+/*
+ * row of table tno from which the next seek point is due
+ */
+static SSIndex
+wf_seek_due(WaveFile *wf, int tno)
+{
+	WFSeekPoint *p;
+
+	if(wf->seek == NULL || wf->seek->len == 0)
+		return 0;
+	p = &g_array_index(wf->seek, WFSeekPoint, wf->seek->len - 1);
+	if(p->table != tno)
+		return 0;
+	return p->row + WF_SEEKSTRIDE;
+}
+
+static void
+wf_seek_add(WaveFile *wf, int tno, SSIndex row, double iv, double swval,
+	    SSSeekPoint *sp)
+{
+	WFSeekPoint p;
+
+	if(wf->seek == NULL)
+		wf->seek = g_array_new(0, 0, sizeof(WFSeekPoint));
+	memset(&p, 0, sizeof(p));	/* no stray bytes in index files */
+	p.table = tno;
+	p.row = row;
+	p.iv = iv;
+	p.swval = swval;
+	p.sp = *sp;
+	g_array_append_val(wf->seek, p);
+}
+
+/*
+ * read data for a single table (sweep or segment) from spicestream.
+ * Rows are read WDS_CHUNK at a time into the batch rb, and stored
+ * from there into the table's datasets.
+ * on entry:
+ *	state=0: no previous data; rb is empty
+ *	state=1: previous table ended; rb is empty
+ *	state=2: the rows remaining in rb start this table
+ *	nest is an estimate of the number of rows in the table, or 0.
+ *	If reuse is non-NULL, the rows are stored in that table, an existing
+ *	one being read again, instead of a new one.  Its first keep rows
+ *	are read but left as they are.
+ *	If rb->resume is set, the table was started earlier, and the stream
+ *	or the rows in rb carry on from row rb->row of it.
+ *	Only the rows between rb->start and rb->end are stored.
+ * on exit:
+ *	return NULL: fatal error, *statep=-1
+ *	return non-NULL: valid wvtable*
+ *
+ *	state=-1 fatal error
+ *	state=0: successful completion of reading whole file
+ * 	state=1:  finished table but more tables remain,
+ *			none of the next table has yet been read
+ * 	state=2:  finished table but more tables remain and
+ *		the rows remaining in rb start the next table.
+ *	state=3:  stopped, as rb->stop asked, after rb->end; the rows
+ *		remaining in rb, or the stream, carry on from row rb->row.
+ */
+WvTable *
+wf_read_table(SpiceStream *ss, WaveFile *wf, int *statep, WFRowBatch *rb,
+	      SSIndex nest, WvTable *reuse, SSIndex keep)
+{
+	WvTable *wt;
+	SSIndex row, nrows;
+	SSSeekPoint sp;
+	double last_ival;
+	double spar = 0;
+	int ncols = ss->ncols;
+	int rc, k, a, e, skip, tno, marked;
+
+	if(rb->resume) {
+		spar = rb->swval;
+	} else if(ss->nsweepparam > 0) {		
+		if(ss->nsweepparam == 1) {
+			if(ss_readsweep(ss, &spar) <= 0) {
+				*statep = -1;
+				return NULL;
+			}
+		} else {
+			ss_msg(ERR, "wf_read_table", "nsweepparam=%d; multidimentional sweeps not supported\n", ss->nsweepparam);
+			*statep = -1;
+			return NULL;
+		}
+	}
+	if(reuse) {
+		wt = reuse;
+		if(keep == 0)
+			wt_clear(wt);
+	} else {
+		wt = wvtable_new(wf, nest);
+	}
+	if(ss->nsweepparam == 1) {	
+		wt->swval = spar;
+		if(!wt->name)
+			wt->name = g_strdup(ss->spar[0].name);
+	} else {
+		wt->swval = 0;
+	}
+	
+	tno = reuse ? reuse->swindex : wf->wf_ntables;
+	row = rb->resume ? rb->row : 0;	/* row of the table in the file */
+	rb->resume = 0;
+	nrows = 0;			/* rows stored */
+	last_ival = -1.0e29;
+	for(;;) {
+		if(rb->pos >= rb->n) {
+			marked = rb->mark && row >= wf_seek_due(wf, tno)
+				&& ss_seekpoint(ss, &sp);
+			rc = ss_readrows(ss, WDS_CHUNK, rb->iv, rb->dv);
+			if(rc <= 0)
+				break;
+			rb->n = rc;
+			rb->pos = 0;
+			if(marked && (row == 0 || rb->iv[0] >= last_ival))
+				wf_seek_add(wf, tno, row, rb->iv[0], wt->swval,
+					    &sp);
+		}
+
+		/* the rows up to where the independent variable
+		 * decreases, which starts the next table, are this table's.
+		 */
+		for(k = rb->pos; k < rb->n; k++) {
+			if(row + k - rb->pos > 0 && rb->iv[k] < last_ival)
+				break;
+			last_ival = rb->iv[k];
+		}
+		if(k < rb->n && row + k - rb->pos == 1) {
+			ss_msg(ERR, "wavefile_read", "independent variable is not nondecreasing at row %lld; ival=%g last_ival=%g\n", row + k - rb->pos, rb->iv[k], last_ival);
+			rc = -1;
+			break;
+		}
+
+		/* store those in the range wanted */
+		for(a = rb->pos; a < k && rb->iv[a] < rb->start; a++)
+			;
+		for(e = a; e < k && rb->iv[e] <= rb->end; e++)
+			;
+		skip = CLAMP(keep - nrows, 0, e - a);
+		wt_put_rows(wt, nrows + skip, e - a - skip,
+			    rb->iv + a + skip, rb->dv + (a + skip) * ncols);
+		if(wf->load && !wfl_rows(wf->load, ss, wf->wf_ntables,
+					 wt->swval, e - a, rb->iv + a,
+					 rb->dv + a * ncols)) {
+			rc = -1;	/* cancelled */
+			break;
+		}
+		nrows += e - a;
+		if(e < k && rb->stop) {
+			row += e - rb->pos;
+			rb->pos = e;
+			rc = 3;
+			break;
+		}
+		row += k - rb->pos;
+		rb->pos = k;
+		if(k < rb->n) {
+			rc = 2;
+			break;
+		}
+	}
+	wt->nvalues = nrows;
+	rb->row = row;
+
+	if(rc == 3)
+		*statep = 3;
+	else if(rc == 2)
+		*statep = 2;
+	else if(rc == -2)
+		*statep = 1;
+	else if(rc < 0) {
+		if(reuse)
+			wt_trim(wt);	/* keep what was read */
+		else
+			wt_free(wt);
+		*statep = -1;
+		return NULL;
+	} else {
+		*statep = 0;
+	}
+	wt_trim(wt);
+	return wt;
+}
+
+/*
+ * store a batch of n rows, as read from the file, into a table's
+ * datasets starting at row.  ivals has the independent variable's
+ * values, and dvals the dependent values, ncols to a row.
+ */
+void
+wt_put_rows(WvTable *wt, SSIndex row, int n, double *ivals, double *dvals)
+{
+	WaveFile *wf = wt->wf;
+	WaveVar *dv;
+	int i, j;
+
+	if(n == 0)
+		return;
+	wds_set_range(wt->iv->wds, row, n, ivals, 1);
+	for(i = 0; i < wt->wt_ndv; i++) {
+		if(wf->dvload && !wf->dvload[i])
+			continue;
+		dv = &wt->dv[i];
+		for(j = 0; j < dv->wv_ncols; j++)
+			wds_set_range(&dv->wds[j], row, n,
+				      dvals + dv->sv->col - 1 + j, wf->wf_ncols);
+	}
+}
+
+#define WF_TAILSIZE	4096	/* bytes at the end of the data hashed */
+
+/*
+ * hash the WF_TAILSIZE bytes, or as many as there are, that end at
+ * offset end of a file.
+ */
+guint32
+wf_tail_hash(int fd, gint64 end)
+{
+	guchar buf[WF_TAILSIZE];
+	gint64 start = MAX(end - WF_TAILSIZE, 0);
+	guint32 h = 2166136261U;
+	ssize_t i, n;
+
+	n = pread64(fd, buf, end - start, start);
+	for(i = 0; i < n; i++) {
+		h ^= buf[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+/*
+ * the nanoseconds part of a file's modification time, or 0 if the system
+ * doesn't record it, so that a file rewritten within a second can be told
+ * from the one before it.
+ */
+long
+wf_mtime_nsec(struct stat *st)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	return st->st_mtim.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Record the state of the file a WaveFile is being read from, open on fd,
+ * so that wf_reload() can later tell what has changed.  If fd is a
+ * decompressed copy of the file, the file itself is looked at instead.
+ */
+void
+wf_stamp(WaveFile *wf, int fd)
+{
+	struct stat st;
+	int sfd;
+
+	wf->hdrhash = ss_header_hash(wf->ss);
+	sfd = ss_fd_decompressed(fd) ? open(wf->wf_filename, O_RDONLY) : fd;
+	if(sfd < 0 || fstat(sfd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		wf->srcsize = -1;
 	} else {
-		return wf;
+		wf->srcsize = st.st_size;
+		wf->srcmtime = st.st_mtime;
+		wf->srcnsec = wf_mtime_nsec(&st);
+		wf->tailhash = wf_tail_hash(sfd, st.st_size);
 	}
+	if(sfd >= 0 && sfd != fd)
+		close(sfd);
 }
 
 /*
- * read data for a single table (sweep or segment) from spicestream.
- * on entry:
- *	state=0: no previous data; dvals is allocated but garbage
- *	state=1: first row of data is in *ivalp, and vals[].
- * on exit:
- *	return NULL: fatal error, *statep=-1
- *	return non-NULL: valid wvtable*
- *
- *	state=-1 fatal error
- *	state=0: successful completion of reading whole file
- * 	state=1:  finished table but more tables remain,
- *			none of the next table has yet been read
- * 	state=2:  finished table but more tables remain and
- *		*ivalp,dvals[] contain first row of next table.
+ * does any of a WaveFile's data still point into its mapped cache file?
  */
-WvTable *
-wf_read_table(SpiceStream *ss, WaveFile *wf,
-	      int *statep, double *ivalp, double *dvals)
+static int
+wf_any_mapped(WaveFile *wf)
 {
 	WvTable *wt;
-	int row;
-	WaveVar *dv;
-	double last_ival;
-	double spar;
-	int rc, i, j;
+	int t, i, j;
 
-	if(ss->nsweepparam > 0) {		
-		if(ss->nsweepparam == 1) {
-			if(ss_readsweep(ss, &spar) <= 0) {
-				*statep = -1;
-				return NULL;
-			}
-		} else {
-			ss_msg(ERR, "wf_read_table", "nsweepparam=%d; multidimentional sweeps not supported\n", ss->nsweepparam);
-			*statep = -1;
-			return NULL;
-		}
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		if(wt->iv->wds->mapped)
+			return 1;
+		for(i = 0; i < wf->wf_ndv; i++)
+			for(j = 0; j < wt->dv[i].wv_ncols; j++)
+				if(wt->dv[i].wds[j].mapped)
+					return 1;
 	}
-	wt = wvtable_new(wf);
-	if(ss->nsweepparam == 1) {	
-		wt->swval = spar;
-		wt->name = g_strdup(ss->spar[0].name);
-	} else {
-		wt->swval = 0;
+	return 0;
+}
+
+/*
+ * Look at the file a WaveFile was read from.  Returns 1 if it seems not
+ * to have changed since, 0 if it has, or -1 if it can't be looked at.
+ * If appendp isn't NULL, *appendp is set to whether it has only grown.
+ * The file itself is looked at, so a compressed one needn't be
+ * decompressed to find that it hasn't changed.
+ */
+static int
+wf_source_same(WaveFile *wf, int *appendp)
+{
+	struct stat st;
+	int sfd, same;
+
+	sfd = open(wf->wf_filename, O_RDONLY);
+	if(sfd < 0 || fstat(sfd, &st) < 0) {
+		perror(wf->wf_filename);
+		if(sfd >= 0)
+			close(sfd);
+		return -1;
 	}
-	
-	if(*statep == 2) {
-		wf_set_point(wt->iv->wds, row, *ivalp);
-		for(i = 0; i < wt->wt_ndv; i++) {
-			dv = &wt->dv[i];
-			for(j = 0; j < dv->wv_ncols; j++)
-				wf_set_point(&dv->wds[j], row,
-					     dvals[dv->sv->col - 1 + j ]);
-		}
-		row = 1;
-		wt->nvalues = 1;
-		last_ival = *ivalp;
-	} else {
-		row = 0;
-		wt->nvalues = 0;
-		last_ival = -1.0e29;
+	same = S_ISREG(st.st_mode) && st.st_size == wf->srcsize
+		&& st.st_mtime == wf->srcmtime
+		&& wf_mtime_nsec(&st) == wf->srcnsec
+		&& wf_tail_hash(sfd, st.st_size) == wf->tailhash;
+	if(appendp)
+		*appendp = S_ISREG(st.st_mode) && wf->srcsize >= 0
+			&& st.st_size > wf->srcsize
+			&& wf_tail_hash(sfd, wf->srcsize) == wf->tailhash;
+	close(sfd);
+	return same;
+}
+
+/*
+ * Has the file a WaveFile was read from changed since, so that
+ * wf_reload() would have something to do?  Cheap, unless the WaveFile
+ * is being followed, in which case it is always taken to have changed.
+ */
+int
+wf_changed(WaveFile *wf)
+{
+	return wf->follow != NULL || wf_source_same(wf, NULL) != 1;
+}
+
+/*
+ * Bring a WaveFile up to date with its file, which may have changed
+ * since it was read, such as by running the simulation again.
+ * The WaveFile is changed in place, so that pointers to its tables and
+ * variables stay valid, and only as much is done as the change needs:
+ *	- if the size, modification time and the end of the file are
+ *	  unchanged, nothing.
+ *	- if the file is being followed, or has only grown, the new rows
+ *	  are added.  Unless it is being followed, the old ones must
+ *	  be parsed again to get to them, but aren't stored again.
+ *	- otherwise the data is read again into the same tables, over the
+ *	  old values.  Packed, paged or mapped values are freed as each
+ *	  table is reached, so the memory needed is about that of the
+ *	  old or new data, whichever is larger, rather than both.
+ * Tables that the file no longer has are removed; if dropped is non-NULL
+ * they are added to it, for the caller to free with wt_free() once
+ * nothing refers to them, otherwise they are freed here.
+ * Returns WFR_SAME, WFR_APPENDED or WFR_REREAD, or
+ *	WFR_NEWHEADER if the file's variables are different, in which case
+ *		nothing has been done: it must be read as a new WaveFile.
+ *	WFR_FAILED if the data couldn't be read.  The WaveFile keeps
+ *		what could be read.
+ */
+int
+wf_reload(WaveFile *wf, GPtrArray *dropped)
+{
+	SpiceStream *ss, *pss;
+	FILE *fp;
+	WFRowBatch rb;
+	WvTable *wt, *reuse;
+	SSIndex n, nest;
+	int state, same, append, t;
+
+	if(wf->follow) {
+		n = wf_follow(wf);
+		if(n >= 0)
+			return n > 0 ? WFR_APPENDED : WFR_SAME;
+		wf_follow_stop(wf);
 	}
 
-	while((rc = ss_readrow(ss, ivalp, dvals)) > 0) {
-		if(row > 0 && *ivalp < last_ival) {
-			if(row == 1) {
-				ss_msg(ERR, "wavefile_read", "independent variable is not nondecreasing at row %d; ival=%g last_ival=%g\n", row, *ivalp, last_ival);
-				wt_free(wt);
-				*statep = -1;
-				return NULL;
-				
-			} else {
-				*statep = 2;
-				return wt;
-			}
-		}
-		last_ival = *ivalp;
-		wf_set_point(wt->iv->wds, row, *ivalp);
-		for(i = 0; i < wt->wt_ndv; i++) {
-			dv = &wt->dv[i];
-			for(j = 0; j < dv->wv_ncols; j++)
-				wf_set_point(&dv->wds[j], row,
-					     dvals[dv->sv->col - 1 + j ]);
+	same = wf_source_same(wf, &append);
+	if(same < 0)
+		return WFR_FAILED;
+	if(same)
+		return WFR_SAME;
+
+	fp = ss_fopen(wf->wf_filename);
+	if(fp == NULL) {
+		perror(wf->wf_filename);
+		return WFR_FAILED;
+	}
+	ss = ss_open_internal(fp, wf->wf_filename,
+			      ss_filetype_name(wf->ss->filetype));
+	if(ss == NULL) {
+		fclose(fp);
+		return WFR_NEWHEADER;
+	}
+	if(wf->ss->plot > 0) {
+		/* find the plot again, in case it has moved */
+		pss = NULL;
+		if(ss_plots(ss) > wf->ss->plot)
+			pss = ss_open_plot(ss, wf->ss->plot);
+		ss_delete(ss);
+		if(pss == NULL)
+			return WFR_NEWHEADER;
+		ss = pss;
+		fp = ss->fp;
+	}
+	if(ss_header_hash(ss) != wf->hdrhash) {
+		ss_delete(ss);
+		return WFR_NEWHEADER;
+	}
+	ss_msg(DBG, "wf_reload", "%s: %s", wf->wf_filename,
+	       append ? "grown" : "changed");
+	wf_stamp(wf, fileno(fp));
+	ss_select_vars(ss, wf->dvload);
+
+	wf_rows_init(&rb, ss);
+	rb.mark = wf_want_seek(wf, ss);
+	if(wf->seek)
+		g_array_set_size(wf->seek, 0);
+	nest = ss_guessrows(ss);
+	if(nest > 0 && ss->ntables > 1)
+		nest /= ss->ntables;
+
+	t = 0;
+	state = 0;
+	do {
+		reuse = (t < wf->wf_ntables) ? wf_wtable(wf, t) : NULL;
+		wt = wf_read_table(ss, wf, &state, &rb, nest, reuse,
+				   (reuse && append) ? reuse->nvalues : 0);
+		if(reuse) {
+			t++;	/* kept even if it failed part way */
+		} else if(wt) {
+			wf_add_table(wf, wt);
+			t++;
 		}
-		row++;
-		wt->nvalues++;
+		if(wt)
+			nest = wt->nvalues + 1;
+	} while(state > 0);
+
+	g_free(rb.iv);
+	g_free(rb.dv);
+	wf->ss->ntables = ss->ntables;
+	if(wf->ss->fp) {	/* kept by a lazy read, and now out of date */
+		fclose(wf->ss->fp);
+		wf->ss->fp = NULL;
 	}
-	if(rc == -2)
-		*statep = 1;
-	else if(rc < 0) {
-		wt_free(wt);
-		*statep = -1;
-		return NULL;
-	} else {
-		*statep = 0;
+	if((wf->flags & WF_LAZY) && state >= 0 && ss_close_keep(ss)) {
+		wf->ss->fp = ss->fp;
+		ss->fp = NULL;
 	}
-	return wt;
+	ss_delete(ss);
+
+	while(wf->wf_ntables > t) {
+		wt = wf_wtable(wf, wf->wf_ntables - 1);
+		g_ptr_array_remove_index(wf->tables, wf->wf_ntables - 1);
+		if(dropped)
+			g_ptr_array_add(dropped, wt);
+		else
+			wt_free(wt);
+	}
+	if(wf->map && !wf_any_mapped(wf))
+		wf_cache_unmap(wf);
+
+	if(state < 0)
+		return WFR_FAILED;
+	if((wf->flags & WF_CACHE) && !(wf->flags & WF_LAZY))
+		wf_cache_write(wf);
+	if(wf->flags & WF_INDEX)
+		wf_index_write(wf);
+	return append ? WFR_APPENDED : WFR_REREAD;
 }
 
 
@@ -324,17 +1429,27 @@ wf_free(WaveFile *wf)
 		wt_free(wt);
 	}
 	g_ptr_array_free(wf->tables, 0);
+	if(wf->seek)
+		g_array_free(wf->seek, 1);
+	wf_cache_unmap(wf);
+	wf_follow_free(wf);
+	if(wf->dvload)
+		g_free(wf->dvload);
 	ss_delete(wf->ss);
 	g_free(wf);
 }
 
 void wt_free(WvTable *wt)
 {
-	int i;
-	for(i = 0; i < wt->wt_ndv; i++)
-		wf_free_dataset(wt->dv[i].wds);
+	int i, j;
+	for(i = 0; i < wt->wt_ndv; i++) {
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wf_free_dataset(&wt->dv[i].wds[j]);
+		g_free(wt->dv[i].wds);
+	}
 	g_free(wt->dv);
 	wf_free_dataset(wt->iv->wds);
+	g_free(wt->iv->wds);
 	g_free(wt->iv);
 	if(wt->name)
 		g_free(wt->name);
@@ -342,10 +1457,80 @@ void wt_free(WvTable *wt)
 }
 
 /*
- * create a new, empty WvTable for a WaveFile
+ * set up the storage of a dataset for nest values of type dstype,
+ * in pages if the file is read with WF_PAGED.  Sparse datasets are
+ * small enough not to need them.
+ */
+static void
+wds_init_storage(WDataSet *ds, int dstype, int flags, SSIndex nest)
+{
+	if(dstype == WDS_SPARSE)
+		wds_init_sparse(ds);
+	else if(flags & WF_PAGED)
+		wds_init_paged(ds, dstype == WDS_FLOAT ?
+			       sizeof(float) : sizeof(double));
+	else
+		wf_init_dataset(ds, dstype, nest);
+}
+
+/*
+ * empty a dataset so that it can be read again.  Values in an array are
+ * left to be written over; packed, paged, sparse or mapped ones are freed.
+ */
+static void
+wds_clear(WDataSet *ds, int dstype, int flags, SSIndex nest)
+{
+	if(ds->dstype == WDS_LAZY)
+		return;
+	if(ds->mapped || ds->dstype == WDS_PACKED || ds->dstype == WDS_PAGED
+	   || ds->dstype == WDS_SPARSE) {
+		wf_free_dataset(ds);
+		wds_init_storage(ds, dstype, flags, nest);
+	} else {
+		ds->min = G_MAXDOUBLE;
+		ds->max = -G_MAXDOUBLE;
+	}
+}
+
+/*
+ * empty a WvTable's datasets, for wf_reload() to read it again in place.
+ */
+static void
+wt_clear(WvTable *wt)
+{
+	WaveFile *wf = wt->wf;
+	int i, j;
+
+	wds_clear(wt->iv->wds, WDS_DOUBLE, wf->flags, wt->nvalues);
+	for(i = 0; i < wt->wt_ndv; i++)
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wds_clear(&wt->dv[i].wds[j], wf->dstype, wf->flags,
+				  wt->nvalues);
+}
+
+/*
+ * trim the storage of all of a WvTable's datasets down to the number of
+ * rows actually read, once the table is complete, and pack them
+ * if the file was read with WF_PACK.
+ */
+void
+wt_trim(WvTable *wt)
+{
+	int i, j;
+	wf_trim_dataset(wt->iv->wds, wt->nvalues);
+	for(i = 0; i < wt->wt_ndv; i++)
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wf_trim_dataset(&wt->dv[i].wds[j], wt->nvalues);
+	if(wt->wf->flags & WF_PACK)
+		wt_pack(wt);
+}
+
+/*
+ * create a new, empty WvTable for a WaveFile,
+ * with room for nest rows in each of its datasets.
  */
 WvTable *
-wvtable_new(WaveFile *wf)
+wvtable_new(WaveFile *wf, SSIndex nest)
 {
 	WvTable *wt;
 	SpiceStream *ss = wf->ss;
@@ -357,48 +1542,75 @@ wvtable_new(WaveFile *wf)
 	wt->iv->sv = ss->ivar;
 	wt->iv->wtable = wt;
 	wt->iv->wds = g_new0(WDataSet, 1);
-	wf_init_dataset(wt->iv->wds);
+	wds_init_storage(wt->iv->wds, WDS_DOUBLE, wf->flags, nest);
 
 	wt->dv = g_new0(WaveVar, wf->ss->ndv);
 	for(i = 0; i < wf->wf_ndv; i++) {
 		wt->dv[i].wtable = wt;
 		wt->dv[i].sv = &ss->dvar[i];
 		wt->dv[i].wds = g_new0(WDataSet, wt->dv[i].sv->ncols);
-		for(j = 0; j < wt->dv[i].sv->ncols; j++)
-			wf_init_dataset(&wt->dv[i].wds[j]);
+		for(j = 0; j < wt->dv[i].sv->ncols; j++) {
+			if(wf->dvload && !wf->dvload[i])
+				wt->dv[i].wds[j].dstype = WDS_LAZY;
+			else
+				wds_init_storage(&wt->dv[i].wds[j], wf->dstype,
+						 wf->flags, nest);
+		}
 	}
 	return wt;
 }
 
 
 /*
- * initialize common elements of WDataSet structure 
+ * initialize common elements of WDataSet structure,
+ * allocating space for nest values of type dstype.
  */ 
 void
-wf_init_dataset(WDataSet *ds)
+wf_init_dataset(WDataSet *ds, int dstype, SSIndex nest)
 {
 	ds->min = G_MAXDOUBLE;
 	ds->max = -G_MAXDOUBLE;
 	
-	ds->bpsize = DS_INBLKS;
-	ds->bptr = g_new0(double *, ds->bpsize);
-	ds->bptr[0] = g_new(double, DS_DBLKSIZE);
-	ds->bpused = 1;
+	ds->dstype = dstype;
+	ds->nalloc = (nest > 0) ? nest : DS_INITSIZE;
+	if(dstype == WDS_FLOAT)
+		ds->fptr = g_new(float, ds->nalloc);
+	else
+		ds->dptr = g_new(double, ds->nalloc);
 	ds->nreallocs = 0;
 }
 
+/*
+ * free a DataSet's array of values, unless it belongs to a mapped file.
+ */
+void
+wds_free_storage(WDataSet *ds)
+{
+	if(!ds->mapped) {
+		if(ds->dptr)
+			g_free(ds->dptr);
+		if(ds->fptr)
+			g_free(ds->fptr);
+	}
+	ds->dptr = NULL;
+	ds->fptr = NULL;
+	ds->mapped = 0;
+}
+
 /*
  * free up memory pointed to by a DataSet, but not the dataset itself.
  */
 void
 wf_free_dataset(WDataSet *ds)
 {
-	int i;
-	for(i = 0; i < ds->bpused; i++)
-		if(ds->bptr[i])
-			g_free(ds->bptr[i]);
-	g_free(ds->bptr);
-	g_free(ds);
+	wds_free_storage(ds);
+	if(ds->dstype == WDS_PACKED)
+		wds_free_packed(ds);
+	else if(ds->dstype == WDS_PAGED)
+		wds_free_paged(ds);
+	else if(ds->dstype == WDS_SPARSE)
+		wds_free_sparse(ds);
+	ds->nalloc = 0;
 }
 
 /*
@@ -422,51 +1634,271 @@ wf_foreach_wavevar(WaveFile *wf, GFunc func, gpointer *p)
 }
 
 /*
- * expand dataset's storage to add one more block.
+ * reallocate dataset's storage to hold exactly n values.
  */
-void
-wf_expand_dset(WDataSet *ds)
+static void
+wds_realloc(WDataSet *ds, SSIndex n)
 {
-	if(ds->bpused >= ds->bpsize) {
-		ds->bpsize *= 2;
-		ds->bptr = g_realloc(ds->bptr, ds->bpsize * sizeof(double*));
-		ds->nreallocs++;
+	void *p;
+
+	if(ds->mapped) {	/* copy it out of the mapping first */
+		if(ds->dstype == WDS_FLOAT)
+			p = g_memdup(ds->fptr, MIN(n, ds->nalloc) * sizeof(float));
+		else
+			p = g_memdup(ds->dptr, MIN(n, ds->nalloc) * sizeof(double));
+		wds_free_storage(ds);
+		if(ds->dstype == WDS_FLOAT)
+			ds->fptr = p;
+		else
+			ds->dptr = p;
 	}
-	ds->bptr[ds->bpused++] = g_new(double, DS_DBLKSIZE);
+	if(ds->dstype == WDS_FLOAT)
+		ds->fptr = g_realloc(ds->fptr, n * sizeof(float));
+	else
+		ds->dptr = g_realloc(ds->dptr, n * sizeof(double));
+	ds->nalloc = n;
+}
+
+/*
+ * expand dataset's storage so that it can hold at least n values.
+ * Growth is geometric, so that the cost of copying stays proportional
+ * to the number of values.
+ */
+void
+wf_expand_dset(WDataSet *ds, SSIndex n)
+{
+	SSIndex nsize;
+
+	nsize = ds->nalloc * 2;
+	if(nsize < n)
+		nsize = n;
+	if(nsize < DS_INITSIZE)
+		nsize = DS_INITSIZE;
+	wds_realloc(ds, nsize);
+	ds->nreallocs++;
+}
+
+/*
+ * shrink dataset's storage to hold exactly n values.
+ */
+void
+wf_trim_dataset(WDataSet *ds, SSIndex n)
+{
+	if(ds->dstype == WDS_SPARSE)
+		wds_trim_sparse(ds);
+	if(ds->dstype != WDS_DOUBLE && ds->dstype != WDS_FLOAT)
+		return;
+	if(n < 1)
+		n = 1;
+	if(n >= ds->nalloc)
+		return;
+	wds_realloc(ds, n);
 }
 
 /*
  * set single value in dataset.   Probably can be inlined.
  */
 void
-wf_set_point(WDataSet *ds, int n, double val)
+wf_set_point(WDataSet *ds, SSIndex n, double val)
 {
-	int blk, off;
-	blk = ds_blockno(n);
-	off = ds_offset(n);
-	while(blk >= ds->bpused)
-		wf_expand_dset(ds);
+	if(ds->dstype == WDS_PAGED) {
+		val = wds_page_set(ds, n, val);
+	} else if(ds->dstype == WDS_SPARSE && n >= ds->nalloc) {
+		wds_sparse_set_range(ds, n, 1, &val, 1);
+		return;
+	} else {
+		if(ds->dstype == WDS_SPARSE)
+			wds_unsparse(ds);
+		else if(ds->dstype == WDS_PACKED)
+			wds_unpack(ds);
+		else if(ds->mapped)
+			wds_realloc(ds, ds->nalloc);
+		if(n >= ds->nalloc)
+			wf_expand_dset(ds, n+1);
 
-	ds->bptr[blk][off] = val;
+		if(ds->dstype == WDS_FLOAT)
+			val = ds->fptr[n] = val;  /* min/max of the rounded value */
+		else
+			ds->dptr[n] = val;
+	}
 	if(val < ds->min)
 		ds->min = val;
 	if(val > ds->max)
 		ds->max = val;
 }
 
+/*
+ * set n consecutive values in a dataset, starting at index start,
+ * from vals[0], vals[stride], vals[2*stride] ...
+ * This is the bulk form of wf_set_point(); the stride lets a batch of
+ * rows be moved into each column's dataset without copying it first.
+ */
+void
+wds_set_range(WDataSet *ds, SSIndex start, int n, double *vals, int stride)
+{
+	double min, max;
+	double *dp;
+	float *fp;
+	int i;
+
+	if(ds->dstype == WDS_PAGED) {
+		wds_page_set_range(ds, start, n, vals, stride);
+		return;
+	}
+	if(ds->dstype == WDS_SPARSE) {
+		if(start >= ds->nalloc) {
+			wds_sparse_set_range(ds, start, n, vals, stride);
+			return;
+		}
+		wds_unsparse(ds);
+	}
+	if(ds->dstype == WDS_PACKED)
+		wds_unpack(ds);
+	else if(ds->mapped)
+		wds_realloc(ds, ds->nalloc);
+	if(start + n > ds->nalloc)
+		wf_expand_dset(ds, start + n);
+
+	/* copy, then find min and max in a separate pass that the
+	 * compiler can vectorize.
+	 */
+	min = ds->min;
+	max = ds->max;
+	if(ds->dstype == WDS_FLOAT) {
+		fp = ds->fptr + start;
+		for(i = 0; i < n; i++)
+			fp[i] = vals[i * stride];
+		for(i = 0; i < n; i++) {	/* of the rounded values */
+			min = (fp[i] < min) ? fp[i] : min;
+			max = (fp[i] > max) ? fp[i] : max;
+		}
+	} else {
+		dp = ds->dptr + start;
+		for(i = 0; i < n; i++)
+			dp[i] = vals[i * stride];
+		for(i = 0; i < n; i++) {
+			min = (dp[i] < min) ? dp[i] : min;
+			max = (dp[i] > max) ? dp[i] : max;
+		}
+	}
+	ds->min = min;
+	ds->max = max;
+}
+
 /*
  * get single point from dataset.   Probably can be inlined.
  */
 double
-wds_get_point(WDataSet *ds, int n)
+wds_get_point(WDataSet *ds, SSIndex n)
+{
+	double v;
+
+	g_assert(n < ds->nalloc);
+
+	switch(ds->dstype) {
+	case WDS_FLOAT:
+		return ds->fptr[n];
+	case WDS_PACKED:
+		/* the cache of unpacked blocks is shared */
+		ss_lock();
+		v = wds_get_block(ds, n / WDS_PBLOCK)[n % WDS_PBLOCK];
+		ss_unlock();
+		return v;
+	case WDS_PAGED:
+		return wds_page_get(ds, n);
+	case WDS_SPARSE:
+		return wds_sparse_get(ds, n);
+	default:
+		return ds->dptr[n];
+	}
+}
+
+/*
+ * get n consecutive points from a dataset, starting at index start.
+ * Returns a pointer to an array of doubles containing the values; 
+ * this is either a pointer into the dataset itself, or buf, which
+ * must have room for n values.  
+ * This lets loops that visit many points do so without caring how the
+ * dataset is stored.
+ */
+double *
+wds_get_range(WDataSet *ds, SSIndex start, int n, double *buf)
+{
+	int i, k;
+	float *fp;
+	double *bp;
+
+	g_assert(start + n <= ds->nalloc);
+
+	if(ds->dstype == WDS_DOUBLE)
+		return ds->dptr + start;
+
+	if(ds->dstype == WDS_PAGED)
+		return wds_page_range(ds, start, n, buf);
+
+	if(ds->dstype == WDS_SPARSE)
+		return wds_sparse_range(ds, start, n, buf);
+
+	if(ds->dstype == WDS_PACKED) {
+		ss_lock();
+		for(i = 0; i < n; i += k) {
+			bp = wds_get_block(ds, (start + i) / WDS_PBLOCK);
+			k = MIN(n - i, WDS_PBLOCK - (start + i) % WDS_PBLOCK);
+			memcpy(buf + i, bp + (start + i) % WDS_PBLOCK,
+			       k * sizeof(double));
+		}
+		ss_unlock();
+		return buf;
+	}
+
+	fp = ds->fptr + start;
+	for(i = 0; i < n; i++)
+		buf[i] = fp[i];
+	return buf;
+}
+
+/*
+ * change the storage precision of the dataset(s) for a dependent
+ * variable to dstype.  Independent variables are always stored in double
+ * precision.
+ * Returns 0 on success, -1 if wv is an independent variable,
+ * is paged or sparse, or hasn't been loaded.
+ */
+int
+wv_set_precision(WaveVar *wv, int dstype)
 {
-	int blk, off;
-	blk = ds_blockno(n);
-	off = ds_offset(n);
-	g_assert(blk <= ds->bpused);
-	g_assert(off < DS_DBLKSIZE);
+	WDataSet *ds;
+	double *dp;
+	float *fp;
+	SSIndex i, n;
+	int j;
 
-	return ds->bptr[blk][off];
+	if(wv == wv->wv_iv || wv_is_lazy(wv) || wv->wds[0].dstype == WDS_PAGED
+	   || wv->wds[0].dstype == WDS_SPARSE)
+		return -1;
+	n = wv->wv_nvalues;
+	for(j = 0; j < wv->wv_ncols; j++) {
+		ds = &wv->wds[j];
+		wds_unpack(ds);
+		if(ds->dstype == dstype)
+			continue;
+		if(dstype == WDS_FLOAT) {
+			fp = g_new(float, MAX(n, 1));
+			for(i = 0; i < n; i++)
+				fp[i] = ds->dptr[i];
+			wds_free_storage(ds);
+			ds->fptr = fp;
+		} else {
+			dp = g_new(double, MAX(n, 1));
+			for(i = 0; i < n; i++)
+				dp[i] = ds->fptr[i];
+			wds_free_storage(ds);
+			ds->dptr = dp;
+		}
+		ds->dstype = dstype;
+		ds->nalloc = MAX(n, 1);
+	}
+	return 0;
 }
 
 /*
@@ -481,28 +1913,34 @@ wds_get_point(WDataSet *ds, int n)
  * Further, if there are duplicate values, returns the highest index
  * that has the same value.
  */
-int
+SSIndex
 wf_find_point(WaveVar *iv, double ival)
 {
 	WDataSet *ds = iv->wds;
+	double *ivp;
 	double cval;
-	int a, b;
+	SSIndex a, b, m;
 	int n = 0;
 
+	ivp = (ds->dstype == WDS_DOUBLE) ? ds->dptr : NULL;
 	a = 0;
 	b = iv->wv_nvalues - 1;
 	if(ival >= ds->max)
 		return b;
 	while(a+1 < b) {
-		cval = wds_get_point(ds, (a+b)/2);
-/*		printf(" a=%d b=%d ival=%g cval=%g\n", a,b,ival,cval); */
+		m = a + (b - a) / 2;
+		if(ivp)
+			cval = ivp[m];
+		else
+			cval = wds_get_point(ds, m);
+/*		printf(" a=%lld b=%lld ival=%g cval=%g\n", a,b,ival,cval); */
 		if(ival < cval)
-			b = (a+b)/2;
+			b = m;
 		else
-			a = (a+b)/2;
+			a = m;
 
 
-		g_assert(n++ < 32);  /* > 2 ** 32 points?  must be a bug! */
+		g_assert(n++ < 64);  /* > 2 ** 64 points?  must be a bug! */
 	}
 	return a;
 }
@@ -522,11 +1960,13 @@ wf_find_point(WaveVar *iv, double ival)
 double
 wv_interp_value(WaveVar *dv, double ival)
 {
-	int li, ri;   /* index of points to left and right of desired value */
+	SSIndex li, ri;   /* index of points to left and right of desired value */
 	double lx, rx;  /* independent variable's value at li and ri */
 	double ly, ry;  /* dependent variable's value at li and ri */
 	WaveVar *iv;
 
+	if(wv_is_lazy(dv) && wv_load(dv) < 0)
+		return 0.0;
 	iv = dv->wv_iv;
 
    	li = wf_find_point(iv, ival);
@@ -538,10 +1978,12 @@ wv_interp_value(WaveVar *dv, double ival)
 	rx = wds_get_point(&iv->wds[0], ri);
 /*	g_assert(lx <= ival); */
 	if(li > 0 && lx > ival) {
-		fprintf(stderr, "wv_interp_value: assertion failed: lx <= ival for %s: ival=%g li=%d lx=%g\n", dv->wv_name, ival, li, lx);
+		fprintf(stderr, "wv_interp_value: assertion failed: lx <= ival for %s: ival=%g li=%lld lx=%g\n", dv->wv_name, ival, li, lx);
 	}
 
 	ly = wds_get_point(&dv->wds[0], li);
+	if(dv->wds[0].dstype == WDS_SPARSE)	/* holds until it changes */
+		return ival < rx ? ly : wds_get_point(&dv->wds[0], ri);
 	ry = wds_get_point(&dv->wds[0], ri);
 
 	if(ival > rx) { /* no extrapolation allowed! */
@@ -569,3 +2011,264 @@ wf_find_variable(WaveFile *wf, char *varname, int swpno)
 	}
 	return NULL;
 }
+
+/*
+ * have two readings of a file found it the same, as far as its size,
+ * modification time, header and the end of its data can tell?
+ */
+static int
+wf_same_stamp(WaveFile *a, WaveFile *b)
+{
+	return a->srcsize >= 0 && a->srcsize == b->srcsize
+		&& a->srcmtime == b->srcmtime && a->srcnsec == b->srcnsec
+		&& a->hdrhash == b->hdrhash && a->tailhash == b->tailhash;
+}
+
+/*
+ * is the file open on fd, that a WaveFile was read from, still as it was
+ * then?  A decompressed copy of it always is.
+ */
+static int
+wf_fd_unchanged(WaveFile *wf, int fd)
+{
+	struct stat st;
+
+	if(ss_fd_decompressed(fd))
+		return 1;
+	return fstat(fd, &st) == 0 && st.st_size == wf->srcsize
+		&& st.st_mtime == wf->srcmtime
+		&& wf_mtime_nsec(&st) == wf->srcnsec
+		&& wf_tail_hash(fd, st.st_size) == wf->tailhash;
+}
+
+#define WF_COLCHUNK	65536	/* rows read at a time by wf_load_cols() */
+
+/*
+ * Read the columns of the dependent variables marked in need, of a file
+ * read lazily that is still open, with ss_readcol(): from the seek point
+ * at the start of each table, only their values are read.
+ * Returns 0, or -1 if they can't be read this way, in which case nothing
+ * has been changed.
+ */
+static int
+wf_load_cols(WaveFile *wf, char *need)
+{
+	SpiceStream *ss = wf->ss;
+	WFSeekPoint *p;
+	SSSeekPoint sp;
+	WvTable *wt;
+	WaveVar *dv;
+	WDataSet **nds;
+	double *buf;
+	SSIndex row;
+	int *first;
+	int i, j, k, s, t, rc;
+
+	if(ss->fp == NULL || ss->readcol == NULL || wf->seek == NULL
+	   || !wf_fd_unchanged(wf, fileno(ss->fp)))
+		return -1;
+
+	/* each table must have a seek point at its first row */
+	first = g_new(int, MAX(wf->wf_ntables, 1));
+	for(t = 0; t < wf->wf_ntables; t++)
+		first[t] = -1;
+	for(s = wf->seek->len - 1; s >= 0; s--) {
+		p = &g_array_index(wf->seek, WFSeekPoint, s);
+		if(p->row == 0 && p->table >= 0 && p->table < wf->wf_ntables)
+			first[p->table] = s;
+	}
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		if(first[t] < 0 && wt->nvalues > 0) {
+			g_free(first);
+			return -1;
+		}
+	}
+
+	/* read into new datasets, to put in place once all are read */
+	nds = g_new0(WDataSet *, wf->wf_ntables * wf->wf_ndv);
+	buf = g_new(double, WF_COLCHUNK);
+	rc = 0;
+	for(t = 0; t < wf->wf_ntables && rc == 0; t++) {
+		wt = wf_wtable(wf, t);
+		for(i = 0; i < wf->wf_ndv && rc == 0; i++) {
+			if(!need[i])
+				continue;
+			dv = &wt->dv[i];
+			nds[t * wf->wf_ndv + i] = g_new0(WDataSet, dv->wv_ncols);
+			for(j = 0; j < dv->wv_ncols && rc == 0; j++) {
+				wds_init_storage(&nds[t * wf->wf_ndv + i][j],
+						 wf->dstype, wf->flags,
+						 wt->nvalues);
+				if(wt->nvalues == 0)
+					continue;
+				sp = g_array_index(wf->seek, WFSeekPoint,
+						   first[t]).sp;
+				for(row = 0; row < wt->nvalues; row += k) {
+					k = MIN(wt->nvalues - row, WF_COLCHUNK);
+					if(ss_readcol(ss, &sp, dv->sv->col + j,
+						      k, buf) != k) {
+						rc = -1;
+						break;
+					}
+					wds_set_range(&nds[t * wf->wf_ndv + i][j],
+						      row, k, buf, 1);
+				}
+			}
+		}
+	}
+	g_free(buf);
+	g_free(first);
+
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		for(i = 0; i < wf->wf_ndv; i++) {
+			if(nds[t * wf->wf_ndv + i] == NULL)
+				continue;
+			dv = &wt->dv[i];
+			for(j = 0; j < dv->wv_ncols; j++) {
+				if(rc < 0) {
+					wf_free_dataset(&nds[t * wf->wf_ndv + i][j]);
+					continue;
+				}
+				wf_free_dataset(&dv->wds[j]);
+				dv->wds[j] = nds[t * wf->wf_ndv + i][j];
+				wf_trim_dataset(&dv->wds[j], wt->nvalues);
+				if(wf->flags & WF_PACK)
+					wds_pack(&dv->wds[j], WDS_PACK_XOR64);
+			}
+			g_free(nds[t * wf->wf_ndv + i]);
+		}
+	}
+	g_free(nds);
+	if(rc < 0)
+		ss_msg(DBG, "wf_load_cols", "%s: can't read columns; reading the file again", wf->wf_filename);
+	return rc;
+}
+
+/*
+ * Read the data for the dependent variables of a lazily-read WaveFile
+ * that are marked nonzero in want, in all of the file's tables.
+ * If the file was kept open, only their columns are read; see
+ * wf_load_cols().  Otherwise it is read again from the start, so this is
+ * best done for several variables at once.
+ * Returns 0 on success, or -1 on failure, in which case the variables
+ * remain unloaded.
+ */
+int
+wf_load_vars(WaveFile *wf, char *want)
+{
+	FILE *fp;
+	SpiceStream *ss;
+	WaveFile *nwf;
+	WvTable *wt, *nwt;
+	WDataSet *wds;
+	char *need;
+	int i, t, n;
+
+	if(wf->dvload == NULL)
+		return 0;
+	need = g_new0(char, MAX(wf->wf_ndv, 1));
+	for(i = n = 0; i < wf->wf_ndv; i++)
+		if(want[i] && !wf->dvload[i]) {
+			need[i] = 1;
+			n++;
+		}
+	if(n == 0) {
+		g_free(need);
+		return 0;
+	}
+	ss_msg(DBG, "wf_load_vars", "%s: loading %d variables",
+	       wf->wf_filename, n);
+
+	if(wf_load_cols(wf, need) == 0) {
+		for(i = 0; i < wf->wf_ndv; i++)
+			if(need[i])
+				wf->dvload[i] = 1;
+		g_free(need);
+		return 0;
+	}
+
+	nwf = NULL;
+	ss = NULL;
+	if(wf->ss->plot > 0) {
+		ss = ss_open_plot(wf->ss, wf->ss->plot);
+	} else if((fp = ss_fopen(wf->wf_filename)) == NULL) {
+		ss_msg(ERR, "wf_load_vars", "%s: %s", wf->wf_filename,
+		       strerror(errno));
+	} else {
+		ss = ss_open_internal(fp, wf->wf_filename,
+				      ss_filetype_name(wf->ss->filetype));
+		if(ss == NULL)
+			fclose(fp);
+	}
+	if(ss)
+		nwf = wf_finish_read(ss, wf->flags & ~(WF_LAZY|WF_INDEX),
+				     need, NULL);
+	if(nwf == NULL) {
+		g_free(need);
+		return -1;
+	}
+
+	/* make sure the file is still the one we read before: one
+	 * rewritten with the same shape would otherwise go unnoticed */
+	if(!wf_same_stamp(wf, nwf))
+		goto changed;
+	if(nwf->wf_ndv != wf->wf_ndv || nwf->wf_ntables != wf->wf_ntables)
+		goto changed;
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		nwt = wf_wtable(nwf, t);
+		if(wt->nvalues != nwt->nvalues)
+			goto changed;
+	}
+
+	/* swap the datasets with the new file's empty ones, so that
+	 * they go away when it is freed.
+	 */
+	for(t = 0; t < wf->wf_ntables; t++) {
+		wt = wf_wtable(wf, t);
+		nwt = wf_wtable(nwf, t);
+		for(i = 0; i < wf->wf_ndv; i++) {
+			if(!need[i])
+				continue;
+			wds = wt->dv[i].wds;
+			wt->dv[i].wds = nwt->dv[i].wds;
+			nwt->dv[i].wds = wds;
+		}
+	}
+	for(i = 0; i < wf->wf_ndv; i++)
+		if(need[i])
+			wf->dvload[i] = 1;
+	wf_free(nwf);
+	g_free(need);
+	return 0;
+
+ changed:
+	ss_msg(ERR, "wf_load_vars", "%s: file has changed since it was read",
+	       wf->wf_filename);
+	wf_free(nwf);
+	g_free(need);
+	return -1;
+}
+
+/*
+ * Read the data for a single dependent variable of a lazily-read
+ * WaveFile, in all of its tables.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+wv_load(WaveVar *wv)
+{
+	WaveFile *wf = wv->wv_file;
+	char *want;
+	int rc;
+
+	if(!wv_is_lazy(wv))
+		return 0;
+	want = g_new0(char, wf->wf_ndv);
+	want[wv - wv->wtable->dv] = 1;
+	rc = wf_load_vars(wf, want);
+	g_free(want);
+	return rc;
+}
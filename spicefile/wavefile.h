@@ -30,22 +30,61 @@
 typedef struct _WaveFile WaveFile;
 typedef struct _WaveVar WaveVar;
 typedef struct _WDataSet WDataSet;
+typedef struct _WDSPage WDSPage;
 typedef struct _WvTable WvTable;
+typedef struct _WFLoad WFLoad;
+typedef struct _WFFollow WFFollow;
 
 /* Wave Data Set - 
- * an array of double-precision floating-point values,  used to store a
- * column of values.  Organized as a block structure because we don't know
- * how many entries there will be without reading the file, and we don't
- * want to read the whole thing twice.
- * 
- * Depending on what the memory allocator does, this might even 
- * end up being relatively cache-friendly.  TODO: think more about this.
+ * an array of floating-point values,  used to store a
+ * column of values.  We don't know how many entries there will be without
+ * reading the file, and we don't want to read the whole thing twice, so
+ * the column is a single contiguous array whose initial size comes from
+ * the reader's estimate of the number of rows, if it has one.  It grows
+ * geometrically as rows are read, and is trimmed to fit once the table
+ * it belongs to is complete, so that memory use follows the amount of
+ * data rather than the number of datasets.
+ *
+ * Values are stored either as doubles or as floats.  Single precision
+ * halves the memory and bandwidth needed for data that came from
+ * a single-precision file in the first place.  Independent variables
+ * are always stored as doubles.
+ *
+ * A dataset may also point into a cache file mapped into memory, in
+ * which case its values can't be changed or freed.
+ * Datasets of a file read with WF_PAGED are kept in pages which are
+ * written out to a spill file when the memory budget is exceeded.
+ *
+ * The datasets of a file read with WF_LAZY are WDS_LAZY, with no
+ * values at all, until wv_load() reads them.
+ *
+ * Once a table is complete its datasets can be packed: the values are
+ * compressed, losslessly, in blocks of WDS_PBLOCK values which are
+ * unpacked on demand into a small cache of recently used blocks.
+ * min and max remain available without unpacking anything.
+ *
+ * The dependent variables of a file whose format records only the values
+ * that change, as event-driven simulators write, are WDS_SPARSE: a list
+ * of the rows at which each value changes, and what to; see wavesparse.c.
  */ 
 
-#define DS_DBLKSIZE	8192
-#define DS_INBLKS	1024
-#define ds_blockno(n) ((n) / DS_DBLKSIZE)
-#define ds_offset(n) ((n) % DS_DBLKSIZE)
+#define DS_INITSIZE	64	/* initial size when there is no estimate */
+#define WDS_CHUNK	256	/* values per wds_get_range() call in bulk loops,
+				 * and rows per batch when reading */
+
+#define WDS_DOUBLE	0	/* storage types for dstype */
+#define WDS_FLOAT	1
+#define WDS_PACKED	2
+#define WDS_LAZY	3	/* not read yet; see wv_load() */
+#define WDS_PAGED	4
+#define WDS_SPARSE	5	/* piecewise-constant, as a list of changes */
+
+#define WDS_PBLOCK	1024	/* values per packed block */
+#define WDS_PAGE	1024	/* values per page of a paged dataset */
+
+#define WDS_PACK_DOD	1	/* packing methods: delta-of-delta, for iv */
+#define WDS_PACK_XOR64	2	/* XOR with previous double */
+#define WDS_PACK_XOR32	3	/* XOR with previous float */
 
 struct _WDataSet {
 	double min;
@@ -53,11 +92,28 @@ struct _WDataSet {
 	
 	/* remaining stuff is an array storage structure 
 	 * that could be abstracted out and/or replaced with somthing else */
-	/* pointer to array of pointers to blocks of doubles */
-	double **bptr;
-	int bpsize; /* size of array of pointers */
-	int bpused; /* number of blocks actually allocated */
+	int dstype;	/* WDS_DOUBLE, WDS_FLOAT, or WDS_PACKED */
+	double *dptr;	/* contiguous array of values, for WDS_DOUBLE */
+	float *fptr;	/* contiguous array of values, for WDS_FLOAT */
+	SSIndex nalloc;	/* number of values allocated */
 	int nreallocs;
+	int mapped;	/* dptr or fptr points into a mapped cache file */
+
+	int pmethod;	/* for WDS_PACKED: WDS_PACK_* method used */
+	SSIndex nblocks;	/* number of packed blocks */
+	guchar **pblock;  /* array of packed blocks */
+	gint64 psize;	/* total size of packed blocks, in bytes */
+
+	int pesize;	/* for WDS_PAGED: size of each value */
+	SSIndex npages;	/* number of pages */
+	WDSPage **pages;
+	int plost;	/* times a page couldn't be read back from the
+			 * spill file; its values read as NaN */
+
+	SSIndex nchanges;	/* for WDS_SPARSE: number of changes */
+	SSIndex challoc;	/* number allocated */
+	SSIndex *crow;	/* row at which each change happens */
+	double *cval;	/* and the value from then on */
 };
 
 /* Wave Variable - used for independent or dependent variable.
@@ -77,6 +133,7 @@ struct _WaveVar {
 #define wv_file		wtable->wf
 
 #define wv_is_multisweep(WV) ((WV)->wtable->wf->wf_ntables>1)
+#define wv_is_lazy(WV) ((WV)->wds[0].dstype == WDS_LAZY)
 
 /*
  * Wave Table - association of one or more dependent variables with
@@ -87,19 +144,49 @@ struct _WvTable {
 	int swindex;	/* index of the sweep, 0-based */
 	char *name;	/* name of the sweep, if any, else NULL */
 	double swval;	/* value at which the sweep was taken */
-	int nvalues;	/* number of rows */
+	SSIndex nvalues;	/* number of rows */
 	WaveVar *iv;	/* pointer to single independent variable */
 	WaveVar *dv;	/* pointer to array of dependent var info */
 };
 
 #define wt_ndv	wf->ss->ndv
 
+/*
+ * Seek point - a place in a file from which one of its tables can be read
+ * without reading everything before it.  A file read with WF_INDEX has
+ * one every WF_SEEKSTRIDE rows or so; see waveindex.c.  So does one read
+ * with WF_LAZY whose reader can read single columns from them.
+ */
+typedef struct {
+	int table;	/* index of the table, */
+	SSIndex row;	/* and of the row read next from here */
+	double iv;	/* value of the independent variable in that row */
+	double swval;	/* the table's sweep value */
+	SSSeekPoint sp;
+} WFSeekPoint;
+
+#define WF_SEEKSTRIDE	4096
+
 /*
  * WaveFile - data struture containing all of the data from a file.
  */
 struct _WaveFile {
 	SpiceStream *ss;
 	GPtrArray *tables;  /* array of WvTable* */
+	int dstype;	/* storage type for dependent variables */
+	int flags;	/* WF_* flags it was read with */
+	char *dvload;	/* if read lazily, nonzero for each dependent
+			 * variable whose data has been loaded */
+	void *map;	/* mapped cache file, if read from one */
+	size_t mapsize;
+	WFLoad *load;	/* while being read by wf_load_start() */
+	WFFollow *follow;	/* if read with WF_FOLLOW; see wavefollow.c */
+	gint64 srcsize;	/* size and mtime of the file when read, and */
+	gint64 srcmtime;  /* hashes of its header and of the end of */
+	guint32 hdrhash;  /* its data then; see wf_reload() */
+	guint32 tailhash;
+	long srcnsec;	/* nanoseconds part of srcmtime, or 0 */
+	GArray *seek;	/* WFSeekPoints in file order; see wf_want_seek() */
 	void *udata;
 };
 
@@ -110,13 +197,131 @@ struct _WaveFile {
 #define wf_wtable(WF,I)	(WvTable*)g_ptr_array_index((WF)->tables, (I))
 
 
+/* flags for wf_read_opt() */
+#define WF_SINGLE	0x1	/* store dependent variables in single precision */
+#define WF_DOUBLE	0x2	/* store double precision even if file is single */
+#define WF_PACK		0x4	/* pack each table's datasets once read */
+#define WF_CACHE	0x8	/* read from and write a cache file */
+#define WF_LAZY		0x10	/* read dependent variables only when needed */
+#define WF_PAGED	0x20	/* use paged datasets; see wds_set_budget() */
+#define WF_FOLLOW	0x40	/* keep reading as the file grows; see wf_follow() */
+#define WF_INDEX	0x80	/* note seek points, and write them to a file */
+#define WF_SPARSE	0x100	/* store only the changes of dependent variables */
+
+/* results of wf_reload() */
+#define WFR_FAILED	-1
+#define WFR_SAME	0	/* file hasn't changed */
+#define WFR_APPENDED	1	/* rows were added to the end */
+#define WFR_REREAD	2	/* data read again, into the same WaveVars */
+#define WFR_NEWHEADER	3	/* variables changed; read it as a new file */
+
+/* states returned by wf_load_status() */
+#define WFL_LOADING	0
+#define WFL_DONE	1
+#define WFL_FAILED	2
+#define WFL_CANCELLED	3
+
 /* defined in wavefile.c */
 extern WaveFile *wf_read(char *name, char *format);
+extern WaveFile *wf_read_opt(char *name, char *format, int flags);
+extern WaveFile *wf_read_load(char *name, char *format, int flags,
+			      WFLoad *ld);
+extern WaveFile *wf_read_select(char *name, char *format, int flags,
+				char **varlist);
+extern WaveFile *wf_read_plot(char *name, char *format, int flags, int plot);
+extern WaveFile *wf_read_plot_load(char *name, char *format, int flags,
+				   int plot, WFLoad *ld);
+extern char **wf_plot_names(char *name, char *format);
+extern WaveFile *wf_read_range(char *name, char *format, int flags,
+			       double start, double end);
+typedef void (*WFReadDone)(WaveFile *wf, int i, gpointer data);
+extern void wf_read_many(int n, char **names, char *format, int flags,
+			 WFReadDone done, gpointer data);
 extern double wv_interp_value(WaveVar *dv, double ival);
-extern int wf_find_point(WaveVar *iv, double ival);
-extern double wds_get_point(WDataSet *ds, int n);
+extern SSIndex wf_find_point(WaveVar *iv, double ival);
+extern double wds_get_point(WDataSet *ds, SSIndex n);
+extern double *wds_get_range(WDataSet *ds, SSIndex start, int n, double *buf);
+extern void wds_set_range(WDataSet *ds, SSIndex start, int n, double *vals,
+			  int stride);
+extern int wv_set_precision(WaveVar *wv, int dstype);
+extern int wf_choose_dstype(int flags, int valsize);
+extern void wds_free_storage(WDataSet *ds);
 extern void wf_free(WaveFile *df);
+struct stat;
+extern void wf_stamp(WaveFile *wf, int fd);
+extern long wf_mtime_nsec(struct stat *st);
+extern guint32 wf_tail_hash(int fd, gint64 end);
+extern int wf_changed(WaveFile *wf);
+extern int wf_reload(WaveFile *wf, GPtrArray *dropped);
 extern WaveVar *wf_find_variable(WaveFile *wf, char *varname, int swpno);
 extern void wf_foreach_wavevar(WaveFile *wf, GFunc func, gpointer *p);
+extern int wf_load_vars(WaveFile *wf, char *want);
+extern int wv_load(WaveVar *wv);
+extern WvTable *wvtable_new(WaveFile *wf, SSIndex nest);
+extern void wt_trim(WvTable *wt);
+extern void wt_free(WvTable *wt);
+extern void wt_put_rows(WvTable *wt, SSIndex row, int n, double *ivals,
+			double *dvals);
+
+/* defined in wavepack.c */
+extern int wds_pack(WDataSet *ds, int method);
+extern void wds_unpack(WDataSet *ds);
+extern void wds_free_packed(WDataSet *ds);
+extern double *wds_get_block(WDataSet *ds, SSIndex blk);
+extern void wt_pack(WvTable *wt);
+
+/* defined in wavepage.c */
+extern void wds_set_budget(gint64 bytes);
+extern gint64 wds_get_budget(void);
+extern void wds_init_paged(WDataSet *ds, int esize);
+extern double wds_page_get(WDataSet *ds, SSIndex n);
+extern double wds_page_set(WDataSet *ds, SSIndex n, double val);
+extern void wds_page_set_range(WDataSet *ds, SSIndex start, int n,
+			       double *vals, int stride);
+extern double *wds_page_range(WDataSet *ds, SSIndex start, int n, double *buf);
+extern void wds_free_paged(WDataSet *ds);
+
+/* defined in waveload.c */
+extern WFLoad *wf_load_start(char *name, char *format, int flags);
+extern WFLoad *wf_load_start_plot(char *name, char *format, int flags,
+				  int plot);
+extern int wf_load_status(WFLoad *ld, double *fractionp);
+extern WaveFile *wf_load_preview(WFLoad *ld);
+extern WaveFile *wf_load_empty(WFLoad *ld);
+extern void wf_load_cancel(WFLoad *ld);
+extern WaveFile *wf_load_finish(WFLoad *ld);
+extern int *wfl_cancel_flag(WFLoad *ld);
+extern void wfl_header(WFLoad *ld, SpiceStream *ss);
+extern int wfl_rows(WFLoad *ld, SpiceStream *ss, int table, double swval,
+		    int n, double *ivals, double *dvals);
+
+/* defined in wavefollow.c */
+extern int wf_follow_start(WaveFile *wf);
+extern SSIndex wf_follow(WaveFile *wf);
+extern void wf_follow_stop(WaveFile *wf);
+extern void wf_follow_free(WaveFile *wf);
+
+/* defined in wavesparse.c */
+extern void wds_init_sparse(WDataSet *ds);
+extern SSIndex wds_sparse_find(WDataSet *ds, SSIndex n);
+extern double wds_sparse_get(WDataSet *ds, SSIndex n);
+extern void wds_sparse_set_range(WDataSet *ds, SSIndex start, int n,
+				 double *vals, int stride);
+extern double *wds_sparse_range(WDataSet *ds, SSIndex start, int n,
+				double *buf);
+extern void wds_trim_sparse(WDataSet *ds);
+extern void wds_unsparse(WDataSet *ds);
+extern void wds_free_sparse(WDataSet *ds);
+
+/* defined in wavecache.c */
+extern WaveFile *wf_cache_read(char *name, char *format, int flags);
+extern int wf_cache_write(WaveFile *wf);
+extern void wf_cache_unmap(WaveFile *wf);
+extern char *wf_sidecar_name(char *name, char *ext);
+
+/* defined in waveindex.c */
+extern int wf_index_read(WaveFile *wf);
+extern int wf_index_write(WaveFile *wf);
+extern WFSeekPoint *wf_seek_find(WaveFile *wf, int table, double ival);
 
 #endif /* WAVEFILE_H */
@@ -0,0 +1,251 @@
+/*
+ * wavefollow.c - keep reading a waveform data file as it grows, such as
+ * the output of a simulation that is still running.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * A file read with WF_FOLLOW keeps its SpiceStream open after the rows
+ * written so far have been read.  Each call to wf_follow() reads the
+ * rows appended since the last one and adds them to the end of the last
+ * table, or to new tables, so its cost depends on the amount of new data
+ * rather than the size of the file.
+ *
+ * Each batch of rows is read between ss_mark() and ss_rewind(): if the
+ * data runs out part way through a row, only the whole rows are kept,
+ * and the reader is left at the start of the partial one to read it
+ * again once the rest of it has been written.
+ *
+ * The datasets of the table being added to aren't trimmed, since they
+ * grow geometrically; a table is trimmed when the next one starts,
+ * or when wf_follow_stop() is called.
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "wavefile.h"
+
+#define WFF_SWEEP	0	/* sweep values of a new table come next */
+#define WFF_NEWTABLE	1	/* the next row starts a new table */
+#define WFF_ROWS	2	/* the next row goes in the last table */
+
+struct _WFFollow {
+	int state;		/* WFF_* */
+	SSIndex size;		/* size of the file when last read */
+	double swval;		/* sweep value for the next table */
+	double last_ival;	/* last independent value in the last table */
+	SSIndex nest;		/* size for the next table's datasets */
+	double *iv;		/* batch of rows being read */
+	double *dv;
+};
+
+/*
+ * Set up to follow a WaveFile whose header has just been read, before
+ * any rows have been read.  Returns 0 if the file can't be followed.
+ */
+int
+wf_follow_start(WaveFile *wf)
+{
+	SpiceStream *ss = wf->ss;
+	WFFollow *fw;
+
+	if(ss->nsweepparam > 1) {
+		ss_msg(ERR, "wf_follow_start", "nsweepparam=%d; multidimentional sweeps not supported\n", ss->nsweepparam);
+		return 0;
+	}
+	ss_follow(ss);
+	fw = g_new0(WFFollow, 1);
+	fw->state = ss->nsweepparam ? WFF_SWEEP : WFF_NEWTABLE;
+	fw->size = -1;
+	fw->iv = g_new(double, WDS_CHUNK);
+	fw->dv = g_new(double, WDS_CHUNK * MAX(ss->ncols, 1));
+	wf->follow = fw;
+	return 1;
+}
+
+/*
+ * store n rows from the batch, starting new tables wherever the
+ * independent variable decreases, as wf_read_table() does.
+ * Returns 0 on error or if a load has been cancelled, else 1.
+ */
+static int
+wf_follow_rows(WaveFile *wf, int n)
+{
+	WFFollow *fw = wf->follow;
+	SpiceStream *ss = wf->ss;
+	WvTable *wt;
+	int i, k;
+
+	for(i = 0; i < n; i = k) {
+		if(fw->state != WFF_ROWS) {
+			wt = wvtable_new(wf, fw->nest);
+			wt->swindex = wf->wf_ntables;
+			wt->swval = fw->swval;
+			if(ss->nsweepparam == 1)
+				wt->name = g_strdup(ss->spar[0].name);
+			else
+				wt->name = g_strdup_printf("tbl%d", wf->wf_ntables + 1);
+			g_ptr_array_add(wf->tables, wt);
+			fw->state = WFF_ROWS;
+		}
+		wt = wf_wtable(wf, wf->wf_ntables - 1);
+
+		for(k = i; k < n; k++) {
+			if(wt->nvalues + k - i > 0 && fw->iv[k] < fw->last_ival)
+				break;
+			fw->last_ival = fw->iv[k];
+		}
+		if(k < n && wt->nvalues + k - i == 1) {
+			ss_msg(ERR, "wf_follow", "independent variable is not nondecreasing at row 1; ival=%g last_ival=%g\n", fw->iv[k], fw->last_ival);
+			return 0;
+		}
+		wt_put_rows(wt, wt->nvalues, k - i, fw->iv + i,
+			    fw->dv + i * ss->ncols);
+		wt->nvalues += k - i;
+		if(wf->load && !wfl_rows(wf->load, ss, wf->wf_ntables - 1,
+					 wt->swval, k - i, fw->iv + i,
+					 fw->dv + i * ss->ncols))
+			return 0;
+		if(k < n) {
+			wt_trim(wt);
+			fw->nest = wt->nvalues + 1;
+			fw->state = WFF_NEWTABLE;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Read the rows that have been added to a file read with WF_FOLLOW
+ * since the last call, and add them to the WaveFile.
+ * Returns the number of rows added, 0 if there were none,
+ * or -1 if the file can't be followed any further.
+ */
+SSIndex
+wf_follow(WaveFile *wf)
+{
+	WFFollow *fw = wf->follow;
+	SpiceStream *ss = wf->ss;
+	struct stat st;
+	SSMark *mark;
+	WvTable *wt;
+	SSIndex total = 0;
+	int n, partial;
+
+	if(fw == NULL || ss->fp == NULL)
+		return -1;
+	if(fstat(fileno(ss->fp), &st) < 0)
+		return -1;
+	if(S_ISREG(st.st_mode)) {
+		if(st.st_size == fw->size)
+			return 0;
+		if(st.st_size < fw->size) {
+			ss_msg(WARN, "wf_follow", "%s: file is shorter than it was; not following it any further", ss->filename);
+			return -1;
+		}
+		fw->size = st.st_size;
+	}
+	clearerr(ss->fp);
+
+	for(partial = 0; !partial; ) {
+		mark = ss_mark(ss);
+		if(fw->state == WFF_SWEEP) {
+			if(ss_readsweep(ss, &fw->swval) <= 0) {
+				ss_rewind(ss, mark);
+				ss_mark_free(mark);
+				break;
+			}
+			ss_mark_free(mark);
+			fw->state = WFF_NEWTABLE;
+			continue;
+		}
+
+		n = ss_readrows(ss, WDS_CHUNK, fw->iv, fw->dv);
+		if(n > 0 && ss->rows_held && ss->rows_rc != -2) {
+			/* the data ran out after these rows, perhaps part
+			 * way through the next one: read just these again,
+			 * to leave the reader where they end. */
+			ss_rewind(ss, mark);
+			n = ss_readrows(ss, n, fw->iv, fw->dv);
+			partial = 1;
+		}
+		if(n == -2) {
+			/* end of table; the next one starts with its
+			 * sweep values, if it has any */
+			ss_mark_free(mark);
+			if(fw->state == WFF_ROWS) {
+				wt = wf_wtable(wf, wf->wf_ntables - 1);
+				wt_trim(wt);
+				fw->nest = wt->nvalues + 1;
+			}
+			fw->state = ss->nsweepparam ? WFF_SWEEP : WFF_NEWTABLE;
+			continue;
+		}
+		if(n <= 0) {
+			/* nothing more yet */
+			ss_rewind(ss, mark);
+			ss_mark_free(mark);
+			break;
+		}
+		ss_mark_free(mark);
+		if(!wf_follow_rows(wf, n))
+			return -1;
+		total += n;
+	}
+	if(total)
+		ss_msg(DBG, "wf_follow", "%s: %lld new rows", ss->filename, total);
+	return total;
+}
+
+/*
+ * Stop following a file: close it, and trim the last table.
+ * The data read so far remains.
+ */
+void
+wf_follow_stop(WaveFile *wf)
+{
+	WFFollow *fw = wf->follow;
+
+	if(fw == NULL)
+		return;
+	if(fw->state == WFF_ROWS)
+		wt_trim(wf_wtable(wf, wf->wf_ntables - 1));
+	if(wf->ss->fp)
+		ss_close(wf->ss);
+	wf_follow_free(wf);
+}
+
+void
+wf_follow_free(WaveFile *wf)
+{
+	WFFollow *fw = wf->follow;
+
+	if(fw == NULL)
+		return;
+	g_free(fw->iv);
+	g_free(fw->dv);
+	g_free(fw);
+	wf->follow = NULL;
+}
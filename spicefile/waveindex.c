@@ -0,0 +1,233 @@
+/*
+ * waveindex.c - seek indexes of waveform files, for reading part of
+ * a long file without reading all of it.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * When a file is read with WF_INDEX, a seek point is noted every
+ * WF_SEEKSTRIDE rows or so of each table: the table, row and value of the
+ * independent variable there, and an SSSeekPoint from which the reader
+ * can carry on.  Once the whole file has been read they are written to
+ * a "sidecar" file named .NAME.wfx, alongside the cache file if there is
+ * one, which wf_read_range() uses to go straight to the rows it wants.
+ *
+ * The index is only used while the size, modification time and header
+ * of the file it was made from are unchanged.
+ *
+ * Index file layout, all in the native byte order of the machine that
+ * wrote it:
+ *	WFXHeader
+ *	WFSeekPoint[npoints]	in the order of the file
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "wavefile.h"
+
+#define WFX_MAGIC	"gwavewfx"
+#define WFX_VERSION	1
+#define WFX_BYTEORDER	0x01020304
+
+typedef struct {
+	char magic[8];
+	guint32 byteorder;
+	guint32 version;
+	gint64 srcsize;		/* size and mtime of the file indexed */
+	gint64 srcmtime;
+	guint32 hdrhash;	/* ss_header_hash() of it */
+	gint32 filetype;
+	gint32 ntables;
+	gint32 psize;		/* sizeof(WFSeekPoint) */
+	gint64 npoints;
+} WFXHeader;
+
+/* to make temporary names unique when files are read on several threads */
+static int wfx_tmpseq;
+
+/*
+ * Write the seek points of a WaveFile that has just been read with
+ * WF_INDEX to its index file.
+ * Failure isn't an error; the file will just be read from the start.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+wf_index_write(WaveFile *wf)
+{
+	WFXHeader h;
+	char *xname, *tname;
+	FILE *fp;
+	int rc = -1;
+
+	if(wf->seek == NULL || wf->seek->len == 0 || wf->srcsize < 0)
+		return -1;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, WFX_MAGIC, sizeof(h.magic));
+	h.byteorder = WFX_BYTEORDER;
+	h.version = WFX_VERSION;
+	h.srcsize = wf->srcsize;
+	h.srcmtime = wf->srcmtime;
+	h.hdrhash = wf->hdrhash;
+	h.filetype = wf->ss->filetype;
+	h.ntables = wf->wf_ntables;
+	h.psize = sizeof(WFSeekPoint);
+	h.npoints = wf->seek->len;
+
+	/* write to a temporary name and rename, so that a reader never
+	 * sees a partial index.
+	 */
+	xname = wf_sidecar_name(wf->wf_filename, "wfx");
+	ss_lock();
+	tname = g_strdup_printf("%s.%d.%d", xname, (int)getpid(), ++wfx_tmpseq);
+	ss_unlock();
+	fp = fopen64(tname, "w");
+	if(fp == NULL) {
+		ss_msg(DBG, "wf_index_write", "%s: %s", tname, strerror(errno));
+		goto out;
+	}
+	if(fwrite(&h, sizeof(h), 1, fp) != 1
+	   || fwrite(wf->seek->data, sizeof(WFSeekPoint), wf->seek->len, fp)
+	   != wf->seek->len)
+		goto fail;
+	if(fclose(fp) != 0) {
+		fp = NULL;
+		goto fail;
+	}
+	fp = NULL;
+	if(rename(tname, xname) < 0)
+		goto fail;
+	ss_msg(DBG, "wf_index_write", "%s: wrote %lld seek points to %s",
+	       wf->wf_filename, h.npoints, xname);
+	rc = 0;
+	goto out;
+
+ fail:
+	ss_msg(DBG, "wf_index_write", "%s: %s", tname, strerror(errno));
+	if(fp)
+		fclose(fp);
+	unlink(tname);
+ out:
+	g_free(xname);
+	g_free(tname);
+	return rc;
+}
+
+/*
+ * Read the seek points of a WaveFile, which has had its header read and
+ * its file stamped with wf_stamp(), from its index file into wf->seek.
+ * Returns the number of tables in the file, or -1 if there is no index,
+ * or it is out of date or unusable.
+ */
+int
+wf_index_read(WaveFile *wf)
+{
+	WFXHeader h;
+	struct stat st;
+	char *xname;
+	FILE *fp;
+	int rc = -1;
+
+	if(wf->srcsize < 0)
+		return -1;
+	xname = wf_sidecar_name(wf->wf_filename, "wfx");
+	fp = fopen64(xname, "r");
+	if(fp == NULL) {
+		g_free(xname);
+		return -1;
+	}
+	if(fread(&h, sizeof(h), 1, fp) != 1
+	   || memcmp(h.magic, WFX_MAGIC, sizeof(h.magic)) != 0
+	   || h.byteorder != WFX_BYTEORDER
+	   || h.version != WFX_VERSION
+	   || h.psize != sizeof(WFSeekPoint)
+	   || h.npoints < 1 || h.ntables < 1) {
+		ss_msg(DBG, "wf_index_read", "%s: not a usable index", xname);
+		goto out;
+	}
+	if(h.srcsize != wf->srcsize || h.srcmtime != wf->srcmtime
+	   || h.hdrhash != wf->hdrhash || h.filetype != wf->ss->filetype) {
+		ss_msg(DBG, "wf_index_read", "%s: index is stale", xname);
+		goto out;
+	}
+	/* don't trust npoints further than the file goes */
+	if(fstat(fileno(fp), &st) < 0
+	   || h.npoints > (st.st_size - (gint64)sizeof(h)) / h.psize
+	   || sizeof(h) + h.npoints * h.psize != st.st_size) {
+		ss_msg(DBG, "wf_index_read", "%s: wrong size for %lld seek points", xname, h.npoints);
+		goto out;
+	}
+
+	if(wf->seek == NULL)
+		wf->seek = g_array_new(0, 0, sizeof(WFSeekPoint));
+	g_array_set_size(wf->seek, h.npoints);
+	if(fread(wf->seek->data, sizeof(WFSeekPoint), h.npoints, fp)
+	   != h.npoints) {
+		g_array_set_size(wf->seek, 0);
+		goto out;
+	}
+	ss_msg(DBG, "wf_index_read", "%s: %lld seek points in %d tables",
+	       xname, h.npoints, h.ntables);
+	rc = h.ntables;
+ out:
+	fclose(fp);
+	g_free(xname);
+	return rc;
+}
+
+/*
+ * Find the last seek point before the first row, at or after which the
+ * independent variable is ival, of the given table: the last one in the
+ * table whose value is less than ival, or else the last one in the tables
+ * before it.  Returns NULL if there is none, and the table must be read
+ * from the start of the file.
+ */
+WFSeekPoint *
+wf_seek_find(WaveFile *wf, int table, double ival)
+{
+	WFSeekPoint *pts;
+	SSIndex lo, hi, mid;
+
+	if(wf->seek == NULL || wf->seek->len == 0)
+		return NULL;
+	pts = (WFSeekPoint *)wf->seek->data;
+
+	/* points before the one we want are "below" it; find the first
+	 * one that isn't */
+	lo = 0;
+	hi = wf->seek->len;
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if(pts[mid].table < table
+		   || (pts[mid].table == table && pts[mid].iv < ival))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(lo == 0)
+		return NULL;
+	return &pts[lo - 1];
+}
@@ -0,0 +1,461 @@
+/*
+ * waveload.c - read a waveform data file on a thread of its own, so that
+ * the program reading it can carry on while it is read.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * wf_load_start() starts reading a file, and returns at once.
+ * While the file is read, wf_load_status() tells how far through
+ * the file the reader has got, and wf_load_preview() returns a WaveFile
+ * holding a sample of the rows read so far, at most WFL_PREVIEW of them,
+ * evenly spaced; wf_load_empty() returns one with nothing in it, to use
+ * before then.  wf_load_finish() waits for the read to finish and
+ * returns the complete WaveFile.
+ *
+ * The reading thread owns the WaveFile being read; all that is shared
+ * with the caller is the WFLoad, whose fields below are used under
+ * ss_lock().  Without threads, wf_load_start() reads the whole file
+ * before returning.
+ *
+ * At most ss_nthreads() files are read at once.  Loads started beyond
+ * that wait in a queue, and are started by later calls to
+ * wf_load_start() and wf_load_status() as the others finish; those,
+ * like the rest of the wf_load_* functions, must all be called from
+ * the same thread.
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "wavefile.h"
+
+#define WFL_PREVIEW	4096	/* most rows kept for the preview */
+
+struct _WFLoad {
+	char *name;
+	char *format;
+	int flags;
+	int plot;		/* as for wf_read_plot() */
+	SSThread *thread;
+	WFLoad *qnext;		/* next in the queue of loads not started */
+	int queued;		/* waiting in that queue */
+	int pooled;		/* started in turn, and counted in wfl_running */
+
+	/* the rest is shared with the reading thread */
+	int state;		/* WFL_* */
+	int cancel;		/* asked to stop */
+	WaveFile *wf;		/* the file, once read */
+	SSIndex pos;		/* how far through the file the reader is */
+	SSIndex size;		/* size of the file, 0 if unknown */
+	SpiceStream *hdr;	/* copy of the file's header, once read */
+	int gen;		/* changed whenever the preview changes */
+	int taken;		/* gen of the last preview handed out */
+	SSIndex nseen;		/* rows read */
+	int step;		/* every step'th row is kept */
+	int nrows;		/* rows kept */
+	double *iv;		/* independent variable of each row kept */
+	double *dv;		/* dependent values, ncols to a row */
+	int *table;		/* table each row kept belongs to */
+	double *swvals;		/* sweep value of each table */
+	int nswvals;
+};
+
+/* loads waiting to be started, and the number being read; under ss_lock() */
+static WFLoad *wfl_queue;
+static WFLoad *wfl_queue_tail;
+static int wfl_running;
+
+/*
+ * copy of the header of a SpiceStream, with no file.  The variable names
+ * are shared with ss, whose names are never freed.
+ */
+static SpiceStream *
+wfl_copy_header(SpiceStream *ss)
+{
+	SpiceStream *hdr;
+
+	hdr = ss_new(NULL, ss->filename, ss->ndv, ss->nsweepparam);
+	hdr->filetype = ss->filetype;
+	hdr->ncols = ss->ncols;
+	hdr->ntables = ss->ntables;
+	hdr->valsize = ss->valsize;
+	*hdr->ivar = *ss->ivar;
+	if(ss->ndv)
+		memcpy(hdr->dvar, ss->dvar, ss->ndv * sizeof(SpiceVar));
+	if(ss->nsweepparam)
+		memcpy(hdr->spar, ss->spar, ss->nsweepparam * sizeof(SpiceVar));
+	return hdr;
+}
+
+static void *
+wfl_thread(void *arg)
+{
+	WFLoad *ld = arg;
+	WaveFile *wf;
+
+	wf = wf_read_plot_load(ld->name, ld->format, ld->flags, ld->plot, ld);
+	ss_lock();
+	ld->wf = wf;
+	if(wf)
+		ld->state = WFL_DONE;
+	else if(ld->cancel)
+		ld->state = WFL_CANCELLED;
+	else
+		ld->state = WFL_FAILED;
+	if(ld->pooled)
+		wfl_running--;
+	ss_unlock();
+	return NULL;
+}
+
+/*
+ * take ld out of the queue, if it is there.  Called under ss_lock().
+ */
+static void
+wfl_dequeue(WFLoad *ld)
+{
+	WFLoad **lp;
+	WFLoad *prev = NULL;
+
+	if(!ld->queued)
+		return;
+	for(lp = &wfl_queue; *lp != ld; lp = &(*lp)->qnext)
+		prev = *lp;
+	*lp = ld->qnext;
+	if(wfl_queue_tail == ld)
+		wfl_queue_tail = prev;
+	ld->qnext = NULL;
+	ld->queued = 0;
+}
+
+/*
+ * start reading the loads at the head of the queue, while fewer than
+ * ss_nthreads() are being read.
+ */
+static void
+wfl_run_queue(void)
+{
+	WFLoad *ld;
+
+	for(;;) {
+		ss_lock();
+		ld = wfl_queue;
+		if(ld == NULL || wfl_running >= ss_nthreads()) {
+			ss_unlock();
+			return;
+		}
+		wfl_dequeue(ld);
+		ld->pooled = 1;
+		wfl_running++;
+		ss_unlock();
+		ld->thread = ss_thread_start(wfl_thread, ld);
+		if(ld->thread == NULL)
+			wfl_thread(ld);
+	}
+}
+
+/*
+ * Start reading a waveform data file, with the same arguments as
+ * wf_read_opt(), and return without waiting for it to be read, which
+ * may not begin until other loads have finished.
+ * The WFLoad returned must be passed to wf_load_finish() in the end.
+ */
+WFLoad *
+wf_load_start(char *name, char *format, int flags)
+{
+	return wf_load_start_plot(name, format, flags, 0);
+}
+
+/*
+ * Start reading a plot of a waveform data file, as for wf_read_plot(),
+ * in the same way.
+ */
+WFLoad *
+wf_load_start_plot(char *name, char *format, int flags, int plot)
+{
+	WFLoad *ld;
+
+	ld = g_new0(WFLoad, 1);
+	ld->name = g_strdup(name);
+	if(format)
+		ld->format = g_strdup(format);
+	ld->flags = flags;
+	ld->plot = plot;
+	ld->state = WFL_LOADING;
+	ld->step = 1;
+	ss_lock();
+	ld->queued = 1;
+	if(wfl_queue_tail)
+		wfl_queue_tail->qnext = ld;
+	else
+		wfl_queue = ld;
+	wfl_queue_tail = ld;
+	ss_unlock();
+	wfl_run_queue();
+	return ld;
+}
+
+/*
+ * Return the state of a load, one of the WFL_* values.  If fractionp is
+ * non-NULL, the fraction of the file read so far is stored there,
+ * or -1 if it isn't known.
+ */
+int
+wf_load_status(WFLoad *ld, double *fractionp)
+{
+	int state;
+
+	wfl_run_queue();
+	ss_lock();
+	state = ld->state;
+	if(fractionp) {
+		if(state != WFL_LOADING)
+			*fractionp = 1.0;
+		else if(ld->size > 0 && ld->pos >= 0)
+			*fractionp = MIN(1.0, (double)ld->pos / ld->size);
+		else
+			*fractionp = -1;
+	}
+	ss_unlock();
+	return state;
+}
+
+/*
+ * Ask for a load to stop.  wf_load_finish() will return NULL.
+ */
+void
+wf_load_cancel(WFLoad *ld)
+{
+	ss_lock();
+	ld->cancel = 1;
+	if(ld->queued) {
+		wfl_dequeue(ld);
+		ld->state = WFL_CANCELLED;
+	}
+	ss_unlock();
+}
+
+/*
+ * Return a new WaveFile, with the file's variables and a sample of the
+ * rows read so far, which can be used until the whole file has been read.
+ * Returns NULL if there are no rows yet, or none since the last preview.
+ */
+WaveFile *
+wf_load_preview(WFLoad *ld)
+{
+	WaveFile *wf;
+	WvTable *wt;
+	WaveVar *dv;
+	SpiceStream *ss;
+	double *iv, *dvals, *swvals;
+	int *table;
+	int nrows, ncols, first, n, i, j;
+
+	ss_lock();
+	if(ld->hdr == NULL || ld->nrows == 0 || ld->gen == ld->taken) {
+		ss_unlock();
+		return NULL;
+	}
+	ss = wfl_copy_header(ld->hdr);
+	ncols = ss->ncols;
+	nrows = ld->nrows;
+	iv = g_memdup(ld->iv, nrows * sizeof(double));
+	dvals = g_memdup(ld->dv, nrows * ncols * sizeof(double));
+	table = g_memdup(ld->table, nrows * sizeof(int));
+	swvals = g_memdup(ld->swvals, ld->nswvals * sizeof(double));
+	ld->taken = ld->gen;
+	ss_unlock();
+
+	wf = g_new0(WaveFile, 1);
+	wf->ss = ss;
+	wf->tables = g_ptr_array_new();
+	wf->dstype = WDS_DOUBLE;
+
+	/* a table for each run of rows from the same table of the file */
+	for(first = 0; first < nrows; first += n) {
+		for(n = 1; first + n < nrows; n++)
+			if(table[first + n] != table[first])
+				break;
+		wt = wvtable_new(wf, n);
+		wt->swindex = wf->wf_ntables;
+		wt->swval = swvals[table[first]];
+		if(ss->nsweepparam == 1)
+			wt->name = g_strdup(ss->spar[0].name);
+		else
+			wt->name = g_strdup_printf("tbl%d", wf->wf_ntables + 1);
+		wds_set_range(wt->iv->wds, 0, n, iv + first, 1);
+		for(i = 0; i < ss->ndv; i++) {
+			dv = &wt->dv[i];
+			for(j = 0; j < dv->wv_ncols; j++)
+				wds_set_range(&dv->wds[j], 0, n,
+				      dvals + first * ncols + dv->sv->col - 1 + j,
+				      ncols);
+		}
+		wt->nvalues = n;
+		wt_trim(wt);
+		g_ptr_array_add(wf->tables, wt);
+	}
+
+	g_free(iv);
+	g_free(dvals);
+	g_free(table);
+	g_free(swvals);
+	return wf;
+}
+
+/*
+ * Return a new WaveFile with no variables or rows, to stand for a file
+ * whose header hasn't been read yet, until wf_load_preview() returns one.
+ */
+WaveFile *
+wf_load_empty(WFLoad *ld)
+{
+	WaveFile *wf;
+
+	wf = g_new0(WaveFile, 1);
+	wf->ss = ss_new(NULL, ld->name, 0, 0);
+	wf->tables = g_ptr_array_new();
+	wf->dstype = WDS_DOUBLE;
+	return wf;
+}
+
+/*
+ * Wait for a load to finish, free the WFLoad, and return the WaveFile
+ * read, or NULL if it couldn't be read or the load was cancelled.
+ * A load still in the queue is read now, on this thread.
+ */
+WaveFile *
+wf_load_finish(WFLoad *ld)
+{
+	WaveFile *wf;
+	int queued;
+
+	ss_lock();
+	queued = ld->queued;
+	wfl_dequeue(ld);
+	ss_unlock();
+	if(queued)
+		wfl_thread(ld);
+	if(ld->thread)
+		ss_thread_join(ld->thread);
+	wf = ld->wf;
+	if(ld->hdr)
+		ss_delete(ld->hdr);
+	g_free(ld->iv);
+	g_free(ld->dv);
+	g_free(ld->table);
+	g_free(ld->swvals);
+	g_free(ld->name);
+	g_free(ld->format);
+	g_free(ld);
+	return wf;
+}
+
+/*
+ * The flag that wf_load_cancel() sets, for the reading thread to pass to
+ * ss_fopen_cancel(), so that decompressing a file can be cancelled too.
+ */
+int *
+wfl_cancel_flag(WFLoad *ld)
+{
+	return &ld->cancel;
+}
+
+/*
+ * Called by the reading thread, from wf_finish_read(), once the header of
+ * the file has been read.
+ */
+void
+wfl_header(WFLoad *ld, SpiceStream *ss)
+{
+	SpiceStream *hdr;
+	struct stat st;
+	SSIndex size = 0;
+
+	hdr = wfl_copy_header(ss);
+	if(ss->map)
+		size = ss->mapsize;
+	else if(ss->fp && fstat(fileno(ss->fp), &st) == 0
+		&& S_ISREG(st.st_mode))
+		size = st.st_size;
+
+	ss_lock();
+	ld->hdr = hdr;
+	ld->size = size;
+	ld->pos = ss_tell(ss);
+	ld->iv = g_new(double, WFL_PREVIEW);
+	ld->dv = g_new(double, WFL_PREVIEW * MAX(ss->ncols, 1));
+	ld->table = g_new(int, WFL_PREVIEW);
+	ss_unlock();
+}
+
+/*
+ * Called by the reading thread as each batch of n rows from table is read,
+ * to keep the preview sample and the position up to date.
+ * Returns 0 if the load has been cancelled, else 1.
+ */
+int
+wfl_rows(WFLoad *ld, SpiceStream *ss, int table, double swval,
+	 int n, double *ivals, double *dvals)
+{
+	SSIndex pos = ss_tell(ss);
+	int ncols = ss->ncols;
+	int i, k, rc;
+
+	ss_lock();
+	ld->pos = pos;
+	if(ld->nswvals <= table) {
+		ld->swvals = g_renew(double, ld->swvals, table + 1);
+		while(ld->nswvals <= table)
+			ld->swvals[ld->nswvals++] = swval;
+	}
+	for(i = 0; i < n; i++, ld->nseen++) {
+		if(ld->nseen % ld->step)
+			continue;
+		if(ld->nrows == WFL_PREVIEW) {
+			/* full; keep every other row, and half as many
+			 * from now on */
+			for(k = 0; 2*k < ld->nrows; k++) {
+				ld->iv[k] = ld->iv[2*k];
+				ld->table[k] = ld->table[2*k];
+				memcpy(ld->dv + k * ncols, ld->dv + 2*k * ncols,
+				       ncols * sizeof(double));
+			}
+			ld->nrows = k;
+			ld->step *= 2;
+			if(ld->nseen % ld->step)
+				continue;
+		}
+		k = ld->nrows++;
+		ld->iv[k] = ivals[i];
+		ld->table[k] = table;
+		memcpy(ld->dv + k * ncols, dvals + i * ncols,
+		       ncols * sizeof(double));
+		ld->gen++;
+	}
+	rc = !ld->cancel;
+	ss_unlock();
+	return rc;
+}
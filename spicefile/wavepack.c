@@ -0,0 +1,507 @@
+/*
+ * wavepack.c - lossless compression of WDataSet values.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * Values are packed in independent blocks of WDS_PBLOCK values, each
+ * a bit stream starting with the first value of the block in full.
+ *
+ * WDS_PACK_DOD treats the doubles as 64-bit integers and stores the
+ * difference between successive deltas.  A uniformly-stepped
+ * independent variable costs one bit per value.
+ *
+ * WDS_PACK_XOR64 and WDS_PACK_XOR32 store each value XORed with the
+ * previous one, giving only the bits that changed, in the manner of
+ * Facebook's Gorilla time-series database.  Smooth waveforms change
+ * mostly in the low-order mantissa bits.
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <config.h>
+#include <glib.h>
+#include "wavefile.h"
+
+typedef struct {
+	guchar *buf;
+	int nalloc;	/* bytes allocated */
+	long pos;	/* next bit to read or write */
+} BitStream;
+
+/* cache of recently unpacked blocks */
+#define WDS_NCACHE 16
+typedef struct {
+	WDataSet *ds;
+	SSIndex blk;
+	unsigned long used;
+	double *vals;
+} WDSCacheEnt;
+
+static WDSCacheEnt wds_cache[WDS_NCACHE];
+static unsigned long wds_cache_clock;
+
+static void
+bs_put(BitStream *bs, guint64 v, int nbits)
+{
+	int byte, room, k;
+
+	while(nbits > 0) {
+		byte = bs->pos >> 3;
+		if(byte >= bs->nalloc) {
+			bs->buf = g_realloc(bs->buf, bs->nalloc * 2);
+			memset(bs->buf + bs->nalloc, 0, bs->nalloc);
+			bs->nalloc *= 2;
+		}
+		room = 8 - (bs->pos & 7);
+		k = MIN(room, nbits);
+		bs->buf[byte] |= ((v >> (nbits - k)) & ((1 << k) - 1))
+			<< (room - k);
+		bs->pos += k;
+		nbits -= k;
+	}
+}
+
+static guint64
+bs_get(BitStream *bs, int nbits)
+{
+	guint64 v = 0;
+	int room, k;
+
+	while(nbits > 0) {
+		room = 8 - (bs->pos & 7);
+		k = MIN(room, nbits);
+		v = (v << k) |
+			((bs->buf[bs->pos >> 3] >> (room - k)) & ((1 << k) - 1));
+		bs->pos += k;
+		nbits -= k;
+	}
+	return v;
+}
+
+/* number of leading zero bits in the low w bits of x; x != 0 */
+static int
+nlz(guint64 x, int w)
+{
+	int n = w;
+
+	while(x) {
+		x >>= 1;
+		n--;
+	}
+	return n;
+}
+
+/* number of trailing zero bits in x; x != 0 */
+static int
+ntz(guint64 x)
+{
+	int n = 0;
+
+	while((x & 0xff) == 0) {
+		x >>= 8;
+		n += 8;
+	}
+	while((x & 1) == 0) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * delta-of-delta coding: zigzag-encode the signed difference, then
+ * use a prefix code to select the field width.
+ */
+static void
+put_dod(BitStream *bs, guint64 d)
+{
+	guint64 zz;
+
+	zz = (d << 1) ^ (guint64)((gint64)d >> 63);
+	if(zz == 0) {
+		bs_put(bs, 0, 1);
+	} else if(zz < ((guint64)1 << 7)) {
+		bs_put(bs, 2, 2);
+		bs_put(bs, zz, 7);
+	} else if(zz < ((guint64)1 << 16)) {
+		bs_put(bs, 6, 3);
+		bs_put(bs, zz, 16);
+	} else if(zz < ((guint64)1 << 32)) {
+		bs_put(bs, 14, 4);
+		bs_put(bs, zz, 32);
+	} else {
+		bs_put(bs, 15, 4);
+		bs_put(bs, zz, 64);
+	}
+}
+
+static guint64
+get_dod(BitStream *bs)
+{
+	guint64 zz;
+
+	if(bs_get(bs, 1) == 0)
+		return 0;
+	else if(bs_get(bs, 1) == 0)
+		zz = bs_get(bs, 7);
+	else if(bs_get(bs, 1) == 0)
+		zz = bs_get(bs, 16);
+	else if(bs_get(bs, 1) == 0)
+		zz = bs_get(bs, 32);
+	else
+		zz = bs_get(bs, 64);
+	return (zz >> 1) ^ -(zz & 1);
+}
+
+static void
+pack_dod(BitStream *bs, guint64 *u, int n)
+{
+	guint64 d, pd;
+	int i;
+
+	bs_put(bs, u[0], 64);
+	pd = 0;
+	for(i = 1; i < n; i++) {
+		d = u[i] - u[i-1];
+		put_dod(bs, d - pd);
+		pd = d;
+	}
+}
+
+static void
+unpack_dod(BitStream *bs, guint64 *u, int n)
+{
+	guint64 d;
+	int i;
+
+	u[0] = bs_get(bs, 64);
+	d = 0;
+	for(i = 1; i < n; i++) {
+		d += get_dod(bs);
+		u[i] = u[i-1] + d;
+	}
+}
+
+/*
+ * XOR coding of w-bit values.  A zero XOR is a single 0 bit.
+ * Otherwise "10" means the changed bits fit in the same window as the
+ * last one written, and "11" starts a new window, giving its leading
+ * zero count and length.
+ */
+static void
+pack_xor(BitStream *bs, guint64 *u, int n, int w)
+{
+	guint64 x;
+	int plz = -1;
+	int ptz = 0;
+	int lz, tz, len;
+	int lenbits = (w == 64) ? 6 : 5;
+	int i;
+
+	bs_put(bs, u[0], w);
+	for(i = 1; i < n; i++) {
+		x = u[i] ^ u[i-1];
+		if(x == 0) {
+			bs_put(bs, 0, 1);
+			continue;
+		}
+		lz = nlz(x, w);
+		if(lz > 31)
+			lz = 31;
+		tz = ntz(x);
+		if(plz >= 0 && lz >= plz && tz >= ptz) {
+			bs_put(bs, 2, 2);
+			bs_put(bs, x >> ptz, w - plz - ptz);
+		} else {
+			len = w - lz - tz;
+			bs_put(bs, 3, 2);
+			bs_put(bs, lz, 5);
+			bs_put(bs, len - 1, lenbits);
+			bs_put(bs, x >> tz, len);
+			plz = lz;
+			ptz = tz;
+		}
+	}
+}
+
+static void
+unpack_xor(BitStream *bs, guint64 *u, int n, int w)
+{
+	int plz = 0;
+	int ptz = 0;
+	int len;
+	int lenbits = (w == 64) ? 6 : 5;
+	int i;
+
+	u[0] = bs_get(bs, w);
+	for(i = 1; i < n; i++) {
+		if(bs_get(bs, 1) == 0) {
+			u[i] = u[i-1];
+			continue;
+		}
+		if(bs_get(bs, 1) == 1) {
+			plz = bs_get(bs, 5);
+			len = bs_get(bs, lenbits) + 1;
+			ptz = w - plz - len;
+		}
+		u[i] = u[i-1] ^ (bs_get(bs, w - plz - ptz) << ptz);
+	}
+}
+
+/*
+ * number of values in block blk of a packed dataset.
+ */
+static int
+wds_block_len(WDataSet *ds, SSIndex blk)
+{
+	return MIN(WDS_PBLOCK, ds->nalloc - blk * WDS_PBLOCK);
+}
+
+/*
+ * unpack block blk of a packed dataset into vals, as doubles.
+ */
+static void
+wds_unpack_block(WDataSet *ds, SSIndex blk, double *vals)
+{
+	BitStream bs;
+	guint64 u[WDS_PBLOCK];
+	union { guint64 u; double d; } du;
+	union { guint32 u; float f; } fu;
+	int i, n;
+
+	n = wds_block_len(ds, blk);
+	bs.buf = ds->pblock[blk];
+	bs.pos = 0;
+	switch(ds->pmethod) {
+	case WDS_PACK_DOD:
+		unpack_dod(&bs, u, n);
+		break;
+	case WDS_PACK_XOR64:
+		unpack_xor(&bs, u, n, 64);
+		break;
+	case WDS_PACK_XOR32:
+		unpack_xor(&bs, u, n, 32);
+		for(i = 0; i < n; i++) {
+			fu.u = u[i];
+			vals[i] = fu.f;
+		}
+		return;
+	}
+	for(i = 0; i < n; i++) {
+		du.u = u[i];
+		vals[i] = du.d;
+	}
+}
+
+/*
+ * forget any cached blocks belonging to a dataset.
+ */
+static void
+wds_cache_forget(WDataSet *ds)
+{
+	int i;
+
+	ss_lock();
+	for(i = 0; i < WDS_NCACHE; i++)
+		if(wds_cache[i].ds == ds)
+			wds_cache[i].ds = NULL;
+	ss_unlock();
+}
+
+/*
+ * Return a pointer to the unpacked values of block blk of a packed
+ * dataset, unpacking it into the cache if it isn't there already.
+ * The pointer is only good until the next call.
+ * The cache is shared by all datasets, so callers must hold ss_lock().
+ */
+double *
+wds_get_block(WDataSet *ds, SSIndex blk)
+{
+	static int last;
+	WDSCacheEnt *ce;
+	int i, victim;
+
+	ce = &wds_cache[last];
+	if(ce->ds == ds && ce->blk == blk) {
+		ce->used = ++wds_cache_clock;
+		return ce->vals;
+	}
+
+	victim = 0;
+	for(i = 0; i < WDS_NCACHE; i++) {
+		ce = &wds_cache[i];
+		if(ce->ds == ds && ce->blk == blk) {
+			ce->used = ++wds_cache_clock;
+			last = i;
+			return ce->vals;
+		}
+		if(ce->ds == NULL || ce->used < wds_cache[victim].used)
+			victim = i;
+	}
+
+	ce = &wds_cache[victim];
+	if(ce->vals == NULL)
+		ce->vals = g_new(double, WDS_PBLOCK);
+	wds_unpack_block(ds, blk, ce->vals);
+	ce->ds = ds;
+	ce->blk = blk;
+	ce->used = ++wds_cache_clock;
+	last = victim;
+	return ce->vals;
+}
+
+/*
+ * Pack the values in a dataset using the specified method.
+ * WDS_PACK_XOR32 is used in place of WDS_PACK_XOR64 for single-precision
+ * datasets, and WDS_PACK_DOD can only be used for double precision.
+ * The dataset is left alone if packing wouldn't make it smaller.
+ * Returns 1 if the dataset was packed, else 0.
+ */
+int
+wds_pack(WDataSet *ds, int method)
+{
+	BitStream bs;
+	guint64 u[WDS_PBLOCK];
+	union { double d; guint64 u; } du;
+	union { float f; guint32 u; } fu;
+	guchar **pblock;
+	gint64 psize, rawsize;
+	SSIndex nblocks, blk;
+	int n, i;
+
+	if((ds->dstype != WDS_DOUBLE && ds->dstype != WDS_FLOAT)
+	   || ds->nalloc < 2)
+		return 0;
+	if(ds->dstype == WDS_FLOAT) {
+		method = WDS_PACK_XOR32;
+		rawsize = ds->nalloc * sizeof(float);
+	} else {
+		if(method == WDS_PACK_XOR32)
+			method = WDS_PACK_XOR64;
+		rawsize = ds->nalloc * sizeof(double);
+	}
+
+	nblocks = (ds->nalloc + WDS_PBLOCK - 1) / WDS_PBLOCK;
+	pblock = g_new(guchar *, nblocks);
+	psize = 0;
+	for(blk = 0; blk < nblocks; blk++) {
+		n = MIN(WDS_PBLOCK, ds->nalloc - blk * WDS_PBLOCK);
+		for(i = 0; i < n; i++) {
+			if(ds->dstype == WDS_FLOAT) {
+				fu.f = ds->fptr[blk * WDS_PBLOCK + i];
+				u[i] = fu.u;
+			} else {
+				du.d = ds->dptr[blk * WDS_PBLOCK + i];
+				u[i] = du.u;
+			}
+		}
+		bs.nalloc = 64;
+		bs.buf = g_new0(guchar, bs.nalloc);
+		bs.pos = 0;
+		if(method == WDS_PACK_DOD)
+			pack_dod(&bs, u, n);
+		else
+			pack_xor(&bs, u, n, (method == WDS_PACK_XOR32) ? 32 : 64);
+		n = (bs.pos + 7) >> 3;
+		pblock[blk] = g_realloc(bs.buf, n);
+		psize += n;
+	}
+
+	if(psize >= rawsize) {
+		for(blk = 0; blk < nblocks; blk++)
+			g_free(pblock[blk]);
+		g_free(pblock);
+		return 0;
+	}
+
+	wds_free_storage(ds);
+	ds->pblock = pblock;
+	ds->nblocks = nblocks;
+	ds->psize = psize;
+	ds->pmethod = method;
+	ds->dstype = WDS_PACKED;
+	return 1;
+}
+
+/*
+ * Unpack a packed dataset back into an array of doubles or floats,
+ * according to how it was stored before it was packed.
+ */
+void
+wds_unpack(WDataSet *ds)
+{
+	double *vals;
+	SSIndex blk;
+	int i, n;
+
+	if(ds->dstype != WDS_PACKED)
+		return;
+	if(ds->pmethod == WDS_PACK_XOR32) {
+		vals = g_new(double, WDS_PBLOCK);
+		ds->fptr = g_new(float, ds->nalloc);
+		for(blk = 0; blk < ds->nblocks; blk++) {
+			n = wds_block_len(ds, blk);
+			wds_unpack_block(ds, blk, vals);
+			for(i = 0; i < n; i++)
+				ds->fptr[blk * WDS_PBLOCK + i] = vals[i];
+		}
+		g_free(vals);
+		ds->dstype = WDS_FLOAT;
+	} else {
+		ds->dptr = g_new(double, ds->nalloc);
+		for(blk = 0; blk < ds->nblocks; blk++)
+			wds_unpack_block(ds, blk, ds->dptr + blk * WDS_PBLOCK);
+		ds->dstype = WDS_DOUBLE;
+	}
+	wds_free_packed(ds);
+}
+
+/*
+ * Free a packed dataset's blocks.  Called from wf_free_dataset.
+ */
+void
+wds_free_packed(WDataSet *ds)
+{
+	SSIndex blk;
+
+	wds_cache_forget(ds);
+	for(blk = 0; blk < ds->nblocks; blk++)
+		g_free(ds->pblock[blk]);
+	g_free(ds->pblock);
+	ds->pblock = NULL;
+	ds->nblocks = 0;
+	ds->psize = 0;
+}
+
+/*
+ * pack all of the datasets in a completed WvTable.
+ */
+void
+wt_pack(WvTable *wt)
+{
+	int i, j;
+
+	wds_pack(wt->iv->wds, WDS_PACK_DOD);
+	for(i = 0; i < wt->wt_ndv; i++)
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wds_pack(&wt->dv[i].wds[j], WDS_PACK_XOR64);
+}
@@ -0,0 +1,386 @@
+/*
+ * wavepage.c - paged WDataSet storage, for files bigger than memory.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * The values of a WDS_PAGED dataset are kept in pages of WDS_PAGE values.
+ * All of the resident pages, from all datasets, are kept on a single
+ * list in order of use.  When the memory they take up would exceed the
+ * budget set with wds_set_budget(), the least recently used ones are
+ * written to an anonymous temporary spill file and freed, to be read
+ * back in when they are next touched.
+ * The list and the spill file are shared, so the functions here that
+ * use them hold ss_lock() while they do.
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <config.h>
+#include <sys/types.h>
+#include <glib.h>
+#include "wavefile.h"
+
+struct _WDSPage {
+	void *buf;	/* values, if resident, else NULL */
+	int nbytes;	/* size of buf */
+	off_t off;	/* location in spill file, or -1 if never written */
+	int dirty;	/* changed since it was last written */
+	WDSPage *prev;	/* list of resident pages, most recently used first */
+	WDSPage *next;
+};
+
+/* all spill file slots are big enough for a page of doubles */
+#define SLOTSIZE	(WDS_PAGE * sizeof(double))
+
+static gint64 wds_budget;		/* in bytes; 0 for no limit */
+static gint64 wds_resident;	/* bytes in resident pages */
+static WDSPage *lru_head;
+static WDSPage *lru_tail;
+
+static FILE *spill_fp;
+static off_t spill_end;
+static off_t *spill_free;	/* stack of free slots */
+static int spill_nfree;
+static int spill_free_alloc;
+
+static void wds_page_make_room(int nbytes);
+
+/*
+ * Set the limit on the memory used by the values of paged datasets,
+ * in bytes.  0 means no limit.
+ */
+void
+wds_set_budget(gint64 bytes)
+{
+	ss_lock();
+	wds_budget = bytes;
+	wds_page_make_room(0);
+	ss_unlock();
+}
+
+gint64
+wds_get_budget(void)
+{
+	return wds_budget;
+}
+
+static void
+lru_unlink(WDSPage *pg)
+{
+	if(pg->prev)
+		pg->prev->next = pg->next;
+	else
+		lru_head = pg->next;
+	if(pg->next)
+		pg->next->prev = pg->prev;
+	else
+		lru_tail = pg->prev;
+	pg->prev = pg->next = NULL;
+}
+
+static void
+lru_push(WDSPage *pg)
+{
+	pg->prev = NULL;
+	pg->next = lru_head;
+	if(lru_head)
+		lru_head->prev = pg;
+	lru_head = pg;
+	if(lru_tail == NULL)
+		lru_tail = pg;
+}
+
+static off_t
+spill_slot_alloc(void)
+{
+	off_t off;
+
+	if(spill_nfree > 0)
+		return spill_free[--spill_nfree];
+	off = spill_end;
+	spill_end += SLOTSIZE;
+	return off;
+}
+
+static void
+spill_slot_free(off_t off)
+{
+	if(spill_nfree >= spill_free_alloc) {
+		spill_free_alloc = MAX(64, spill_free_alloc * 2);
+		spill_free = g_renew(off_t, spill_free, spill_free_alloc);
+	}
+	spill_free[spill_nfree++] = off;
+}
+
+/*
+ * write a page to the spill file.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+spill_write(WDSPage *pg)
+{
+	if(spill_fp == NULL) {
+		spill_fp = ss_tmpfile();
+		if(spill_fp == NULL) {
+			ss_msg(ERR, "wds_page", "can't create spill file in %s: %s",
+			       g_get_tmp_dir(), strerror(errno));
+			return -1;
+		}
+	}
+	if(pg->off < 0)
+		pg->off = spill_slot_alloc();
+	if(pwrite(fileno(spill_fp), pg->buf, pg->nbytes, pg->off)
+	   != pg->nbytes) {
+		ss_msg(ERR, "wds_page", "writing spill file: %s",
+		       strerror(errno));
+		return -1;
+	}
+	pg->dirty = 0;
+	return 0;
+}
+
+/*
+ * Evict least-recently-used pages until there is room for nbytes more
+ * within the budget.
+ * If the spill file can't be written, we go over the budget rather
+ * than lose data.
+ */
+static void
+wds_page_make_room(int nbytes)
+{
+	static int warned;
+	WDSPage *pg;
+
+	if(wds_budget <= 0)
+		return;
+	while(wds_resident + nbytes > wds_budget && lru_tail) {
+		pg = lru_tail;
+		if((pg->dirty || pg->off < 0) && spill_write(pg) < 0) {
+			if(!warned)
+				ss_msg(WARN, "wds_page", "exceeding memory budget");
+			warned = 1;
+			break;
+		}
+		lru_unlink(pg);
+		g_free(pg->buf);
+		pg->buf = NULL;
+		wds_resident -= pg->nbytes;
+	}
+}
+
+/*
+ * initialize a dataset for paged storage of values of size esize.
+ */
+void
+wds_init_paged(WDataSet *ds, int esize)
+{
+	ds->min = G_MAXDOUBLE;
+	ds->max = -G_MAXDOUBLE;
+	ds->dstype = WDS_PAGED;
+	ds->pesize = esize;
+	ds->pages = NULL;
+	ds->npages = 0;
+	ds->nalloc = 0;
+	ds->plost = 0;
+}
+
+static void
+wds_page_fill_nan(WDataSet *ds, void *buf)
+{
+	int i;
+
+	for(i = 0; i < WDS_PAGE; i++) {
+		if(ds->pesize == sizeof(float))
+			((float *)buf)[i] = NAN;
+		else
+			((double *)buf)[i] = NAN;
+	}
+}
+
+/*
+ * Return the values in page pgno of a paged dataset, reading it back in
+ * if needed.  Asking for the page just past the end adds a new one.
+ * If a page can't be read back its values are NaN, and it is counted in
+ * ds->plost; being clean, it is read again the next time it is paged in.
+ */
+static void *
+wds_page_buf(WDataSet *ds, SSIndex pgno)
+{
+	WDSPage *pg;
+
+	if(pgno == ds->npages) {
+		pg = g_new0(WDSPage, 1);
+		pg->off = -1;
+		pg->nbytes = ds->pesize * WDS_PAGE;
+		pg->dirty = 1;
+		wds_page_make_room(pg->nbytes);
+		pg->buf = g_malloc(pg->nbytes);
+		wds_resident += pg->nbytes;
+		lru_push(pg);
+		ds->pages = g_renew(WDSPage *, ds->pages, ds->npages + 1);
+		ds->pages[ds->npages++] = pg;
+		ds->nalloc = ds->npages * WDS_PAGE;
+		return pg->buf;
+	}
+
+	g_assert(pgno < ds->npages);
+	pg = ds->pages[pgno];
+	if(pg->buf == NULL) {
+		wds_page_make_room(pg->nbytes);
+		pg->buf = g_malloc(pg->nbytes);
+		errno = 0;
+		if(pread(fileno(spill_fp), pg->buf, pg->nbytes, pg->off)
+		   != pg->nbytes) {
+			ss_msg(ERR, "wds_page", "reading spill file: %s; %d values lost",
+			       errno ? strerror(errno) : "short read", WDS_PAGE);
+			wds_page_fill_nan(ds, pg->buf);
+			ds->plost++;
+		}
+		wds_resident += pg->nbytes;
+		lru_push(pg);
+	} else if(pg != lru_head) {
+		lru_unlink(pg);
+		lru_push(pg);
+	}
+	return pg->buf;
+}
+
+double
+wds_page_get(WDataSet *ds, SSIndex n)
+{
+	void *buf;
+	double v;
+
+	ss_lock();
+	buf = wds_page_buf(ds, n / WDS_PAGE);
+	if(ds->pesize == sizeof(float))
+		v = ((float *)buf)[n % WDS_PAGE];
+	else
+		v = ((double *)buf)[n % WDS_PAGE];
+	ss_unlock();
+	return v;
+}
+
+/*
+ * store a value in a paged dataset, returning the value as stored.
+ */
+double
+wds_page_set(WDataSet *ds, SSIndex n, double val)
+{
+	void *buf;
+
+	ss_lock();
+	buf = wds_page_buf(ds, n / WDS_PAGE);
+	ds->pages[n / WDS_PAGE]->dirty = 1;
+	if(ds->pesize == sizeof(float))
+		val = ((float *)buf)[n % WDS_PAGE] = val;
+	else
+		val = ((double *)buf)[n % WDS_PAGE] = val;
+	ss_unlock();
+	return val;
+}
+
+/*
+ * store n values starting at start, as for wds_set_range().
+ */
+void
+wds_page_set_range(WDataSet *ds, SSIndex start, int n, double *vals,
+		   int stride)
+{
+	void *pbuf;
+	double v;
+	int i, j, k, off;
+
+	ss_lock();
+	for(i = 0; i < n; i += k) {
+		pbuf = wds_page_buf(ds, (start + i) / WDS_PAGE);
+		ds->pages[(start + i) / WDS_PAGE]->dirty = 1;
+		off = (start + i) % WDS_PAGE;
+		k = MIN(n - i, WDS_PAGE - off);
+		for(j = 0; j < k; j++) {
+			if(ds->pesize == sizeof(float))
+				v = ((float *)pbuf)[off + j] = vals[(i + j) * stride];
+			else
+				v = ((double *)pbuf)[off + j] = vals[(i + j) * stride];
+			if(v < ds->min)
+				ds->min = v;
+			if(v > ds->max)
+				ds->max = v;
+		}
+	}
+	ss_unlock();
+}
+
+/*
+ * copy n values starting at start into buf, as for wds_get_range().
+ */
+double *
+wds_page_range(WDataSet *ds, SSIndex start, int n, double *buf)
+{
+	void *pbuf;
+	int i, j, k, off;
+
+	ss_lock();
+	for(i = 0; i < n; i += k) {
+		pbuf = wds_page_buf(ds, (start + i) / WDS_PAGE);
+		off = (start + i) % WDS_PAGE;
+		k = MIN(n - i, WDS_PAGE - off);
+		if(ds->pesize == sizeof(float)) {
+			for(j = 0; j < k; j++)
+				buf[i + j] = ((float *)pbuf)[off + j];
+		} else {
+			memcpy(buf + i, (double *)pbuf + off,
+			       k * sizeof(double));
+		}
+	}
+	ss_unlock();
+	return buf;
+}
+
+/*
+ * free all of the pages of a paged dataset.
+ */
+void
+wds_free_paged(WDataSet *ds)
+{
+	WDSPage *pg;
+	SSIndex i;
+
+	ss_lock();
+	for(i = 0; i < ds->npages; i++) {
+		pg = ds->pages[i];
+		if(pg->buf) {
+			lru_unlink(pg);
+			g_free(pg->buf);
+			wds_resident -= pg->nbytes;
+		}
+		if(pg->off >= 0)
+			spill_slot_free(pg->off);
+		g_free(pg);
+	}
+	g_free(ds->pages);
+	ds->pages = NULL;
+	ds->npages = 0;
+	ss_unlock();
+}
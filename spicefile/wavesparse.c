@@ -0,0 +1,193 @@
+/*
+ * wavesparse.c - sparse WDataSet storage, for the outputs of event-driven
+ * simulators, in which few values change from one row to the next.
+ *
+ * Copyright 1999, Stephen G. Tell.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * A WDS_SPARSE dataset holds a piecewise-constant variable as a list of
+ * its changes: the row at which each new value starts, and the value,
+ * which holds until the next change.  Its memory follows the number of
+ * changes rather than the number of rows, so that a file with many
+ * nodes, few of which change at each time step, takes up little more
+ * than its independent variable.  A value is found by a binary search
+ * of the changes.
+ *
+ * nalloc is the number of rows the dataset covers.  Rows are added in
+ * order, as they are read; writing over one that is already there turns
+ * the dataset into an ordinary array of doubles first.
+ */
+
+#include "ssintern.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <config.h>
+#include <glib.h>
+#include "wavefile.h"
+
+/*
+ * initialize a dataset for sparse storage.
+ */
+void
+wds_init_sparse(WDataSet *ds)
+{
+	ds->min = G_MAXDOUBLE;
+	ds->max = -G_MAXDOUBLE;
+	ds->dstype = WDS_SPARSE;
+	ds->nchanges = 0;
+	ds->challoc = DS_INITSIZE;
+	ds->crow = g_new(SSIndex, ds->challoc);
+	ds->cval = g_new(double, ds->challoc);
+	ds->nalloc = 0;
+}
+
+/*
+ * Return the index of the change in effect at row n of a sparse dataset:
+ * the last one at or before it.
+ */
+SSIndex
+wds_sparse_find(WDataSet *ds, SSIndex n)
+{
+	SSIndex a, b, m;
+
+	a = 0;
+	b = ds->nchanges;
+	while(a + 1 < b) {
+		m = a + (b - a) / 2;
+		if(ds->crow[m] <= n)
+			a = m;
+		else
+			b = m;
+	}
+	return a;
+}
+
+double
+wds_sparse_get(WDataSet *ds, SSIndex n)
+{
+	if(ds->nchanges == 0)
+		return 0.0;
+	return ds->cval[wds_sparse_find(ds, n)];
+}
+
+/*
+ * add rows start to start+n-1 to the end of a sparse dataset, from
+ * vals[0], vals[stride] ..., as for wds_set_range().  Only the values
+ * that differ from the one before are stored.
+ * Rows that are skipped over keep the value before them.
+ */
+void
+wds_sparse_set_range(WDataSet *ds, SSIndex start, int n, double *vals,
+		     int stride)
+{
+	double v, last;
+	SSIndex k;
+	int i;
+
+	g_assert(start >= ds->nalloc);
+	k = ds->nchanges;
+	last = k ? ds->cval[k - 1] : 0.0;
+	for(i = 0; i < n; i++) {
+		v = vals[i * stride];
+		if(k > 0 && v == last)
+			continue;
+		if(k == ds->challoc) {
+			ds->challoc *= 2;
+			ds->crow = g_renew(SSIndex, ds->crow, ds->challoc);
+			ds->cval = g_renew(double, ds->cval, ds->challoc);
+		}
+		ds->crow[k] = start + i;
+		ds->cval[k] = last = v;
+		k++;
+		if(v < ds->min)
+			ds->min = v;
+		if(v > ds->max)
+			ds->max = v;
+	}
+	ds->nchanges = k;
+	ds->nalloc = start + n;
+}
+
+/*
+ * copy n values starting at start into buf, as for wds_get_range().
+ */
+double *
+wds_sparse_range(WDataSet *ds, SSIndex start, int n, double *buf)
+{
+	SSIndex k;
+	int i;
+
+	if(ds->nchanges == 0) {
+		memset(buf, 0, n * sizeof(double));
+		return buf;
+	}
+	k = wds_sparse_find(ds, start);
+	for(i = 0; i < n; i++) {
+		while(k + 1 < ds->nchanges && ds->crow[k + 1] <= start + i)
+			k++;
+		buf[i] = ds->cval[k];
+	}
+	return buf;
+}
+
+/*
+ * shrink a sparse dataset's list of changes to fit, once it is complete.
+ */
+void
+wds_trim_sparse(WDataSet *ds)
+{
+	ds->challoc = MAX(ds->nchanges, 1);
+	ds->crow = g_renew(SSIndex, ds->crow, ds->challoc);
+	ds->cval = g_renew(double, ds->cval, ds->challoc);
+}
+
+/*
+ * turn a sparse dataset into an array of doubles, so that rows already
+ * in it can be written over.
+ */
+void
+wds_unsparse(WDataSet *ds)
+{
+	double *dp;
+	SSIndex i;
+	int n;
+
+	if(ds->dstype != WDS_SPARSE)
+		return;
+	dp = g_new(double, MAX(ds->nalloc, 1));
+	for(i = 0; i < ds->nalloc; i += n) {
+		n = MIN(ds->nalloc - i, WDS_CHUNK);
+		wds_sparse_range(ds, i, n, dp + i);
+	}
+	wds_free_sparse(ds);
+	ds->dptr = dp;
+	ds->dstype = WDS_DOUBLE;
+	ds->nalloc = MAX(ds->nalloc, 1);
+}
+
+void
+wds_free_sparse(WDataSet *ds)
+{
+	g_free(ds->crow);
+	g_free(ds->cval);
+	ds->crow = NULL;
+	ds->cval = NULL;
+	ds->nchanges = ds->challoc = 0;
+}
@@ -264,6 +264,8 @@ update_wfile_waves(GWDataFile *wdata)
 	VWListItem *vdi;
 	struct wp_file_pkg foo;
 	WaveVar  *wv;
+	GList *l;
+	char *want;
 	int foundone = 0;
 
 	foo.gdf = wdata;
@@ -277,11 +279,30 @@ update_wfile_waves(GWDataFile *wdata)
 		g_list_foreach(wp->vwlist, vw_list_if_wfile, &foo);
 	}
 
+	/* if the new file was read lazily, load all of the variables
+	 * we need in a single pass.
+	 */
+	if(wdata->wf->dvload) {
+		want = g_new0(char, wdata->wf->wf_ndv + 1);
+		for(l = vw_delete_list; l; l = l->next) {
+			vdi = (VWListItem *)l->data;
+			wv = wf_find_variable(wdata->wf, 
+				      vdi->vw->var->wv_name,
+				      vdi->vw->var->wtable->swindex);
+			if(wv)
+				want[wv - wv->wtable->dv] = 1;
+		}
+		wf_load_vars(wdata->wf, want);
+		g_free(want);
+	}
+
 	while((vdi = g_list_nth_data(vw_delete_list, 0)) != NULL) {
 		foundone = 1;
 		wv = wf_find_variable(wdata->wf, 
 				      vdi->vw->var->wv_name,
 				      vdi->vw->var->wtable->swindex);
+		if(wv && wv_is_lazy(wv))
+			wv = NULL;	/* failed to load it */
 		if(wv) {
 			/* printf("updated variable %s to %lx\n", vdi->vw->varname, wdata->wf); */
 			vdi->vw->gdf = wdata;
@@ -311,6 +332,78 @@ update_wfile_waves(GWDataFile *wdata)
 	}
 }
 
+/*
+ * Remove from the panels all waves showing variables of any of the
+ * WvTables in tables, which a reload of their file has dropped.
+ */
+void
+remove_wtable_waves(GPtrArray *tables)
+{
+	WavePanel *wp;
+	VisibleWave *vw;
+	GList *l;
+	int i, j;
+
+	for(i = 0; i < wtable->npanels; i++) {
+		wp = wtable->panels[i];
+		for(l = wp->vwlist; l; ) {
+			vw = (VisibleWave *)l->data;
+			l = l->next;
+			for(j = 0; j < tables->len; j++)
+				if(vw->var->wtable == g_ptr_array_index(tables, j)) {
+					remove_wave_from_panel(wp, vw);
+					break;
+				}
+		}
+	}
+}
+
+/*
+ * update the display after the data of a file has changed in place:
+ * rows have been added to a file being followed or reloaded, or it
+ * has been read again.
+ * old_end is the last x value of the file before rows were added,
+ * or -G_MAXDOUBLE if any of its data may have changed.
+ * Panels showing the file whose scales haven't changed only have
+ * the part right of old_end redrawn.
+ */
+void
+update_wfile_follow(GWDataFile *wdata, double old_end)
+{
+	WavePanel *wp;
+	GList *l;
+	double *oldv;
+	int i, shown;
+
+	oldv = g_new(double, 4 * MAX(wtable->npanels, 1));
+	for(i = 0; i < wtable->npanels; i++) {
+		wp = wtable->panels[i];
+		oldv[4*i] = wp->start_xval;
+		oldv[4*i+1] = wp->end_xval;
+		oldv[4*i+2] = wp->start_yval;
+		oldv[4*i+3] = wp->end_yval;
+		wavepanel_update_data(wp);
+	}
+	wtable->suppress_redraw = 1;
+	wavetable_update_data();
+	wtable->suppress_redraw = 0;
+
+	for(i = 0; i < wtable->npanels; i++) {
+		wp = wtable->panels[i];
+		for(shown = 0, l = wp->vwlist; l && !shown; l = l->next)
+			shown = (((VisibleWave *)l->data)->gdf == wdata);
+		if(oldv[4*i] != wp->start_xval || oldv[4*i+1] != wp->end_xval
+		   || oldv[4*i+2] != wp->start_yval
+		   || oldv[4*i+3] != wp->end_yval)
+			draw_wavepanel(wp->drawing, NULL, wp);
+		else if(shown)
+			draw_wavepanel_from(wp, old_end);
+	}
+	g_free(oldv);
+	draw_labels(wtable);
+	mbtn_update_all();
+}
+
 SCM_DEFINE(wavepanel_add_variable_x, "wavepanel-add-variable!", 2, 0, 0,
 	   (SCM wavepanel, SCM var),
 	   "Add variable VAR to the display in WAVEPANEL.")
@@ -346,6 +439,9 @@ add_var_to_panel(WavePanel *wp, WaveVar *dv)
 		}
 	}
 
+	if(wv_is_lazy(dv) && wv_load(dv) < 0)
+		return SCM_BOOL_F;
+
 	vw = g_new0(VisibleWave, 1);
 	vw->wp = wp;
 	vw->var = dv;
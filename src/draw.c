@@ -190,6 +190,7 @@ struct wavedraw_method {
 
 void vw_wp_draw_ppixel(VisibleWave *vw, WavePanel *wp);
 void vw_wp_draw_lineclip(VisibleWave *vw, WavePanel *wp);
+void vw_wp_draw_steps(VisibleWave *vw, WavePanel *wp);
 
 struct wavedraw_method wavedraw_method_tab[] = {
 	vw_wp_draw_ppixel, "per-pixel",
@@ -198,6 +199,9 @@ struct wavedraw_method wavedraw_method_tab[] = {
 
 const int n_wavedraw_methods = sizeof(wavedraw_method_tab)/sizeof(struct wavedraw_method);
 
+/* while draw_wavepanel_from() is drawing, the x value to draw from */
+static double draw_from_xval = -G_MAXDOUBLE;
+
 
 /*
  * We know how to do this right, but working on other things has taken
@@ -235,7 +239,10 @@ vw_wp_visit_draw(VisibleWave *vw, WavePanel *wp)
                                             1, GDK_LINE_SOLID, GDK_CAP_BUTT,
                                             GDK_JOIN_ROUND);
 	
-	(wavedraw_method_tab[1].func)(vw, wp);
+	if(vw->var->wds[0].dstype == WDS_SPARSE)
+		vw_wp_draw_steps(vw, wp);
+	else
+		(wavedraw_method_tab[1].func)(vw, wp);
 }
 
 /* finish what we started in vw_wp_visit_draw(),
@@ -253,7 +260,7 @@ vw_wp_draw_ppixel(VisibleWave *vw, WavePanel *wp)
 {
 	int x0, x1;
 	int y0, y1;
-	int i;
+	SSIndex i;
 	double xstep;
 	double xval;
 	double yval;
@@ -411,51 +418,102 @@ vw_wp_draw_lineclip(VisibleWave *vw, WavePanel *wp)
 {
 	int x0, x1;
 	int y0, y1;
-	int i;
+	SSIndex i;
 	double xstep;
 	double xval;
 	double yval;
         double xval0, yval0, xval1, yval1;
         double xval0d, yval0d, xval1d, yval1d;
 
-        xval1 = wds_get_point(&vw->var->wv_iv->wds[0], 0);
-        yval1 = wds_get_point(&vw->var->wds[0], 0);
-
-        for(i = 1; i < vw->var->wtable->nvalues; i++) {
-                xval0d = xval1;
-                yval0d = yval1;
-                xval1d = xval1 = wds_get_point(&vw->var->wv_iv->wds[0], i);
-                yval1d = yval1 = wds_get_point(&vw->var->wds[0], i);
-
-                if(line_clip(&xval0d, &yval0d, &xval1d, &yval1d,
-                             wp->start_xval, wp->start_yval,
-                             wp->end_xval, wp->end_yval))  {
-                        x0 = val2x(wp, xval0d, wtable->logx);
-                        y0 = val2y(wp, yval0d);
-                        x1 = val2x(wp, xval1d, wtable->logx);
-                        y1 = val2y(wp, yval1d);
-                        if(x0 != x1 || y0 != y1)
-                                gdk_draw_line(wp->pixmap, vw->gc, x0,y0, x1,y1);
-                }
+	WDataSet *ivds = &vw->var->wv_iv->wds[0];
+	WDataSet *dvds = &vw->var->wds[0];
+	double xbuf[WDS_CHUNK], ybuf[WDS_CHUNK];
+	double *xp, *yp;
+	SSIndex nvalues = vw->var->wtable->nvalues;
+	SSIndex first = 0;
+	int n, j;
+
+	/* only the segments that reach past draw_from_xval, if set */
+	if(draw_from_xval > -G_MAXDOUBLE)
+		first = wf_find_point(vw->var->wv_iv, draw_from_xval);
+
+        xval1 = wds_get_point(ivds, first);
+        yval1 = wds_get_point(dvds, first);
+
+        for(i = first + 1; i < nvalues; i += n) {
+		n = MIN(nvalues - i, WDS_CHUNK);
+		xp = wds_get_range(ivds, i, n, xbuf);
+		yp = wds_get_range(dvds, i, n, ybuf);
+		for(j = 0; j < n; j++) {
+			xval0d = xval1;
+			yval0d = yval1;
+			xval1d = xval1 = xp[j];
+			yval1d = yval1 = yp[j];
+
+			if(line_clip(&xval0d, &yval0d, &xval1d, &yval1d,
+				     wp->start_xval, wp->start_yval,
+				     wp->end_xval, wp->end_yval))  {
+				x0 = val2x(wp, xval0d, wtable->logx);
+				y0 = val2y(wp, yval0d);
+				x1 = val2x(wp, xval1d, wtable->logx);
+				y1 = val2y(wp, yval1d);
+				if(x0 != x1 || y0 != y1)
+					gdk_draw_line(wp->pixmap, vw->gc, x0,y0, x1,y1);
+			}
+		}
         }
 }
 
 /*
- * Repaint all or part of a wavepanel.
+ * draw a sparse, piecewise-constant wave as steps, straight from its list
+ * of changes: a level for as long as each value holds, and an edge where
+ * it changes.  Only the changes in view are visited, so the time taken
+ * follows the number of them rather than the number of rows.
  */
-void 
-draw_wavepanel(GtkWidget *widget, GdkEventExpose *event, WavePanel *wp)
+void
+vw_wp_draw_steps(VisibleWave *vw, WavePanel *wp)
 {
-	int w = widget->allocation.width;
-	int h = widget->allocation.height;
-	int x, y;
-	int i;
+	WaveVar *iv = vw->var->wv_iv;
+	WDataSet *ivds = &iv->wds[0];
+	WDataSet *dvds = &vw->var->wds[0];
+	SSIndex nvalues = vw->var->wtable->nvalues;
+	SSIndex k;
+	double xval0, xval1;
+	int h = wp->drawing->allocation.height;
+	int x0, x1, y0, y1;
+	int edge = 0;	/* whether there is a level before this one */
 
-	if(wp->pixmap == NULL)
+	if(nvalues < 1 || dvds->nchanges < 1)
 		return;
+	k = wds_sparse_find(dvds, wf_find_point(iv, MAX(wp->start_xval,
+							  draw_from_xval)));
+	y0 = 0;
+	for(; k < dvds->nchanges; k++) {
+		xval0 = wds_get_point(ivds, dvds->crow[k]);
+		if(xval0 > wp->end_xval)
+			break;
+		if(k + 1 < dvds->nchanges)
+			xval1 = wds_get_point(ivds, dvds->crow[k + 1]);
+		else
+			xval1 = wds_get_point(ivds, nvalues - 1);
+		x0 = val2x(wp, MAX(xval0, wp->start_xval), wtable->logx);
+		x1 = val2x(wp, MIN(xval1, wp->end_xval), wtable->logx);
+		y1 = CLAMP(val2y(wp, dvds->cval[k]), -1, h);
+		if(edge && xval0 >= wp->start_xval && y0 != y1)
+			gdk_draw_line(wp->pixmap, vw->gc, x0, y0, x0, y1);
+		if(x1 > x0)
+			gdk_draw_line(wp->pixmap, vw->gc, x0, y1, x1, y1);
+		y0 = y1;
+		edge = 1;
+	}
+}
 
-	gdk_draw_rectangle(wp->pixmap, bg_gdk_gc, TRUE, 0,0, w,h);
-
+/*
+ * highlighted outline of a selected wavepanel
+ */
+static void
+draw_wavepanel_outline(WavePanel *wp, int w, int h)
+{
 	if(wp->selected) {
 /*		gdk_draw_line(wp->pixmap, hl_gdk_gc, 0,   0,  w-1, 0);
 		gdk_draw_line(wp->pixmap, hl_gdk_gc, w-1, 0,  w-1, h-1);
@@ -468,27 +526,57 @@ draw_wavepanel(GtkWidget *widget, GdkEventExpose *event, WavePanel *wp)
 		gdk_draw_line(wp->pixmap, hl_gdk_gc, 1,   h-2,  1, 1);
 
 	}
-	/* draw horizontal line at y=zero.  future: do real graticule here */
-	if(wp->start_yval < 0 && wp->end_yval > 0) {
-		y = val2y(wp, 0);
-		gdk_draw_line(wp->pixmap, pg_gdk_gc, 0, y, w, y);
-	}
+}
 
-	/* draw waves */
-	g_list_foreach(wp->vwlist, (GFunc)vw_wp_visit_draw, wp); 
+/*
+ * cursors, drawn over the waves at xmin and right of it.  They are drawn
+ * with XOR, so only where the pixmap has just been repainted.
+ */
+static void
+draw_wavepanel_cursors(WavePanel *wp, int h, int xmin)
+{
+	int i, x;
 
-	/* draw cursors */
 	for(i = 0; i < 2; i++) {			
 		VBCursor *csp = wtable->cursor[i];
 		if(csp->shown) {
 			if(wp->start_xval <= csp->xval 
 			   && csp->xval <= wp->end_xval) {
 				x = val2x(wp, csp->xval, wtable->logx);
-				gdk_draw_line(wp->pixmap, csp->gdk_gc,
-					      x, 0, x, h);
+				if(x >= xmin)
+					gdk_draw_line(wp->pixmap, csp->gdk_gc,
+						      x, 0, x, h);
 			}
 		}
 	}
+}
+
+/*
+ * Repaint all or part of a wavepanel.
+ */
+void 
+draw_wavepanel(GtkWidget *widget, GdkEventExpose *event, WavePanel *wp)
+{
+	int w = widget->allocation.width;
+	int h = widget->allocation.height;
+	int y;
+
+	if(wp->pixmap == NULL)
+		return;
+
+	gdk_draw_rectangle(wp->pixmap, bg_gdk_gc, TRUE, 0,0, w,h);
+
+	draw_wavepanel_outline(wp, w, h);
+	/* draw horizontal line at y=zero.  future: do real graticule here */
+	if(wp->start_yval < 0 && wp->end_yval > 0) {
+		y = val2y(wp, 0);
+		gdk_draw_line(wp->pixmap, pg_gdk_gc, 0, y, w, y);
+	}
+
+	/* draw waves */
+	g_list_foreach(wp->vwlist, (GFunc)vw_wp_visit_draw, wp); 
+
+	draw_wavepanel_cursors(wp, h, 0);
 	/* draw select-range line, if in this WavePanel */
 	if(wtable->srange->drawn && wtable->srange->wp == wp)
 		draw_srange(wtable->srange);
@@ -510,6 +598,47 @@ draw_wavepanel(GtkWidget *widget, GdkEventExpose *event, WavePanel *wp)
 	}
 }
 
+/*
+ * Repaint the part of a wavepanel to the right of xval, after rows have
+ * been added to the waves in it, and its scales haven't changed.
+ * Only the data from xval on is visited, so the cost depends on how much
+ * was added rather than how much there is.
+ * The select-range line is drawn on the window with XOR, across the cut,
+ * so while it is shown the whole panel is drawn instead.
+ */
+void
+draw_wavepanel_from(WavePanel *wp, double xval)
+{
+	GtkWidget *widget = wp->drawing;
+	int w, h, x, y;
+
+	if(wp->pixmap == NULL || xval >= wp->end_xval)
+		return;
+	if(xval <= wp->start_xval
+	   || (wtable->srange->drawn && wtable->srange->wp == wp)) {
+		draw_wavepanel(widget, NULL, wp);
+		return;
+	}
+	w = widget->allocation.width;
+	h = widget->allocation.height;
+	x = val2x(wp, xval, wtable->logx) + 1;
+
+	gdk_draw_rectangle(wp->pixmap, bg_gdk_gc, TRUE, x, 0, w - x, h);
+	if(wp->start_yval < 0 && wp->end_yval > 0) {
+		y = val2y(wp, 0);
+		gdk_draw_line(wp->pixmap, pg_gdk_gc, x, y, w, y);
+	}
+	draw_from_xval = xval;
+	g_list_foreach(wp->vwlist, (GFunc)vw_wp_visit_draw, wp); 
+	draw_from_xval = -G_MAXDOUBLE;
+	draw_wavepanel_outline(wp, w, h);
+	draw_wavepanel_cursors(wp, h, x);
+
+	gdk_draw_pixmap(widget->window,
+			widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
+			wp->pixmap, x, 0, x, 0, w - x, h);
+}
+
 /*
  * update text labeling the waveform graphs' X-axis
  */
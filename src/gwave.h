@@ -146,11 +146,14 @@ extern SCM add_var_to_panel(WavePanel *wp, WaveVar *dv);
 extern void wavepanel_update_data(WavePanel *wp);
 extern void wavetable_update_data();
 extern void update_wfile_waves(GWDataFile *wdata);
+extern void update_wfile_follow(GWDataFile *wdata, double old_end);
+extern void remove_wtable_waves(GPtrArray *tables);
 
 /* defined in draw.c */
 extern void vw_wp_visit_draw(VisibleWave *vw, WavePanel *wp);
 extern void draw_wavepanel(GtkWidget *widget, GdkEventExpose *event,
 			   WavePanel *wp);
+extern void draw_wavepanel_from(WavePanel *wp, double xval);
 extern void draw_labels(WaveTable *wt);
 extern double y2val(WavePanel *wp, int y);
 extern int val2y(WavePanel *wp, double val);
@@ -183,7 +186,8 @@ extern char *wave_drag_ok_xpm[];
 
 /* defined in wavelist.c */
 void cmd_show_wave_list(GtkWidget *widget, GWDataFile *wdata);
-extern GWDataFile *load_wave_file(char *name, char *type);
+extern GWDataFile *load_wave_file(char *name, char *type, char **vars,
+				  int background);
 extern void get_fname_load_file(GtkWidget *w, gpointer d);
 extern void reload_all_wave_files(GtkWidget *w);
 
@@ -60,18 +60,22 @@ vw_wp_visit_export_visible(gpointer p, gpointer d)
 	WavePanel *wp = ((struct visit_export_data *)d)->wp;
 	FILE *fp = ((struct visit_export_data *)d)->fp;
 	WaveVar *dv, *iv;
-	int starti, endi, i;
-	double x,y;
+	SSIndex starti, endi, i;
+	int j, n;
+	double xbuf[WDS_CHUNK], ybuf[WDS_CHUNK];
+	double *xp, *yp;
 
 	dv = vw->var;
 	iv = dv->wv_iv;
 	starti = wf_find_point(iv, wp->start_xval);
 	endi = wf_find_point(iv, wp->end_xval);
 
-	for(i = starti; i <= endi; i++) {
-		x = wds_get_point(&iv->wds[0], i);
-		y = wds_get_point(&dv->wds[0], i);
-		fprintf(fp, "%g %g\n", x, y);
+	for(i = starti; i <= endi; i += n) {
+		n = MIN(endi + 1 - i, WDS_CHUNK);
+		xp = wds_get_range(&iv->wds[0], i, n, xbuf);
+		yp = wds_get_range(&dv->wds[0], i, n, ybuf);
+		for(j = 0; j < n; j++)
+			fprintf(fp, "%g %g\n", xp[j], yp[j]);
 	}
 	fputc('\n', fp);
 }
@@ -165,10 +165,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <gtk/gtk.h>
 #include <guile-gtk.h>
 #include <config.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include <scwm_guile.h>
 #include <gwave.h>
 
@@ -190,11 +195,102 @@ void gwfile_add_wv_to_list(gpointer d /*WaveVar* */,
 
 static gint wavelist_button_click(GtkWidget *widget,
 				  GdkEventButton *event, gpointer data);
+static void replace_wave_file(GWDataFile *wdata, WaveFile *new_wf);
+static void wavefile_update_list(GWDataFile *wdata);
+static void wavefile_load_done(GWDataFile *wdata);
+static void wavefile_follow(GWDataFile *wdata, int on);
+static void wavefile_watch(GWDataFile *wdata);
+static void wavefile_unwatch(GWDataFile *wdata);
+void delete_wave_file(GtkWidget *w, GWDataFile *wdata);
+
+#define LOAD_POLL_MS	250	/* how often to check on a background load */
+#define LOAD_PREVIEW_POLLS 8	/* polls between updates of the preview */
+#define WATCH_POLL_MS	250	/* how often auto-reload looks for settled files */
+
+static int auto_reload = 0;		/* set by auto-reload-files! */
+static guint auto_reload_timer = 0;
+static double auto_reload_polled;	/* when unwatched files were last polled */
+#ifdef HAVE_SYS_INOTIFY_H
+static int inotify_fd = -1;
+static gint inotify_tag;
+#endif
+
+SCM_VARIABLE_INIT(scm_wavefile_single_precision, "wavefile-single-precision", SCM_BOOL_F);
+/*"If this variable is set to #t, the dependent variables in waveform"
+"files loaded afterward are stored in single precision, using half"
+"the memory.  Files that contain only single-precision data are always"
+"stored that way.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_compress, "wavefile-compress", SCM_BOOL_F);
+/*"If this variable is set to #t, the data in waveform files loaded"
+"afterward is kept compressed in memory, and decompressed a block at"
+"a time as it is drawn or measured.  The compression is lossless.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_cache, "wavefile-cache", SCM_BOOL_T);
+/*"If this variable is #t, the parsed contents of each waveform file are"
+"saved in a cache file, .NAME.wfc, alongside it.  Loading or reloading"
+"the file again while it is unchanged maps the cache instead of"
+"parsing the file.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_lazy, "wavefile-lazy", SCM_BOOL_F);
+/*"If this variable is set to #t, only the independent variables of"
+"waveform files loaded afterward are read at first.  The data for each"
+"other variable is read when it is first displayed, measured or"
+"exported.  This saves time and memory for files with many variables,"
+"unless an up-to-date cache file can be used instead.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_background_load, "wavefile-background-load", SCM_BOOL_T);
+/*"If this variable is #t, waveform files loaded from the File menu or"
+"the command line, or by load-wavefile! with BACKGROUND, are read on a"
+"thread of their own, so that gwave can be used while they load.  A sample of the"
+"rows read so far is displayed until the whole file has been read."
+"Its variables appear once the file's header has been read."
+"Use wavefile-loading? and wavefile-wait! in scripts that need"
+"all of the data.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_follow_interval, "wavefile-follow-interval", scm_make_real(1.0));
+/*"How often, in seconds, files being followed with wavefile-follow!"
+"are checked for new data.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_settle_time, "wavefile-settle-time", scm_make_real(2.0));
+/*"With auto-reload-files!, a file that has changed is reloaded once it"
+"has not changed for this many seconds, so that a simulation that is"
+"writing it is finished, rather than while it is half written.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_poll_interval, "wavefile-poll-interval", scm_make_real(5.0));
+/*"With auto-reload-files!, how often, in seconds, files whose changes"
+"the system can't report, such as those on some network filesystems or"
+"on systems without inotify, are checked for changes.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_reload_filter, "wavefile-reload-filter", SCM_BOOL_F);
+/*"If this variable is set to a procedure, it is called with the"
+"GWDataFile of each file that auto-reload-files! finds has changed,"
+"before reloading it.  If it returns #f the file isn't reloaded,"
+"which lets the procedure veto the reload, or do it some other way"
+"itself.");*/
+
+SCM_VARIABLE_INIT(scm_wavefile_memory_budget, "wavefile-memory-budget", SCM_BOOL_F);
+/*"If this variable is set to a number, waveform files loaded afterward"
+"keep their data in pages, and at most this many megabytes of"
+"pages are kept in memory.  The rest are written out to a temporary"
+"file and read back when they are drawn or measured.  This allows"
+"viewing files bigger than memory.  It is set by the -m command-line"
+"option.");*/
 
 XSCM_HOOK(new_wavefile_hook,"new-wavefile-hook", 1, (SCM DF),
 "This hook is invoked when a new waveform file is successfully loaded."
 "It is called with the new GWDataFile, DF, as its only argument.");
 
+XSCM_HOOK(wavefile_loaded_hook,"wavefile-loaded-hook", 1, (SCM DF),
+"This hook is invoked when a waveform file being read in the background"
+"has been read completely.  It is called with the GWDataFile, DF.");
+
+XSCM_HOOK(wavefile_reloaded_hook,"wavefile-reloaded-hook", 1, (SCM DF),
+"This hook is invoked when the data of a waveform file has been"
+"reloaded because the file changed, whether by wavefile-reload!,"
+"reload-all-files! or auto-reload-files!.  It is called with the"
+"GWDataFile, DF.");
+
 XSCM_HOOK(new_wavelist_hook,"new-wavelist-hook", 1, (SCM DF),
 "This hook is invoked when the variable list window for a"
 "GWDataFile is created.  The GWDataFile object, DF, is passed as an"
@@ -203,24 +299,45 @@ XSCM_HOOK(new_wavelist_hook,"new-wavelist-hook", 1, (SCM DF),
 "uses of this hook is creating the menus such for the variable-list window.");
 
 /*
- * Load a waveform file, adding it to the list of files from which
- * variables can be chosen to add to the display.
+ * flags for wf_read_opt, from the wavefile-* options
  */
-GWDataFile *
-load_wave_file(char *fname, char *ftype)
+static int
+wavefile_read_flags(void)
+{
+	SCM budget;
+	int flags = 0;
+
+	if(SCM_NFALSEP(SCM_VARIABLE_REF(scm_wavefile_single_precision)))
+		flags |= WF_SINGLE;
+	if(SCM_NFALSEP(SCM_VARIABLE_REF(scm_wavefile_compress)))
+		flags |= WF_PACK;
+	if(SCM_NFALSEP(SCM_VARIABLE_REF(scm_wavefile_cache)))
+		flags |= WF_CACHE;
+	if(SCM_NFALSEP(SCM_VARIABLE_REF(scm_wavefile_lazy)))
+		flags |= WF_LAZY;
+	budget = SCM_VARIABLE_REF(scm_wavefile_memory_budget);
+	if(SCM_NUMBERP(budget)) {
+		wds_set_budget((gint64)(scm_num2double(budget, 0, "load_wave_file")
+				      * 1048576));
+		flags |= WF_PAGED;
+	}
+	return flags;
+}
+
+/*
+ * Make a GWDataFile for a WaveFile that has been read, and add it to the
+ * list of files from which variables can be chosen to add to the display.
+ * If the file is still being read by ld, wf is a preview of it.
+ */
+static GWDataFile *
+add_wave_file(WaveFile *wf, WFLoad *ld)
 {
 	GWDataFile *wdata;
-	SCM swdata;
-	int i;
 
 	wdata = g_new0(GWDataFile, 1);
-	wdata->wf = wf_read(fname, ftype);
-	
-	if(wdata->wf == NULL) {
-		g_free(wdata);
-		return NULL;
-	}
+	wdata->wf = wf;
 	wdata->wf->udata = wdata;
+	wdata->load = ld;
 
 	/* give the file a short (fow now, 1-character) "tag" to identify it
 	 * in the menu and variable labels.  
@@ -236,6 +353,8 @@ load_wave_file(char *fname, char *ftype)
 	wdata->outstanding_smob = 1;
 	SGT_NEWCELL_SMOB(wdata->smob, GWDataFile, wdata);
 	call1_hooks(new_wavefile_hook, wdata->smob);
+	if(auto_reload)
+		wavefile_watch(wdata);
 
 	if(wtable->window)
 		cmd_show_wave_list(NULL, wdata);
@@ -243,23 +362,218 @@ load_wave_file(char *fname, char *ftype)
 	return wdata;
 }
 
-SCM_DEFINE(load_wavefile_x, "load-wavefile!", 1, 1, 0, (SCM file, SCM filetype),
+/*
+ * callback for the cancel button of a file being loaded
+ */
+static void
+wavefile_cancel_load(GtkWidget *w, gpointer p)
+{
+	GWDataFile *wdata = (GWDataFile *)p;
+
+	if(wdata->load)
+		wf_load_cancel(wdata->load);
+}
+
+/*
+ * add a progress bar and cancel button to the variable list window
+ * of a file that is still being loaded.
+ */
+static void
+wavelist_add_load_box(GWDataFile *wdata, GtkWidget *box)
+{
+	GtkWidget *button;
+
+	wdata->load_box = gtk_hbox_new(FALSE, 0);
+	gtk_signal_connect(GTK_OBJECT(wdata->load_box), "destroy",
+			   GTK_SIGNAL_FUNC(gtk_widget_destroyed),
+			   &(wdata->load_box));
+	wdata->load_pbar = gtk_progress_bar_new();
+	gtk_signal_connect(GTK_OBJECT(wdata->load_pbar), "destroy",
+			   GTK_SIGNAL_FUNC(gtk_widget_destroyed),
+			   &(wdata->load_pbar));
+	gtk_box_pack_start(GTK_BOX(wdata->load_box), wdata->load_pbar,
+			   TRUE, TRUE, 0);
+	button = gtk_button_new_with_label("Cancel");
+	gtk_signal_connect(GTK_OBJECT(button), "clicked",
+			   GTK_SIGNAL_FUNC(wavefile_cancel_load), wdata);
+	gtk_box_pack_start(GTK_BOX(wdata->load_box), button, FALSE, FALSE, 0);
+	gtk_box_pack_end(GTK_BOX(box), wdata->load_box,
+			 FALSE, FALSE, 0);
+	gtk_widget_show_all(wdata->load_box);
+}
+
+/*
+ * timeout callback that watches a file being loaded in the background,
+ * updating its progress bar and preview until it has been read.
+ */
+static gint
+wavefile_load_poll(gpointer p)
+{
+	GWDataFile *wdata = (GWDataFile *)p;
+	WaveFile *wf;
+	double frac;
+
+	if(wf_load_status(wdata->load, &frac) != WFL_LOADING) {
+		wdata->load_timer = 0;
+		wavefile_load_done(wdata);
+		return FALSE;
+	}
+	if(wdata->load_pbar) {
+		if(frac >= 0)
+			gtk_progress_bar_set_fraction(
+				GTK_PROGRESS_BAR(wdata->load_pbar), frac);
+		else
+			gtk_progress_bar_pulse(GTK_PROGRESS_BAR(wdata->load_pbar));
+	}
+	/* until the first preview, which brings the variables, look for
+	 * one every time.  A file being reloaded shows its old data. */
+	if(!wdata->reloading
+	   && (wdata->wf->wf_ntables == 0
+	       || ++wdata->load_polls % LOAD_PREVIEW_POLLS == 0)
+	   && (wf = wf_load_preview(wdata->load)) != NULL)
+		replace_wave_file(wdata, wf);
+	return TRUE;
+}
+
+/*
+ * wait for a file being loaded in the background to finish, and replace
+ * its preview with the whole file, or if it couldn't be read, delete it.
+ * A file being reloaded keeps its old data if the new can't be read.
+ */
+static void
+wavefile_load_done(GWDataFile *wdata)
+{
+	WaveFile *wf;
+	int state, reloading = wdata->reloading;
+
+	if(wdata->load_timer) {
+		gtk_timeout_remove(wdata->load_timer);
+		wdata->load_timer = 0;
+	}
+	state = wf_load_status(wdata->load, NULL);
+	wf = wf_load_finish(wdata->load);
+	wdata->load = NULL;
+	wdata->reloading = 0;
+	if(wdata->load_box)
+		gtk_widget_destroy(wdata->load_box);
+
+	if(reloading) {
+		if(wf) {
+			replace_wave_file(wdata, wf);
+			call1_hooks(wavefile_reloaded_hook, wdata->smob);
+		} else {
+			fprintf(stderr, "gwave: %s %s\n", wdata->wf->wf_filename,
+				state == WFL_CANCELLED ? "not reloaded; cancelled"
+				: "couldn't be reloaded");
+		}
+	} else if(wf) {
+		replace_wave_file(wdata, wf);
+		call1_hooks(wavefile_loaded_hook, wdata->smob);
+	} else {
+		fprintf(stderr, "gwave: %s %s\n", wdata->wf->wf_filename,
+			state == WFL_CANCELLED ? "not loaded; cancelled"
+			: "couldn't be read");
+		delete_wave_file(NULL, wdata);
+	}
+}
+
+/*
+ * Load a waveform file, adding it to the list of files from which
+ * variables can be chosen to add to the display.
+ * If vars isn't NULL, it is a NULL-terminated list of the names of the
+ * variables to read now; the rest are read when they are first used.
+ * Otherwise, if background is nonzero and wavefile-background-load is set,
+ * the file is read on a thread of its own, once there is one to spare,
+ * and a preview of it is used until it has been read; it has no
+ * variables until the reader has got through its header, and if it
+ * can't be read it is deleted then.
+ * Returns NULL if the file can't be read, as far as can be told now.
+ */
+GWDataFile *
+load_wave_file(char *fname, char *ftype, char **vars, int background)
+{
+	GWDataFile *wdata;
+	WaveFile *wf;
+	WFLoad *ld;
+	int flags = wavefile_read_flags();
+
+	if(vars) {
+		wf = wf_read_select(fname, ftype, flags, vars);
+		if(wf == NULL)
+			return NULL;
+		return add_wave_file(wf, NULL);
+	}
+	if(!background
+	   || SCM_FALSEP(SCM_VARIABLE_REF(scm_wavefile_background_load))) {
+		wf = wf_read_opt(fname, ftype, flags);
+		if(wf == NULL)
+			return NULL;
+		return add_wave_file(wf, NULL);
+	}
+
+	if(access(fname, R_OK) < 0) {
+		perror(fname);
+		return NULL;
+	}
+	/* the variables aren't known until the reader has got through the
+	 * header, which may take a while; wavefile_load_poll() puts them
+	 * in once it has, without holding up the main loop meanwhile. */
+	ld = wf_load_start(fname, ftype, flags);
+	if(wf_load_status(ld, NULL) != WFL_LOADING) {
+		/* read without a thread; there's no need for a preview */
+		wf = wf_load_finish(ld);
+		if(wf == NULL)
+			return NULL;
+		return add_wave_file(wf, NULL);
+	}
+	wdata = add_wave_file(wf_load_empty(ld), ld);
+	wdata->load_timer = gtk_timeout_add(LOAD_POLL_MS, wavefile_load_poll,
+					    wdata);
+	return wdata;
+}
+
+SCM_DEFINE(load_wavefile_x, "load-wavefile!", 1, 3, 0,
+	   (SCM file, SCM filetype, SCM vars, SCM background),
 "Load waveform data from FILE into memory, and make it available for"
 "display.  If FILETYPE is specified, it indicates the format of the file"
 "and which wavefile reader to use, otherwise the format is inferred"
-"from the filename and file contents.  Returns a GWDataFile object"
-"which can be used to refer to the loaded data.")
+"from the filename and file contents.  If VARS is a list of variable"
+"names, only those variables are read now, and each of the others"
+"is read when it is first displayed.  Returns a GWDataFile object"
+"which can be used to refer to the loaded data, or #f if FILE can't"
+"be read.  If BACKGROUND is #t and wavefile-background-load is set,"
+"returns at once with a GWDataFile that is still being read, as for"
+"the File menu; see wavefile-wait!.")
 #define FUNC_NAME s_load_wavefile_x
 {
 	char *fname, *ftype;
+	char **names = NULL;
 	GWDataFile *df;
+	SCM p;
+	int i, n;
 
 	VALIDATE_ARG_STR_NEWCOPY(1, file, fname);
 	VALIDATE_ARG_STR_NEWCOPY_USE_NULL(2, filetype, ftype);
-	df = load_wave_file(fname, ftype);
+	if(!UNSET_SCM(vars)) {
+		n = scm_ilength(vars);
+		if(n < 0)
+			scm_wrong_type_arg(FUNC_NAME, 3, vars);
+		for(p = vars; SCM_CONSP(p); p = SCM_CDR(p))
+			if(SCM_FALSEP(scm_string_p(SCM_CAR(p))))
+				scm_wrong_type_arg(FUNC_NAME, 3, vars);
+		names = g_new0(char *, n + 1);
+		for(i = 0, p = vars; i < n; i++, p = SCM_CDR(p))
+			names[i] = gh_scm2newstr(SCM_CAR(p), NULL);
+	}
+	df = load_wave_file(fname, ftype, names, !UNSET_SCM(background));
 	g_free(fname);
 	if(ftype)
 		g_free(ftype);
+	if(names) {
+		for(i = 0; names[i]; i++)
+			g_free(names[i]);
+		g_free(names);
+	}
 	if(df)
 		return df->smob;
 	else
@@ -267,6 +581,246 @@ SCM_DEFINE(load_wavefile_x, "load-wavefile!", 1, 1, 0, (SCM file, SCM filetype),
 }
 #undef FUNC_NAME
 
+SCM_DEFINE(wavefile_plots, "wavefile-plots", 1, 1, 0,
+	   (SCM file, SCM filetype),
+"Returns a list of the names of the plots, or sets of results, in the"
+"waveform file FILE, such as the operating point, AC and transient"
+"plots of an ngspice rawfile.  A file that holds only one has a list"
+"of one name, which may be empty.  Returns #f if FILE can't be read."
+"FILETYPE is as for load-wavefile!.")
+#define FUNC_NAME s_wavefile_plots
+{
+	char *fname, *ftype;
+	char **names;
+	SCM result = SCM_EOL;
+	int i;
+
+	VALIDATE_ARG_STR_NEWCOPY(1, file, fname);
+	VALIDATE_ARG_STR_NEWCOPY_USE_NULL(2, filetype, ftype);
+	names = wf_plot_names(fname, ftype);
+	g_free(fname);
+	if(ftype)
+		g_free(ftype);
+	if(names == NULL)
+		return SCM_BOOL_F;
+	for(i = 0; names[i]; i++)
+		result = scm_cons(scm_makfrom0str(names[i]), result);
+	g_strfreev(names);
+	return scm_reverse(result);
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(load_wavefile_plot_x, "load-wavefile-plot!", 2, 1, 0,
+	   (SCM file, SCM plot, SCM filetype),
+"Load plot number PLOT, counting from 0, of the waveform file FILE,"
+"as listed by wavefile-plots, as if it were a file of its own."
+"Only the plots it needs are read.  FILETYPE is as for load-wavefile!."
+"Returns a GWDataFile object, or #f if the plot can't be read.")
+#define FUNC_NAME s_load_wavefile_plot_x
+{
+	char *fname, *ftype;
+	WaveFile *wf;
+	int n;
+
+	VALIDATE_ARG_STR_NEWCOPY(1, file, fname);
+	VALIDATE_ARG_INT_MIN_COPY(2, plot, 0, n);
+	VALIDATE_ARG_STR_NEWCOPY_USE_NULL(3, filetype, ftype);
+	wf = wf_read_plot(fname, ftype, wavefile_read_flags(), n);
+	g_free(fname);
+	if(ftype)
+		g_free(ftype);
+	if(wf == NULL)
+		return SCM_BOOL_F;
+	return add_wave_file(wf, NULL)->smob;
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_plot, "wavefile-plot", 1, 0, 0,
+           (SCM df),
+"Returns the number of the plot of its file from which the"
+"GWDataFile DF was loaded; 0 unless it was loaded with"
+"load-wavefile-plot!.")
+#define FUNC_NAME s_wavefile_plot
+{
+	GWDataFile *wdata;
+	VALIDATE_ARG_GWDataFile_COPY(1, df, wdata);
+
+	return scm_long2num(wdata->wf->ss->plot);
+}
+#undef FUNC_NAME
+
+/*
+ * state for load-wavefiles!: files that have been read, and how many of
+ * them, in the order asked for, have been added so far.
+ */
+typedef struct {
+	int n;
+	WaveFile **wfs;
+	int *finished;
+	GWDataFile **dfs;
+	int next;
+} LoadManyState;
+
+/*
+ * called on this thread as each file is finished with, in whatever order
+ * they finish.  Files are added in the order they were named, so that
+ * they get the same tags however long each takes to read.
+ */
+static void
+load_many_done(WaveFile *wf, int i, gpointer data)
+{
+	LoadManyState *st = (LoadManyState *)data;
+
+	st->wfs[i] = wf;
+	st->finished[i] = 1;
+	while(st->next < st->n && st->finished[st->next]) {
+		if(st->wfs[st->next])
+			st->dfs[st->next] = add_wave_file(st->wfs[st->next],
+							      NULL);
+		st->next++;
+	}
+}
+
+SCM_DEFINE(load_wavefiles_x, "load-wavefiles!", 1, 2, 0,
+	   (SCM files, SCM filetype, SCM background),
+"Load waveform data from each of the files named in the list FILES,"
+"reading several of them at once when there are processors to spare."
+"FILETYPE, if specified, is the format of all of the files, as for"
+"load-wavefile!.  The files are added in the order named."
+"Returns a list with a GWDataFile object for each file,"
+"or #f for each file that could not be read."
+"BACKGROUND is as for load-wavefile!.")
+#define FUNC_NAME s_load_wavefiles_x
+{
+	char **names;
+	char *ftype;
+	LoadManyState st;
+	SCM p;
+	SCM result = SCM_EOL;
+	int i, n;
+
+	n = scm_ilength(files);
+	if(n < 0)
+		scm_wrong_type_arg(FUNC_NAME, 1, files);
+	for(p = files; SCM_CONSP(p); p = SCM_CDR(p))
+		if(SCM_FALSEP(scm_string_p(SCM_CAR(p))))
+			scm_wrong_type_arg(FUNC_NAME, 1, files);
+	VALIDATE_ARG_STR_NEWCOPY_USE_NULL(2, filetype, ftype);
+
+	names = g_new0(char *, n);
+	for(i = 0, p = files; i < n; i++, p = SCM_CDR(p))
+		names[i] = gh_scm2newstr(SCM_CAR(p), NULL);
+
+	st.n = n;
+	st.wfs = g_new0(WaveFile *, n);
+	st.finished = g_new0(int, n);
+	st.dfs = g_new0(GWDataFile *, n);
+	st.next = 0;
+	if(!UNSET_SCM(background)
+	   && SCM_NFALSEP(SCM_VARIABLE_REF(scm_wavefile_background_load))) {
+		/* wf_load_start() queues them, so that only as many
+		 * are read at once as wf_read_many() would */
+		for(i = 0; i < n; i++)
+			st.dfs[i] = load_wave_file(names[i], ftype, NULL, 1);
+	} else {
+		wf_read_many(n, names, ftype, wavefile_read_flags(),
+			     load_many_done, &st);
+	}
+
+	for(i = n-1; i >= 0; i--) {
+		result = scm_cons(st.dfs[i] ? st.dfs[i]->smob : SCM_BOOL_F,
+				  result);
+		g_free(names[i]);
+	}
+	g_free(names);
+	g_free(st.wfs);
+	g_free(st.finished);
+	g_free(st.dfs);
+	if(ftype)
+		g_free(ftype);
+	return result;
+}
+#undef FUNC_NAME
+
+/*
+ * timeout callback for a file being followed: read the rows added to it,
+ * and draw them.
+ */
+static gint
+wavefile_follow_poll(gpointer p)
+{
+	GWDataFile *wdata = (GWDataFile *)p;
+	WaveFile *wf = wdata->wf;
+	WvTable *wt;
+	double old_end = -G_MAXDOUBLE;
+	int ntables = wf->wf_ntables;
+	SSIndex n;
+
+	if(ntables > 0) {
+		wt = wf_wtable(wf, ntables - 1);
+		if(wt->nvalues > 0)
+			old_end = wds_get_point(wt->iv->wds, wt->nvalues - 1);
+	}
+	n = wf_follow(wf);
+	if(n < 0) {
+		wdata->follow_timer = 0;
+		wavefile_follow(wdata, 0);
+		return FALSE;
+	}
+	if(n == 0)
+		return TRUE;
+
+	if(wf->wf_ntables != ntables) {
+		/* new sweeps: add their variables to the list, and redraw
+		 * everything, since they start back at the left */
+		wavefile_update_list(wdata);
+		old_end = -G_MAXDOUBLE;
+	}
+	update_wfile_follow(wdata, old_end);
+	return TRUE;
+}
+
+/*
+ * Start or stop following a file: reading the rows added to it, such as
+ * by a simulation that is still running, every wavefile-follow-interval.
+ */
+static void
+wavefile_follow(GWDataFile *wdata, int on)
+{
+	WaveFile *wf;
+	SCM secs;
+	guint32 ms = 1000;
+
+	if(wdata->follow_timer) {
+		gtk_timeout_remove(wdata->follow_timer);
+		wdata->follow_timer = 0;
+	}
+	if(!on) {
+		wf_follow_stop(wdata->wf);
+		return;
+	}
+
+	if(wdata->load)
+		wavefile_load_done(wdata);
+	if(wdata->wf == NULL)
+		return;
+	if(wdata->wf->follow == NULL) {
+		/* reread it, to follow it from the start */
+		wf = wf_read_opt(wdata->wf->wf_filename, NULL,
+				 wdata->wf->flags | WF_FOLLOW);
+		if(wf == NULL) {
+			fprintf(stderr, "gwave: can't follow %s\n",
+				wdata->wf->wf_filename);
+			return;
+		}
+		replace_wave_file(wdata, wf);
+	}
+	secs = SCM_VARIABLE_REF(scm_wavefile_follow_interval);
+	if(SCM_NUMBERP(secs))
+		ms = MAX(1, scm_num2double(secs, 0, "wavefile_follow") * 1000);
+	wdata->follow_timer = gtk_timeout_add(ms, wavefile_follow_poll, wdata);
+}
+
 /*
  * Delete a wave file.
  * callback from menu: wavelist->file->delete
@@ -276,6 +830,24 @@ delete_wave_file(GtkWidget *w, GWDataFile *wdata)
 {
 	int i;
 	GSList *list;
+	WaveFile *wf;
+
+/* stop reading it, if it is still being read */
+	wavefile_unwatch(wdata);
+	if(wdata->follow_timer) {
+		gtk_timeout_remove(wdata->follow_timer);
+		wdata->follow_timer = 0;
+	}
+	if(wdata->load) {
+		if(wdata->load_timer)
+			gtk_timeout_remove(wdata->load_timer);
+		wdata->load_timer = 0;
+		wf_load_cancel(wdata->load);
+		wf = wf_load_finish(wdata->load);
+		wdata->load = NULL;
+		if(wf)
+			wf_free(wf);
+	}
 /* remove references from displayed waves */
 	remove_wfile_waves(wdata);
 
@@ -326,38 +898,165 @@ SCM_DEFINE(datafile_delete_x, "wavefile-delete!", 1, 0, 0,
 void
 reload_wave_file(GtkWidget *w, GWDataFile *wdata)
 {
-	int i;
+	WaveFile *wf = wdata->wf;
 	WaveFile *new_wf;
-	WaveFile *old_wf;
+	WvTable *wt;
+	WaveVarH *wvh;
+	GPtrArray *dropped;
+	GSList *list;
+	double old_end = -G_MAXDOUBLE;
+	int ntables, rc, i;
 
-	/* FIXME:sgt: get file type from old file, if it was specified
-	 * when loading it originaly
-	 */
-	new_wf = wf_read(wdata->wf->wf_filename, NULL);
-	if(new_wf == NULL) {
-		fprintf(stderr, "reload_wave_file: failed to read %s\n", wdata->wf->wf_filename);
-		/* FIXME:sgt put up error message in window */
+	if(wdata->load)		/* still loading; it's as new as it gets */
+		return;
+
+	/* read just what has changed, into the same WaveFile if we can */
+	ntables = wf->wf_ntables;
+	if(ntables > 0) {
+		wt = wf_wtable(wf, ntables - 1);
+		if(wt->nvalues > 0)
+			old_end = wds_get_point(wt->iv->wds, wt->nvalues - 1);
+	}
+	dropped = g_ptr_array_new();
+	rc = wf_reload(wf, dropped);
+	if(dropped->len > 0) {
+		remove_wtable_waves(dropped);
+		for(list = wdata->wvhl; list; list = list->next) {
+			wvh = (WaveVarH *)list->data;
+			for(i = 0; wvh->wv && i < dropped->len; i++)
+				if(wvh->wv->wtable == g_ptr_array_index(dropped, i))
+					wvh->wv = NULL;
+		}
+		for(i = 0; i < dropped->len; i++)
+			wt_free(g_ptr_array_index(dropped, i));
+	}
+	g_ptr_array_free(dropped, 0);
+	if(wdata->follow_timer && wf->follow == NULL) {
+		/* rewritten rather than added to; no longer followed */
+		gtk_timeout_remove(wdata->follow_timer);
+		wdata->follow_timer = 0;
+	}
+
+	switch(rc) {
+	case WFR_SAME:
+		return;
+	case WFR_NEWHEADER:
+		/* FIXME:sgt: get file type from old file, if it was specified
+		 * when loading it originaly
+		 */
+		new_wf = wf_read_plot(wf->wf_filename, NULL, wf->flags,
+				      wf->ss->plot);
+		if(new_wf == NULL) {
+			fprintf(stderr, "reload_wave_file: failed to read %s\n", wf->wf_filename);
+			/* FIXME:sgt put up error message in window */
+			return;
+		}
+		replace_wave_file(wdata, new_wf);
+		call1_hooks(wavefile_reloaded_hook, wdata->smob);
+		return;
+	case WFR_FAILED:
+		/* show what could be read */
+		fprintf(stderr, "reload_wave_file: failed to read %s\n", wf->wf_filename);
+		old_end = -G_MAXDOUBLE;
+		break;
+	case WFR_REREAD:
+		old_end = -G_MAXDOUBLE;
+		break;
+	}
+	if(wf->wf_ntables != ntables) {
+		wavefile_update_list(wdata);
+		old_end = -G_MAXDOUBLE;
+	}
+	update_wfile_follow(wdata, old_end);
+	call1_hooks(wavefile_reloaded_hook, wdata->smob);
+}
+
+/*
+ * Reload a file that has changed on a thread of its own, as a new
+ * WaveFile, with a progress bar in its variable list window.  The old
+ * data is shown until the new has been read, and then replaced by it,
+ * as for a file whose variables have changed.  Without
+ * wavefile-background-load, it is reloaded at once.
+ */
+static void
+wavefile_reload_start(GWDataFile *wdata)
+{
+	WaveFile *wf = wdata->wf;
+	GtkWidget *box;
+
+	if(wdata->load || wf->follow
+	   || SCM_FALSEP(SCM_VARIABLE_REF(scm_wavefile_background_load))) {
+		reload_wave_file(NULL, wdata);
 		return;
 	}
+	if(!wf_changed(wf))
+		return;
+	wdata->load = wf_load_start_plot(wf->wf_filename, NULL, wf->flags,
+					 wf->ss->plot);
+	wdata->reloading = 1;
+	if(wf_load_status(wdata->load, NULL) != WFL_LOADING) {
+		/* read without a thread */
+		wavefile_load_done(wdata);
+		return;
+	}
+	if(wdata->wlist_win && (box = GTK_BIN(wdata->wlist_win)->child))
+		wavelist_add_load_box(wdata, box);
+	wdata->load_timer = gtk_timeout_add(LOAD_POLL_MS, wavefile_load_poll,
+					    wdata);
+}
+
+/*
+ * Replace the data of a GWDataFile with a new WaveFile read from
+ * the same file, pointing the displayed waves, the variable list, and
+ * the handles held by guile at the new file's variables.
+ */
+static void
+replace_wave_file(GWDataFile *wdata, WaveFile *new_wf)
+{
+	WaveFile *old_wf;
+	WaveVarH *wvh;
+	WaveVar *wv;
+	GSList *list;
+
 	old_wf = wdata->wf;
 	wdata->wf = new_wf;
 	wdata->wf->udata = wdata;
+	wdata->ndv = new_wf->wf_ndv;
 /*	printf("reload_wave_file(%s) old=%lx new=%lx\n",
 	       wdata->wf->wf_filename, old_wf, new_wf); */
 
 	update_wfile_waves(wdata);
 
-/* remove old buttons from list, and add new ones */	
-	if(wdata->wlist_win && GTK_WIDGET_VISIBLE(wdata->wlist_win)) {
-		gtk_container_foreach(GTK_CONTAINER(wdata->wlist_box),
-				      (GtkCallback) gtk_widget_destroy, NULL);
-		wf_foreach_wavevar(wdata->wf, gwfile_add_wv_to_list, (gpointer)wdata);
+	for(list = wdata->wvhl; list; list = list->next) {
+		wvh = (WaveVarH *)list->data;
+		if(!wvh->wv)
+			continue;
+		wv = wf_find_variable(new_wf, wvh->wv->wv_name,
+				      wvh->wv->wtable->swindex);
+		wvh->wv = wv;
+		if(wv)
+			wv->udata = wvh;
 	}
 
+	wavefile_update_list(wdata);
 	wf_free(old_wf);
 	mbtn_update_all();
 }
 
+/*
+ * remove old buttons from a file's variable list, and add new ones
+ */
+static void
+wavefile_update_list(GWDataFile *wdata)
+{
+	if(wdata->wlist_win && GTK_WIDGET_VISIBLE(wdata->wlist_win)) {
+		gtk_container_foreach(GTK_CONTAINER(wdata->wlist_box),
+				      (GtkCallback) gtk_widget_destroy, NULL);
+		wf_foreach_wavevar(wdata->wf, gwfile_add_wv_to_list,
+				   (gpointer)wdata);
+	}
+}
+
 void
 reload_wave_file_w(gpointer p, gpointer d)
 { 
@@ -366,9 +1065,8 @@ reload_wave_file_w(gpointer p, gpointer d)
 } 
 
 /*
- * Reload all files.
- * plan: replace this with update_all_wave_files(), which checks
- * file dates/sizes and only reloads those that need it.
+ * Reload all files.  Those that haven't changed are left alone,
+ * and those that have only grown just have the new data read.
  */
 void
 reload_all_wave_files(GtkWidget *w)
@@ -387,6 +1085,269 @@ SCM_DEFINE(reload_all_files_x, "reload-all-files!", 0, 0, 0, (),
 }
 #undef FUNC_NAME
 
+/*
+ * look at the size and modification time of a file watched by
+ * auto-reload-files!, noting when they change.  A file that has gone,
+ * perhaps to be written again, counts as still changing.
+ */
+static void
+wavefile_watch_stat(GWDataFile *wdata, double now)
+{
+	struct stat st;
+
+	if(stat(wdata->wf->wf_filename, &st) < 0) {
+		if(wdata->reload_pending)
+			wdata->changed_at = now;
+		return;
+	}
+	if(st.st_size != wdata->seen_size || st.st_mtime != wdata->seen_mtime) {
+		wdata->seen_size = st.st_size;
+		wdata->seen_mtime = st.st_mtime;
+		wdata->reload_pending = 1;
+		wdata->changed_at = now;
+	}
+}
+
+static double
+wavefile_now(void)
+{
+	GTimeVal tv;
+
+	g_get_current_time(&tv);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * seconds given by a scheme variable, or def if it isn't a number
+ */
+static double
+wavefile_secs_var(SCM var, double def)
+{
+	SCM secs = SCM_VARIABLE_REF(var);
+
+	if(SCM_NUMBERP(secs))
+		return scm_num2double(secs, 0, "wavefile_secs_var");
+	return def;
+}
+
+/*
+ * Start watching a file for changes, for auto-reload-files!.
+ * Files are watched with inotify, on their directory so that a file
+ * that is replaced rather than written over is noticed too, or failing
+ * that by looking at them every wavefile-poll-interval seconds.
+ */
+static void
+wavefile_watch(GWDataFile *wdata)
+{
+	WaveFile *wf = wdata->wf;
+	char *dir;
+
+	if(wdata->watch_name || wf->srcsize < 0)	/* pipes can't change */
+		return;
+	wdata->watch_wd = -1;
+	wdata->reload_pending = 0;
+	wdata->watch_name = g_path_get_basename(wf->wf_filename);
+	/* changes since it was read count */
+	wdata->seen_size = wf->srcsize;
+	wdata->seen_mtime = wf->srcmtime;
+#ifdef HAVE_SYS_INOTIFY_H
+	if(inotify_fd >= 0) {
+		dir = g_path_get_dirname(wf->wf_filename);
+		wdata->watch_wd = inotify_add_watch(inotify_fd, dir,
+			IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE
+			| IN_MOVED_TO | IN_DELETE);
+		if(wdata->watch_wd < 0 && v_flag)
+			fprintf(stderr, "inotify_add_watch(%s): %s; polling\n",
+				dir, strerror(errno));
+		g_free(dir);
+	}
+#endif
+}
+
+static void
+wavefile_unwatch(GWDataFile *wdata)
+{
+	GList *l;
+	GWDataFile *o;
+
+	if(wdata->watch_name == NULL)
+		return;
+#ifdef HAVE_SYS_INOTIFY_H
+	/* the watch is on the directory, which other files may share */
+	if(wdata->watch_wd >= 0 && inotify_fd >= 0) {
+		for(l = wdata_list; l; l = l->next) {
+			o = (GWDataFile *)l->data;
+			if(o != wdata && o->watch_name
+			   && o->watch_wd == wdata->watch_wd)
+				break;
+		}
+		if(l == NULL)
+			inotify_rm_watch(inotify_fd, wdata->watch_wd);
+	}
+#endif
+	g_free(wdata->watch_name);
+	wdata->watch_name = NULL;
+	wdata->watch_wd = -1;
+	wdata->reload_pending = 0;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*
+ * input callback for the inotify descriptor: note which of the watched
+ * files have changed.  They are reloaded later, once they have settled.
+ */
+static void
+wavefile_watch_event(gpointer data, gint fd, GdkInputCondition cond)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	GWDataFile *wdata;
+	GList *l;
+	double now = wavefile_now();
+	ssize_t n;
+	char *p;
+
+	n = read(fd, buf, sizeof(buf));
+	for(p = buf; n > 0 && p < buf + n;
+	    p += sizeof(struct inotify_event) + ev->len) {
+		ev = (struct inotify_event *)p;
+		for(l = wdata_list; l; l = l->next) {
+			wdata = (GWDataFile *)l->data;
+			if(wdata->watch_name == NULL)
+				continue;
+			/* on overflow, events were lost: check everything */
+			if((ev->mask & IN_Q_OVERFLOW)
+			   || (ev->wd == wdata->watch_wd && ev->len > 0
+			       && strcmp(ev->name, wdata->watch_name) == 0)) {
+				wdata->reload_pending = 1;
+				wdata->changed_at = now;
+			}
+		}
+	}
+}
+#endif
+
+/*
+ * Reload the watched files that have changed, once they have settled:
+ * not changed for wavefile-settle-time seconds.  Files inotify isn't
+ * watching are looked at every wavefile-poll-interval seconds.
+ * Only one file is reloaded per call, so that the display stays usable
+ * while several are being reloaded.
+ */
+static void
+update_all_wave_files(void)
+{
+	GWDataFile *wdata;
+	GList *l;
+	SCM filter;
+	double now = wavefile_now();
+	double settle = wavefile_secs_var(scm_wavefile_settle_time, 2.0);
+	int poll = 0;
+
+	if(now - auto_reload_polled >=
+	   wavefile_secs_var(scm_wavefile_poll_interval, 5.0)) {
+		auto_reload_polled = now;
+		poll = 1;
+	}
+	for(l = wdata_list; l; l = l->next) {
+		wdata = (GWDataFile *)l->data;
+		if(wdata->watch_name == NULL || wdata->load
+		   || wdata->follow_timer)
+			continue;
+		if(wdata->reload_pending || (poll && wdata->watch_wd < 0))
+			wavefile_watch_stat(wdata, now);
+		if(!wdata->reload_pending || now - wdata->changed_at < settle)
+			continue;
+
+		/* the filter may change wdata_list, so stop here */
+		wdata->reload_pending = 0;
+		filter = SCM_VARIABLE_REF(scm_wavefile_reload_filter);
+		if(SCM_NFALSEP(scm_procedure_p(filter))
+		   && SCM_FALSEP(scwm_safe_call1(filter, wdata->smob)))
+			break;
+		if(v_flag)
+			fprintf(stderr, "auto-reload %s\n",
+				wdata->wf->wf_filename);
+		wavefile_reload_start(wdata);
+		break;
+	}
+}
+
+static gint
+wavefile_watch_poll(gpointer p)
+{
+	update_all_wave_files();
+	return TRUE;
+}
+
+/*
+ * Turn automatic reloading of changed files on or off.
+ */
+static void
+wavefile_auto_reload(int on)
+{
+	GList *l;
+
+	if(on == auto_reload)
+		return;
+	auto_reload = on;
+	if(on) {
+#ifdef HAVE_SYS_INOTIFY_H
+		inotify_fd = inotify_init();
+		if(inotify_fd >= 0)
+			inotify_tag = gdk_input_add(inotify_fd, GDK_INPUT_READ,
+						    wavefile_watch_event, NULL);
+		else if(v_flag)
+			fprintf(stderr, "inotify_init: %s; polling\n",
+				strerror(errno));
+#endif
+		for(l = wdata_list; l; l = l->next)
+			wavefile_watch((GWDataFile *)l->data);
+		auto_reload_polled = wavefile_now();
+		auto_reload_timer = gtk_timeout_add(WATCH_POLL_MS,
+						    wavefile_watch_poll, NULL);
+	} else {
+		gtk_timeout_remove(auto_reload_timer);
+		auto_reload_timer = 0;
+		for(l = wdata_list; l; l = l->next)
+			wavefile_unwatch((GWDataFile *)l->data);
+#ifdef HAVE_SYS_INOTIFY_H
+		if(inotify_fd >= 0) {
+			gdk_input_remove(inotify_tag);
+			close(inotify_fd);	/* removes any watches left */
+			inotify_fd = -1;
+		}
+#endif
+	}
+}
+
+SCM_DEFINE(auto_reload_files_x, "auto-reload-files!", 0, 1, 0,
+	   (SCM on),
+"Reload files automatically when they change, such as when a"
+"simulation has been run again.  A file is reloaded once it has not"
+"changed for wavefile-settle-time seconds; see also"
+"wavefile-reload-filter and wavefile-reloaded-hook."
+"If ON is #f, stop reloading them automatically.")
+#define FUNC_NAME s_auto_reload_files_x
+{
+	int f;
+	VALIDATE_ARG_BOOL_COPY_USE_T(1, on, f);
+
+	wavefile_auto_reload(f);
+	return SCM_UNSPECIFIED;
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(auto_reload_files_p, "auto-reload-files?", 0, 0, 0, (),
+"Returns #t if files are being reloaded automatically when they"
+"change; see auto-reload-files!.")
+#define FUNC_NAME s_auto_reload_files_p
+{
+	return SCM_BOOL_FromBool(auto_reload);
+}
+#undef FUNC_NAME
+
 SCM_DEFINE(datafile_reload_x, "wavefile-reload!", 1, 0, 0, 
            (SCM obj),
 "Reread the data file for OBJ.  Useful for updating the display"
@@ -402,6 +1363,101 @@ SCM_DEFINE(datafile_reload_x, "wavefile-reload!", 1, 0, 0,
 }
 #undef FUNC_NAME
 
+SCM_DEFINE(wavefile_loading_p, "wavefile-loading?", 1, 0, 0,
+           (SCM obj),
+"Returns #t if the GWDataFile OBJ is still being read in the background,"
+"in which case only a sample of its data is available so far.")
+#define FUNC_NAME s_wavefile_loading_p
+{
+	GWDataFile *wdata;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+
+	return SCM_BOOL_FromBool(wdata->load != NULL);
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_load_progress, "wavefile-load-progress", 1, 0, 0,
+           (SCM obj),
+"Returns the fraction, from 0 to 1, of the GWDataFile OBJ read so far,"
+"or #f if that isn't known.  Returns 1 once the file has been read.")
+#define FUNC_NAME s_wavefile_load_progress
+{
+	GWDataFile *wdata;
+	double frac;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+
+	if(!wdata->load)
+		return scm_make_real(1.0);
+	wf_load_status(wdata->load, &frac);
+	if(frac < 0)
+		return SCM_BOOL_F;
+	return scm_make_real(frac);
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_wait_x, "wavefile-wait!", 1, 0, 0,
+           (SCM obj),
+"Wait until the GWDataFile OBJ has been read completely, if it"
+"is being read in the background.  Returns #t if the file has been read,"
+"or #f if the load was cancelled or failed, in which case the"
+"GWDataFile has been deleted.")
+#define FUNC_NAME s_wavefile_wait_x
+{
+	GWDataFile *wdata;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+
+	if(wdata->load)
+		wavefile_load_done(wdata);
+	return SCM_BOOL_FromBool(wdata->wf != NULL);
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_cancel_load_x, "wavefile-cancel-load!", 1, 0, 0,
+           (SCM obj),
+"Stop reading the GWDataFile OBJ, if it is being read in the background."
+"The GWDataFile is deleted once reading has stopped.")
+#define FUNC_NAME s_wavefile_cancel_load_x
+{
+	GWDataFile *wdata;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+
+	if(wdata->load)
+		wf_load_cancel(wdata->load);
+	return SCM_UNSPECIFIED;
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_follow_x, "wavefile-follow!", 1, 1, 0,
+           (SCM obj, SCM on),
+"Follow the GWDataFile OBJ: read the data added to the file as it grows,"
+"such as the output of a simulation that is still running, and draw it."
+"The file is checked every wavefile-follow-interval seconds."
+"If ON is #f, stop following it.")
+#define FUNC_NAME s_wavefile_follow_x
+{
+	GWDataFile *wdata;
+	int f;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+	VALIDATE_ARG_BOOL_COPY_USE_T(2, on, f);
+
+	if(wdata->wf)
+		wavefile_follow(wdata, f);
+	return SCM_UNSPECIFIED;
+}
+#undef FUNC_NAME
+
+SCM_DEFINE(wavefile_following_p, "wavefile-following?", 1, 0, 0,
+           (SCM obj),
+"Returns #t if the GWDataFile OBJ is being followed with wavefile-follow!.")
+#define FUNC_NAME s_wavefile_following_p
+{
+	GWDataFile *wdata;
+	VALIDATE_ARG_GWDataFile_COPY(1, obj, wdata);
+
+	return SCM_BOOL_FromBool(wdata->follow_timer != 0);
+}
+#undef FUNC_NAME
+
 /*
  * Return the GtkTooltips object used for gwave.
  */
@@ -533,7 +1589,8 @@ cmd_show_wave_list(GtkWidget *w, GWDataFile *wdata)
 		gtk_label_set_justify(GTK_LABEL(label), GTK_JUSTIFY_LEFT);
 		gtk_widget_show(label);
 		gtk_box_pack_start (GTK_BOX (box1), label, FALSE, FALSE, 0);
-
+		if(wdata->load)
+			wavelist_add_load_box(wdata, box1);
 
 
 		scrolled_window = gtk_scrolled_window_new (NULL, NULL);
@@ -905,7 +1962,7 @@ SCM_DEFINE(export_variables, "export-variables", 2, 2, 0,
 	WaveVar *wv;
 	WaveVar *iv = NULL;
 	double from_val, to_val;
-	int starti, endi, i;
+	SSIndex starti, endi, i;
 	double x,y;
 	int idx;
 	char buf[128];
@@ -917,6 +1974,9 @@ SCM_DEFINE(export_variables, "export-variables", 2, 2, 0,
 		if(!wv) {
 			scm_misc_error(FUNC_NAME, "invalid WaveVar ~s", SCM_LIST1(v));
 		}
+		if(wv_is_lazy(wv) && wv_load(wv) < 0) {
+			scm_misc_error(FUNC_NAME, "failed to read data for ~s", SCM_LIST1(v));
+		}
 		if(iv == NULL)
 			iv = wv->wv_iv;
 		else if(iv != wv->wv_iv) {
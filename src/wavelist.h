@@ -88,6 +88,20 @@ struct _GWDataFile {
 	int outstanding_smob;	/* if the guile world has a pointer, defer freeing. */
 	int ndv;
 	GSList *wvhl;
+	WFLoad *load;		/* while the file is read in the background */
+	int reloading;		/* it is being read again; keep showing wf */
+	guint load_timer;	/* timeout that watches the load */
+	int load_polls;
+	GtkWidget *load_box;	/* progress bar and cancel button */
+	GtkWidget *load_pbar;
+	guint follow_timer;	/* timeout that reads rows added to the file */
+	char *watch_name;	/* if watched for changes by auto-reload-files!, */
+	int watch_wd;		/* its name within its directory, and the */
+				/* inotify watch on that, or -1 if polled */
+	int reload_pending;	/* changed; reload once it has settled */
+	double changed_at;	/* when it was last seen to change */
+	gint64 seen_size;	/* its size and mtime when last looked at */
+	gint64 seen_mtime;
 };
 
 /* given a wavevar, how to get back to a gwdatafile... follow pointers